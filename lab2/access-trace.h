@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Трасса доступа LAB2_TRACE_DIR. Две текстовые строки: путь файла и строка с инодом, размером
+// страницы и числом страниц. Дальше сами страницы в двоичном виде: номер страницы как разность
+// с предыдущей, zigzag и varint. Последовательное чтение - байт на страницу
+constexpr const char *ACCESS_TRACE_HEADER = "# lab2 access trace of ";
+constexpr size_t ACCESS_TRACE_LINE_MAX = 4096 + 64; // Longest text line, the path is at most PATH_MAX
+
+struct AccessTraceInfo {
+    uint64_t inode;
+    uint64_t pageSize;          // Page size of the run that recorded the trace
+    uint64_t pages;             // Pages after the text lines
+};
+
+inline int format_trace_info(char *line, size_t size, const AccessTraceInfo &info) {
+    return snprintf(line, size, "# inode %llu page %llu pages %llu\n", static_cast<unsigned long long>(info.inode),
+                    static_cast<unsigned long long>(info.pageSize), static_cast<unsigned long long>(info.pages));
+}
+
+inline bool parse_trace_info(const char *line, AccessTraceInfo &info) {
+    unsigned long long inode, page_size, pages;
+    if (sscanf(line, "# inode %llu page %llu pages %llu", &inode, &page_size, &pages) != 3 || page_size == 0) {
+        return false;
+    }
+    info = {inode, page_size, pages};
+    return true;
+}
+
+// Дописываем страницу page (номер, не смещение), previous - номер предыдущей
+inline void append_trace_page(std::vector<uint8_t> &encoded, uint64_t &previous, uint64_t page) {
+    auto delta = static_cast<int64_t>(page - previous);
+    uint64_t value = (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63);
+    while (value >= 0x80) {
+        encoded.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    encoded.push_back(static_cast<uint8_t>(value));
+    previous = page;
+}
+
+// false, если данные кончились посреди числа
+inline bool next_trace_page(const uint8_t *&position, const uint8_t *end, uint64_t &previous, uint64_t &page) {
+    uint64_t value = 0;
+    for (unsigned shift = 0; position < end && shift < 64; shift += 7) {
+        uint8_t byte = *position++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            page = previous + ((value >> 1) ^ (0 - (value & 1)));
+            previous = page;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Строка с инодом и страницы за ней, первую строку с путем вызывающий уже прочитал.
+// false, если трасса обрезана или это не трасса lab2
+inline bool read_trace_pages(FILE *trace, AccessTraceInfo &info, std::vector<uint64_t> &pages) {
+    char line[ACCESS_TRACE_LINE_MAX];
+    if (!fgets(line, sizeof(line), trace) || !parse_trace_info(line, info)) {
+        return false;
+    }
+    std::vector<uint8_t> encoded;
+    uint8_t chunk[4096];
+    size_t bytes;
+    while ((bytes = fread(chunk, 1, sizeof(chunk), trace)) > 0) {
+        encoded.insert(encoded.end(), chunk, chunk + bytes);
+    }
+    const uint8_t *position = encoded.data(), *end = encoded.data() + encoded.size();
+    uint64_t previous = 0, page;
+    pages.clear();
+    while (pages.size() < info.pages && next_trace_page(position, end, previous, page)) {
+        pages.push_back(page);
+    }
+    return pages.size() == info.pages && position == end;
+}
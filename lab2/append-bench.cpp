@@ -0,0 +1,152 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lab2.h"
+#include "test-util.h"
+
+constexpr size_t PAGE_SIZE = 4096;
+constexpr size_t APPEND_RECORD = 128;
+constexpr size_t RECORDS_PER_FSYNC = 16;    // A log that commits every 2 KB, half a page
+constexpr size_t UPDATE_RECORD = 64;
+constexpr size_t UPDATE_PAGES = 1024;       // 4 MB file updated at random, not cached before the run
+const char *APPEND_FILE = "append-bench-log.dat";
+const char *UPDATE_FILE = "append-bench-update.dat";
+
+// What one scenario cost, filled in by the child process
+struct Result {
+    double recordsPerSecond;
+    uint64_t diskBytesRead;
+    uint64_t diskBytesWritten;
+    bool ok;
+};
+
+struct Run {
+    Result append;
+    Result update;
+};
+
+// Record i is filled with the byte i, so a lost or misplaced record is easy to spot
+void fill_record(char *record, size_t size, size_t i) {
+    memset(record, static_cast<int>(i % 251 + 1), size);
+}
+
+// Checks the file with plain reads, past the cache
+bool file_matches(const char *name, const std::vector<char> &expected) {
+    int fd = open(name, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    std::vector<char> actual(expected.size());
+    ssize_t bytes = pread(fd, actual.data(), actual.size(), 0);
+    close(fd);
+    return bytes == static_cast<ssize_t>(actual.size()) && actual == expected;
+}
+
+// Times the scenario and takes the disk traffic from the process counters
+template<typename Body>
+void measure(Result &result, size_t records, Body body) {
+    lab2_stats before, after;
+    lab2_get_stats(getpid(), &before);
+    auto start = std::chrono::steady_clock::now();
+    result.ok = body();
+    auto end = std::chrono::steady_clock::now();
+    lab2_get_stats(getpid(), &after);
+    result.recordsPerSecond = static_cast<double>(records) / std::chrono::duration<double>(end - start).count();
+    result.diskBytesRead = after.diskBytesRead - before.diskBytesRead;
+    result.diskBytesWritten = after.diskBytesWritten - before.diskBytesWritten;
+}
+
+// Appends small records to an empty log and fsyncs after every few of them
+bool append_log(size_t records) {
+    int fd = lab2_open(APPEND_FILE, O_RDWR);
+    if (fd < 0) {
+        return false;
+    }
+    std::vector<char> expected(records * APPEND_RECORD);
+    bool ok = true;
+    for (size_t i = 0; i < records && ok; i++) {
+        char *record = expected.data() + i * APPEND_RECORD;
+        fill_record(record, APPEND_RECORD, i);
+        ok = lab2_write(fd, record, APPEND_RECORD) == APPEND_RECORD;
+        if (ok && (i + 1) % RECORDS_PER_FSYNC == 0) {
+            ok = lab2_fsync(fd) == 0;
+        }
+    }
+    ok = ok && lab2_fsync(fd) == 0;
+    lab2_close(fd);
+    return ok && file_matches(APPEND_FILE, expected);
+}
+
+// Overwrites small records at random places of a file whose pages are not in the cache
+bool update_records(size_t records) {
+    int fd = lab2_open(UPDATE_FILE, O_RDWR);
+    if (fd < 0) {
+        return false;
+    }
+    std::vector<char> expected(UPDATE_PAGES * PAGE_SIZE, 0);
+    std::mt19937 gen(11);
+    std::uniform_int_distribution<size_t> slot_dis(0, expected.size() / UPDATE_RECORD - 1);
+    bool ok = true;
+    for (size_t i = 0; i < records && ok; i++) {
+        off_t offset = static_cast<off_t>(slot_dis(gen) * UPDATE_RECORD);
+        char *record = expected.data() + offset;
+        fill_record(record, UPDATE_RECORD, i);
+        ok = lab2_pwrite(fd, record, UPDATE_RECORD, offset) == UPDATE_RECORD;
+    }
+    ok = ok && lab2_fsync(fd) == 0;
+    lab2_close(fd);
+    return ok && file_matches(UPDATE_FILE, expected);
+}
+
+bool run_mode(const char *sectors, size_t records, Run &result) {
+    if (!create_sparse_file(APPEND_FILE, 0) || !create_sparse_file(UPDATE_FILE, UPDATE_PAGES * PAGE_SIZE)) {
+        return false;
+    }
+    setenv("LAB2_SECTORS", sectors, 1);
+    bool exited = run_in_child(result, [&](Run &run) {
+        initialize_library();
+        measure(run.append, records, [&] { return append_log(records); });
+        measure(run.update, records, [&] { return update_records(records); });
+        return true;
+    });
+    return exited && result.append.ok && result.update.ok;
+}
+
+void print_result(const char *mode, const char *scenario, const Result &result, size_t record_bytes, size_t records) {
+    auto bytes = static_cast<double>(record_bytes * records);
+    std::cout << mode << " | " << scenario << " | " << result.recordsPerSecond << " | "
+              << static_cast<double>(result.diskBytesWritten) / bytes << " | "
+              << static_cast<double>(result.diskBytesRead) / bytes << "\n";
+}
+
+int main(int argc, char *argv[]) {
+    size_t records = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000;
+    Run pages = {}, sectors = {};
+    bool ok = run_mode("0", records, pages) && run_mode("1", records, sectors);
+    unsetenv("LAB2_SECTORS");
+    unlink(APPEND_FILE);
+    unlink(UPDATE_FILE);
+    if (!ok) {
+        std::cerr << "Run failed or the file does not hold the written records.\n";
+        return 1;
+    }
+
+    std::cout << "unit | scenario | records/s | disk bytes written per record byte | disk bytes read per record byte\n";
+    print_result("page", "append + fsync", pages.append, APPEND_RECORD, records);
+    print_result("sector", "append + fsync", sectors.append, APPEND_RECORD, records);
+    print_result("page", "random update", pages.update, UPDATE_RECORD, records);
+    print_result("sector", "random update", sectors.update, UPDATE_RECORD, records);
+
+    if (sectors.append.diskBytesWritten > pages.append.diskBytesWritten ||
+        sectors.update.diskBytesWritten > pages.update.diskBytesWritten ||
+        sectors.update.diskBytesRead > pages.update.diskBytesRead) {
+        std::cerr << "Sector tracking moved more bytes to or from the disk than whole pages.\n";
+        return 1;
+    }
+    return 0;
+}
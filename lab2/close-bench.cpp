@@ -0,0 +1,72 @@
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lab2.h"
+#include "test-util.h"
+
+constexpr size_t PAGE_SIZE = 4096;
+const char *LARGE_FILE_NAME = "close-bench-large.dat";
+
+// Reads the whole large file through the cache so its pages occupy the frames
+bool fill_cache(int fd) {
+    std::vector<char> buffer(16 * PAGE_SIZE);
+    lab2_lseek(fd, 0, SEEK_SET);
+    ssize_t bytes_read;
+    while ((bytes_read = lab2_read(fd, buffer.data(), buffer.size())) > 0) {
+    }
+    return bytes_read == 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t large_mb = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 64;
+    size_t small_files = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000;
+
+    size_t large_pages = large_mb * 1024 * 1024 / PAGE_SIZE;
+    if (!create_file(LARGE_FILE_NAME, large_pages, PAGE_SIZE, [](size_t, std::vector<char> &page) {
+        std::fill(page.begin(), page.end(), 'L');
+    })) {
+        std::cerr << "Failed to create " << LARGE_FILE_NAME << ".\n";
+        return 1;
+    }
+    initialize_library();
+    int large_fd = lab2_open(LARGE_FILE_NAME, O_RDONLY);
+    if (large_fd < 0 || !fill_cache(large_fd)) {
+        std::cerr << "Failed to read " << LARGE_FILE_NAME << ".\n";
+        unlink(LARGE_FILE_NAME);
+        return 1;
+    }
+
+    // Many small files: one dirty page each, then close. The large file stays open and cached
+    std::vector<char> page(PAGE_SIZE, 's');
+    double close_us = 0, max_close_us = 0;
+    int status = 0;
+    for (size_t i = 0; i < small_files && status == 0; i++) {
+        std::string name = "close-bench-small-" + std::to_string(i) + ".dat";
+        int fd = lab2_open(name.c_str(), O_RDWR | O_CREAT);
+        if (fd < 0 || lab2_write(fd, page.data(), PAGE_SIZE) != PAGE_SIZE) {
+            std::cerr << "Failed to write " << name << ".\n";
+            status = 1;
+        }
+        auto start = std::chrono::steady_clock::now();
+        if (fd >= 0 && lab2_close(fd) != 0) {
+            status = 1;
+        }
+        auto end = std::chrono::steady_clock::now();
+        double us = std::chrono::duration<double, std::micro>(end - start).count();
+        close_us += us;
+        max_close_us = std::max(max_close_us, us);
+        unlink(name.c_str());
+    }
+
+    if (status == 0) {
+        std::cout << small_files << " small files closed with a " << large_mb << " MB file cached: "
+                  << close_us / small_files << " us per close, " << max_close_us << " us max\n";
+    }
+    lab2_close(large_fd);
+    unlink(LARGE_FILE_NAME);
+    return status;
+}
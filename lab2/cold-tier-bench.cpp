@@ -0,0 +1,131 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lab2.h"
+#include "test-util.h"
+
+constexpr size_t PAGE_SIZE = 4096;
+const char *FILE_NAME = "cold-tier-bench.log";
+
+// What one run cost, filled in by the child process
+struct Result {
+    double readsPerSecond;
+    double diskBytesPerRead;
+    double coldHitPercent;
+    double compressionRatio;
+    uint64_t coldPages;
+    bool ok;
+};
+
+// Log lines like a web server writes: the same words with a few changing numbers, compress about 4x
+std::vector<char> make_log(size_t bytes) {
+    std::vector<char> log;
+    log.reserve(bytes + 256);
+    std::mt19937 gen(5);
+    // result_type is wider than unsigned on LP64, the format wants unsigned
+    auto next = [&gen] { return static_cast<unsigned>(gen()); };
+    const char *levels[] = {"INFO", "INFO", "INFO", "WARN", "DEBUG"};
+    const char *paths[] = {"/api/v1/items", "/api/v1/users", "/static/app.js", "/api/v1/orders", "/health"};
+    char line[256];
+    for (size_t i = 0; log.size() < bytes; i++) {
+        int length = snprintf(line, sizeof(line),
+                              "2024-12-02T03:%02zu:%02zu.%03u %s [worker-%u] GET %s/%u status=%u bytes=%u id=%08x\n",
+                              i / 60000 % 60, i / 1000 % 60, next() % 1000, levels[next() % 5], next() % 8,
+                              paths[next() % 5], next() % 10000, next() % 16 ? 200u : 404u, next() % 65536, next());
+        log.insert(log.end(), line, line + length);
+    }
+    log.resize(bytes);
+    return log;
+}
+
+// Child: reads the whole file once, so most of it is evicted, then reads random pages and checks them
+void measure(const std::vector<char> &log, size_t reads, Result &result) {
+    initialize_library();
+    int fd = lab2_open(FILE_NAME, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    std::vector<char> page(PAGE_SIZE);
+    size_t pages = log.size() / PAGE_SIZE;
+    bool ok = true;
+    for (size_t p = 0; p < pages && ok; p++) {
+        ok = lab2_pread(fd, page.data(), PAGE_SIZE, static_cast<off_t>(p * PAGE_SIZE)) == PAGE_SIZE;
+    }
+
+    lab2_stats before, after;
+    lab2_get_stats(getpid(), &before);
+    std::mt19937_64 gen(42);
+    std::uniform_int_distribution<size_t> dis(0, pages - 1);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reads && ok; i++) {
+        size_t offset = dis(gen) * PAGE_SIZE;
+        ok = lab2_pread(fd, page.data(), PAGE_SIZE, static_cast<off_t>(offset)) == PAGE_SIZE &&
+             memcmp(page.data(), log.data() + offset, PAGE_SIZE) == 0;
+    }
+    auto end = std::chrono::steady_clock::now();
+    lab2_get_stats(getpid(), &after);
+    lab2_close(fd);
+
+    uint64_t cold_hits = after.coldHits - before.coldHits, cold_misses = after.coldMisses - before.coldMisses;
+    result.readsPerSecond = static_cast<double>(reads) / std::chrono::duration<double>(end - start).count();
+    result.diskBytesPerRead = static_cast<double>(after.diskBytesRead - before.diskBytesRead) / static_cast<double>(reads);
+    result.coldHitPercent = cold_hits + cold_misses ? 100.0 * static_cast<double>(cold_hits) /
+                                                      static_cast<double>(cold_hits + cold_misses) : 0;
+    result.compressionRatio = after.coldCompressedBytes ? static_cast<double>(after.coldPageBytes) /
+                                                         static_cast<double>(after.coldCompressedBytes) : 0;
+    result.coldPages = after.coldPages;
+    result.ok = ok;
+}
+
+// The cache holds a quarter of the file, the tier gets half of its size in compressed bytes
+bool run(const std::vector<char> &log, size_t reads, bool cold_tier, Result &result) {
+    bool exited = run_in_child(result, [&](Result &shared) {
+        setenv("LAB2_CACHE_SIZE", std::to_string(log.size() / 4).c_str(), 1);
+        setenv("LAB2_COLD_SIZE", cold_tier ? std::to_string(log.size() / 2).c_str() : "0", 1);
+        setenv("LAB2_L1_SIZE", "0", 1);
+        measure(log, reads, shared);
+        return true;
+    });
+    return exited && result.ok;
+}
+
+int main(int argc, char *argv[]) {
+    size_t file_mb = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 64;
+    size_t reads = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 200000;
+    if (file_mb == 0 || reads == 0) {
+        std::cerr << "Usage: cold-tier-bench [file_mb] [random reads]\n";
+        return 1;
+    }
+    std::vector<char> log = make_log(file_mb * 1024 * 1024);
+    int create_fd = open(FILE_NAME, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    bool created = create_fd >= 0 && write(create_fd, log.data(), log.size()) == static_cast<ssize_t>(log.size());
+    if (create_fd >= 0) {
+        close(create_fd);
+    }
+    Result plain = {}, cold = {};
+    bool ok = created && run(log, reads, false, plain) && run(log, reads, true, cold);
+    unlink(FILE_NAME);
+    if (!ok) {
+        std::cerr << "Run failed or a page read back wrong.\n";
+        return 1;
+    }
+
+    std::cout << file_mb << " MB log, cache of a quarter of it, " << reads << " random page reads\n";
+    std::cout << "tier | reads/s | disk bytes per read | tier hit % | compression ratio | pages in tier\n";
+    for (auto &[name, result]: {std::pair{"off", &plain}, std::pair{"compressed", &cold}}) {
+        std::cout << name << " | " << result->readsPerSecond << " | " << result->diskBytesPerRead << " | "
+                  << result->coldHitPercent << " | " << result->compressionRatio << " | " << result->coldPages << "\n";
+    }
+    if (cold.diskBytesPerRead >= plain.diskBytesPerRead) {
+        std::cerr << "The compressed tier did not save disk reads.\n";
+        return 1;
+    }
+    return 0;
+}
@@ -1,20 +1,20 @@
 #include <iostream>
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <unistd.h>
 #include <fcntl.h>
+#include "lab2.h"
 
 #define BUFFER_SIZE 32768 // 32 KiB
 
-// Declare functions from the library
-extern "C" {
-int lab2_open(const char *path, int flags);
-int lab2_close(int fd);
-ssize_t lab2_read(int fd, void *buf, size_t count);
-ssize_t lab2_write(int fd, const void *buf, size_t count);
-off_t lab2_lseek(int fd, off_t offset, int whence);
-int lab2_fsync(int fd);
-void initialize_library();
+// Checks matches that start in data[0, starts_end) and fit into data[0, size)
+void search_in_chunk(const char *data, size_t size, size_t starts_end, const char *substring, size_t substring_len) {
+    for (size_t i = 0; i < starts_end && i + substring_len <= size; i++) {
+        if (std::strncmp(&data[i], substring, substring_len) == 0) {
+//            std::cout << "Found substring at chunk position " << i << std::endl;
+        }
+    }
 }
 
 void search_substring(const char *filename, const char *substring, int repetitions) {
@@ -24,11 +24,18 @@ void search_substring(const char *filename, const char *substring, int repetitio
         std::cerr << "Error opening file" << std::endl;
         exit(EXIT_FAILURE);
     }
+    // The file is scanned front to back; a single pass will not come back to its pages, so they
+    // should not push pages of other users out of the cache
+    lab2_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    if (repetitions == 1) {
+        lab2_fadvise(fd, 0, 0, POSIX_FADV_NOREUSE);
+    }
 
     size_t substring_len = std::strlen(substring);
-    char buffer[BUFFER_SIZE + substring_len - 1]; // Buffer with extra space for overlap
+    size_t overlap = substring_len - 1;
+    char boundary[2 * overlap + 1]; // Tail of previous pages plus head of the current one
     ssize_t bytes_read;
-    ssize_t overlap = substring_len - 1;
+    lab2_view view;
 
     for (int rep = 0; rep < repetitions; rep++) {
         if (lab2_lseek(fd, 0, SEEK_SET) == -1) {
@@ -36,22 +43,28 @@ void search_substring(const char *filename, const char *substring, int repetitio
             lab2_close(fd);
             exit(EXIT_FAILURE);
         }
-        ssize_t total_bytes_read = 0;
+        size_t carried = 0;
 
-        while ((bytes_read = lab2_read(fd, buffer + total_bytes_read, BUFFER_SIZE)) > 0) {
-            total_bytes_read += bytes_read;
+        // Scan the cache pages in place, no copy into a private buffer
+        while ((bytes_read = lab2_read_view(fd, BUFFER_SIZE, &view)) > 0) {
+            auto size = static_cast<size_t>(bytes_read);
 
-            for (ssize_t i = 0; i <= total_bytes_read - substring_len; i++) {
-                if (std::strncmp(&buffer[i], substring, substring_len) == 0) {
-//                    std::cout << "Found substring at position "
-//                              << i + lab2_lseek(fd, 0, SEEK_CUR) - total_bytes_read
-//                              << " in repetition " << rep << std::endl;
-                }
-            }
+            // Matches that cross the page boundary start inside the carried tail
+            size_t head = std::min(size, overlap);
+            std::memcpy(boundary + carried, view.data, head);
+            search_in_chunk(boundary, carried + head, carried, substring, substring_len);
+            search_in_chunk(view.data, size, size, substring, substring_len);
 
-            // Move last `overlap` bytes to the start of the buffer
-            std::memmove(buffer, buffer + total_bytes_read - overlap, overlap);
-            total_bytes_read = overlap;
+            // Keep the last `overlap` bytes seen so far for the next page
+            size_t keep = std::min(carried + size, overlap);
+            if (size >= keep) {
+                std::memcpy(boundary, view.data + size - keep, keep);
+            } else {
+                std::memmove(boundary, boundary + carried + size - keep, keep - size);
+                std::memcpy(boundary + keep - size, view.data, size);
+            }
+            carried = keep;
+            lab2_unpin_view(&view);
         }
     }
 
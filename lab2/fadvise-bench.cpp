@@ -0,0 +1,170 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "lab2.h"
+#include "test-util.h"
+
+constexpr size_t PAGE_SIZE = 4096;
+constexpr size_t HOT_PAGES = 512;       // 2 MB read at random, half of the cache
+constexpr size_t SCAN_PAGES = 4096;     // 16 MB scanned front to back, four times the cache
+constexpr size_t SCAN_CHUNK = 32 * PAGE_SIZE;
+constexpr unsigned long long HOT_READS_PER_CHUNK = 16; // Fixed mix, so both runs see the same access pattern
+const char *HOT_FILE = "fadvise-bench-hot.dat";
+const char *SCAN_FILE = "fadvise-bench-scan.dat";
+
+// Shared by the two processes of a run
+struct Run {
+    std::atomic<bool> warm;         // The hot set is in the cache, the scan may start
+    std::atomic<bool> scanDone;
+    std::atomic<unsigned long long> scannedChunks;
+    std::atomic<unsigned long long> hotReads;
+    std::atomic<bool> failed;       // The hot reader gave up, the scanner must not wait for it
+    double hotHitPercent;
+    double scanMbPerSecond;
+};
+
+// Reads the whole hot set once, then HOT_READS_PER_CHUNK random pages of it per chunk the scanner
+// reads, and reports how many of those reads hit the cache
+int hot_reader(Run &run) {
+    initialize_library();
+    int fd = lab2_open(HOT_FILE, O_RDONLY);
+    if (fd < 0) {
+        run.failed = true;
+        run.warm = true;
+        return 1;
+    }
+    lab2_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+    std::vector<uint64_t> buffer(PAGE_SIZE / sizeof(uint64_t));
+    for (size_t p = 0; p < HOT_PAGES; p++) {
+        if (lab2_pread(fd, buffer.data(), PAGE_SIZE, static_cast<off_t>(p * PAGE_SIZE)) != PAGE_SIZE) {
+            run.failed = true;
+            run.warm = true;
+            return 1;
+        }
+    }
+    lab2_stats before, after;
+    lab2_get_stats(getpid(), &before);
+    run.warm = true;
+
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<size_t> dis(0, HOT_PAGES - 1);
+    while (!run.scanDone) {
+        if (run.hotReads >= run.scannedChunks * HOT_READS_PER_CHUNK) {
+            sched_yield();
+            continue;
+        }
+        size_t page = dis(gen);
+        if (lab2_pread(fd, buffer.data(), PAGE_SIZE, static_cast<off_t>(page * PAGE_SIZE)) != PAGE_SIZE ||
+            buffer[0] != page) {
+            run.failed = true;
+            return 1;
+        }
+        run.hotReads++;
+    }
+    lab2_get_stats(getpid(), &after);
+    auto hits = static_cast<double>(after.hits - before.hits);
+    auto misses = static_cast<double>(after.misses - before.misses);
+    run.hotHitPercent = hits + misses > 0 ? 100 * hits / (hits + misses) : 100;
+    lab2_close(fd);
+    return 0;
+}
+
+// Scans the big file passes times, with or without telling the cache it is a one-pass scan
+int scanner(Run &run, int passes, bool advise) {
+    initialize_library();
+    int fd = lab2_open(SCAN_FILE, O_RDONLY);
+    if (fd < 0) {
+        run.scanDone = true;
+        return 1;
+    }
+    if (advise) {
+        lab2_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        lab2_fadvise(fd, 0, 0, POSIX_FADV_NOREUSE);
+    }
+    while (!run.warm) {
+        usleep(1000);
+    }
+    std::vector<char> buffer(SCAN_CHUNK);
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        lab2_lseek(fd, 0, SEEK_SET);
+        while (lab2_read(fd, buffer.data(), SCAN_CHUNK) > 0) {
+            run.scannedChunks++;
+            while (run.hotReads < run.scannedChunks * HOT_READS_PER_CHUNK && !run.failed) {
+                sched_yield();
+            }
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    run.scanMbPerSecond = static_cast<double>(passes * SCAN_PAGES * PAGE_SIZE) / (1024 * 1024) /
+                          std::chrono::duration<double>(end - start).count();
+    run.scanDone = true;
+    lab2_close(fd);
+    return 0;
+}
+
+bool measure(int passes, bool advise, Run &result) {
+    auto *run = static_cast<Run *>(mmap(nullptr, sizeof(Run), PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (run == MAP_FAILED) {
+        return false;
+    }
+    std::cout.flush();
+    pid_t children[2];
+    for (int child = 0; child < 2; child++) {
+        children[child] = fork();
+        if (children[child] == 0) {
+            exit(child == 0 ? hot_reader(*run) : scanner(*run, passes, advise));
+        }
+    }
+    bool ok = true;
+    for (pid_t child: children) {
+        int status;
+        waitpid(child, &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    result.hotHitPercent = run->hotHitPercent;
+    result.hotReads = run->hotReads.load();
+    result.scanMbPerSecond = run->scanMbPerSecond;
+    munmap(run, sizeof(Run));
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    int passes = argc > 1 ? std::atoi(argv[1]) : 4;
+    // The cache is a quarter of the scanned file, so every pass pushes pages out
+    setenv("LAB2_CACHE_SIZE", "4M", 1);
+    if (!create_numbered_file(HOT_FILE, HOT_PAGES, PAGE_SIZE) ||
+        !create_numbered_file(SCAN_FILE, SCAN_PAGES, PAGE_SIZE)) {
+        std::cerr << "Failed to create files.\n";
+        return 1;
+    }
+
+    Run plain = {}, advised = {};
+    bool ok = measure(passes, false, plain) && measure(passes, true, advised);
+    unlink(HOT_FILE);
+    unlink(SCAN_FILE);
+    if (!ok) {
+        std::cerr << "Run failed.\n";
+        return 1;
+    }
+
+    std::cout << "scan advice | hot set hit % | hot reads during the scan | scan MB/s (with the hot reads)\n";
+    for (auto &[name, run]: {std::pair{"none", &plain}, std::pair{"SEQUENTIAL + NOREUSE", &advised}}) {
+        std::cout << name << " | " << run->hotHitPercent << " | " << run->hotReads << " | " << run->scanMbPerSecond
+                  << "\n";
+    }
+    if (advised.hotHitPercent < plain.hotHitPercent) {
+        std::cerr << "The advised scan evicted more of the hot set than the plain one.\n";
+        return 1;
+    }
+    return 0;
+}
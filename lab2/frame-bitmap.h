@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Битмап по фреймам кэша: бит i - флаг фрейма i. Флаги лежат плотно, так что стрелка клока
+// и фоновый сброс смотрят 64 фрейма за одно чтение, а не по строке кэша на фрейм.
+// Живет в общей памяти, слова лежат сразу за заголовком: выделить надо bytes_for(frames) байт
+struct FrameBitmap {
+    static constexpr size_t BITS = 64;
+
+    size_t frameCount;          // Число фреймов
+    size_t wordCount;           // Число слов по BITS фреймов
+
+    static size_t words_for(size_t frames) {
+        return (frames + BITS - 1) / BITS;
+    }
+
+    static size_t bytes_for(size_t frames) {
+        return sizeof(FrameBitmap) + words_for(frames) * sizeof(std::atomic<uint64_t>);
+    }
+
+    std::atomic<uint64_t> *words() {
+        return reinterpret_cast<std::atomic<uint64_t> *>(this + 1);
+    }
+
+    const std::atomic<uint64_t> *words() const {
+        return reinterpret_cast<const std::atomic<uint64_t> *>(this + 1);
+    }
+
+    void init(size_t frames) {
+        frameCount = frames;
+        wordCount = words_for(frames);
+        for (size_t i = 0; i < wordCount; i++) {
+            words()[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Биты слова, которые соответствуют настоящим фреймам (последнее слово может быть неполным)
+    uint64_t valid_mask(size_t word) const {
+        size_t bits = std::min(BITS, frameCount - word * BITS);
+        return bits == BITS ? ~0ULL : (1ULL << bits) - 1;
+    }
+
+    bool test(size_t frame, std::memory_order order = std::memory_order_seq_cst) const {
+        return words()[frame / BITS].load(order) >> (frame % BITS) & 1;
+    }
+
+    // set и clear возвращают прежнее значение бита
+    bool set(size_t frame, std::memory_order order = std::memory_order_seq_cst) {
+        uint64_t bit = 1ULL << (frame % BITS);
+        return words()[frame / BITS].fetch_or(bit, order) & bit;
+    }
+
+    bool clear(size_t frame, std::memory_order order = std::memory_order_seq_cst) {
+        uint64_t bit = 1ULL << (frame % BITS);
+        return words()[frame / BITS].fetch_and(~bit, order) & bit;
+    }
+
+    // Ставим бит, только если его нет: на попадании слово обычно только читается,
+    // и соседние фреймы не дерутся за его строку кэша
+    void mark(size_t frame) {
+        if (!test(frame, std::memory_order_relaxed)) {
+            set(frame, std::memory_order_relaxed);
+        }
+    }
+};
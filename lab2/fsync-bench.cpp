@@ -0,0 +1,82 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lab2.h"
+
+constexpr size_t PAGE_SIZE = 4096;
+const char *FILE_NAME = "fsync-bench.dat";
+
+// Write syscalls of this process so far (pwritev counts as one)
+unsigned long long write_syscalls() {
+    std::ifstream io("/proc/self/io");
+    std::string name;
+    unsigned long long value;
+    while (io >> name >> value) {
+        if (name == "syscw:") {
+            return value;
+        }
+    }
+    return 0;
+}
+
+// Dirties `pages` pages with the given stride and measures one lab2_fsync
+bool measure(int fd, size_t pages, size_t stride, int rounds, double &latency_ms, double &syscalls) {
+    std::vector<char> page(PAGE_SIZE);
+    latency_ms = 0;
+    syscalls = 0;
+    for (int round = 0; round < rounds; round++) {
+        for (size_t p = 0; p < pages; p++) {
+            std::fill(page.begin(), page.end(), static_cast<char>('a' + (p + round) % 26));
+            lab2_lseek(fd, static_cast<off_t>(p * stride * PAGE_SIZE), SEEK_SET);
+            if (lab2_write(fd, page.data(), PAGE_SIZE) != PAGE_SIZE) {
+                return false;
+            }
+        }
+        unsigned long long syscalls_before = write_syscalls();
+        auto start = std::chrono::steady_clock::now();
+        if (lab2_fsync(fd) != 0) {
+            return false;
+        }
+        auto end = std::chrono::steady_clock::now();
+        latency_ms += std::chrono::duration<double, std::milli>(end - start).count();
+        syscalls += static_cast<double>(write_syscalls() - syscalls_before);
+    }
+    latency_ms /= rounds;
+    syscalls /= rounds;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    size_t max_pages = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4096;
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+
+    initialize_library();
+    int fd = lab2_open(FILE_NAME, O_RDWR | O_CREAT);
+    if (fd < 0) {
+        std::cerr << "Failed to open file.\n";
+        return 1;
+    }
+
+    std::cout << "dirty pages | contiguous: ms, write syscalls | every other page: ms, write syscalls\n";
+    for (size_t pages = 1; pages <= max_pages; pages *= 4) {
+        double contiguous_ms, contiguous_syscalls, strided_ms, strided_syscalls;
+        if (!measure(fd, pages, 1, rounds, contiguous_ms, contiguous_syscalls) ||
+            !measure(fd, pages, 2, rounds, strided_ms, strided_syscalls)) {
+            std::cerr << "Write or fsync failed.\n";
+            lab2_close(fd);
+            unlink(FILE_NAME);
+            return 1;
+        }
+        std::cout << pages << " | " << contiguous_ms << ", " << contiguous_syscalls
+                  << " | " << strided_ms << ", " << strided_syscalls << "\n";
+    }
+
+    lab2_close(fd);
+    unlink(FILE_NAME);
+    return 0;
+}
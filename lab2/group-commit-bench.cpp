@@ -0,0 +1,151 @@
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "lab2.h"
+
+constexpr size_t PAGE_SIZE = 4096;
+const char *FILE_NAME = "group-commit-bench.dat";
+
+// Shared by the committers of a run, followed by the latency of every commit
+struct Run {
+    std::atomic<int> ready;         // Committers that opened the file, they start together
+    std::atomic<uint64_t> deviceFlushes;
+    std::atomic<bool> failed;
+    uint64_t latencyNs[];           // Committer c, commit i at c * commits + i
+};
+
+struct Result {
+    double commitsPerSecond;
+    double p50Us;
+    double p99Us;
+    double flushesPerCommit;
+};
+
+// Committer c owns page c of the file: writes a record there and fsyncs it, commits times.
+// Every word of the record is c * commits + i, so the last one is easy to check
+void committer(Run &run, int committers, size_t commits, int c) {
+    initialize_library();
+    int fd = lab2_open(FILE_NAME, O_RDWR);
+    if (fd < 0) {
+        run.failed = true;
+        run.ready++;
+        exit(1);
+    }
+    lab2_stats before, after;
+    lab2_get_stats(getpid(), &before);
+    run.ready++;
+    while (run.ready < committers) {
+        sched_yield();
+    }
+    std::vector<uint64_t> record(PAGE_SIZE / sizeof(uint64_t));
+    for (size_t i = 0; i < commits && !run.failed; i++) {
+        std::fill(record.begin(), record.end(), c * commits + i);
+        auto start = std::chrono::steady_clock::now();
+        if (lab2_pwrite(fd, record.data(), PAGE_SIZE, static_cast<off_t>(c * PAGE_SIZE)) != PAGE_SIZE ||
+            lab2_fsync(fd) != 0) {
+            run.failed = true;
+            break;
+        }
+        run.latencyNs[c * commits + i] =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+    lab2_get_stats(getpid(), &after);
+    run.deviceFlushes += after.deviceFlushes - before.deviceFlushes;
+    lab2_close(fd);
+    exit(run.failed ? 1 : 0);
+}
+
+// The file as fsync left it: page c holds the last record of committer c
+bool file_holds_last_records(int committers, size_t commits) {
+    int fd = open(FILE_NAME, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    std::vector<uint64_t> page(PAGE_SIZE / sizeof(uint64_t));
+    bool ok = true;
+    for (int c = 0; c < committers && ok; c++) {
+        ok = pread(fd, page.data(), PAGE_SIZE, static_cast<off_t>(c * PAGE_SIZE)) == PAGE_SIZE &&
+             page[0] == c * commits + commits - 1 && page.back() == page[0];
+    }
+    close(fd);
+    return ok;
+}
+
+bool measure(const char *group_commit, int committers, size_t commits, Result &result) {
+    int create_fd = open(FILE_NAME, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (create_fd < 0 || ftruncate(create_fd, static_cast<off_t>(committers * PAGE_SIZE)) != 0) {
+        return false;
+    }
+    close(create_fd);
+    size_t run_size = sizeof(Run) + committers * commits * sizeof(uint64_t);
+    auto *run = static_cast<Run *>(mmap(nullptr, run_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (run == MAP_FAILED) {
+        return false;
+    }
+    setenv("LAB2_GROUP_COMMIT", group_commit, 1);
+    std::cout.flush();
+    auto start = std::chrono::steady_clock::now();
+    std::vector<pid_t> children;
+    for (int c = 0; c < committers; c++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            committer(*run, committers, commits, c);
+        }
+        children.push_back(pid);
+    }
+    bool ok = true;
+    for (pid_t child: children) {
+        int status;
+        waitpid(child, &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    auto end = std::chrono::steady_clock::now();
+    ok = ok && !run->failed && file_holds_last_records(committers, commits);
+
+    std::vector<uint64_t> latency(run->latencyNs, run->latencyNs + committers * commits);
+    std::sort(latency.begin(), latency.end());
+    auto total = static_cast<double>(latency.size());
+    result.commitsPerSecond = total / std::chrono::duration<double>(end - start).count();
+    result.p50Us = static_cast<double>(latency[latency.size() / 2]) / 1000;
+    result.p99Us = static_cast<double>(latency[latency.size() * 99 / 100]) / 1000;
+    result.flushesPerCommit = static_cast<double>(run->deviceFlushes) / total;
+    munmap(run, run_size);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    int committers = argc > 1 ? std::atoi(argv[1]) : 8;
+    size_t commits = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 500;
+    if (committers <= 0 || commits == 0) {
+        std::cerr << "Usage: group-commit-bench [committers] [commits per committer]\n";
+        return 1;
+    }
+    Result solo = {}, group = {};
+    bool ok = measure("0", committers, commits, solo) && measure("1", committers, commits, group);
+    unsetenv("LAB2_GROUP_COMMIT");
+    unlink(FILE_NAME);
+    if (!ok) {
+        std::cerr << "A committer failed or the file does not hold its last record.\n";
+        return 1;
+    }
+
+    std::cout << committers << " processes, write + fsync of one page each\n";
+    std::cout << "fsync | commits/s | p50 commit, us | p99 commit, us | device flushes per commit\n";
+    for (auto &[name, result]: {std::pair{"own flush", &solo}, std::pair{"group commit", &group}}) {
+        std::cout << name << " | " << result->commitsPerSecond << " | " << result->p50Us << " | " << result->p99Us
+                  << " | " << result->flushesPerCommit << "\n";
+    }
+    if (group.flushesPerCommit > solo.flushesPerCommit) {
+        std::cerr << "Group commit issued more device flushes than fsyncs on their own.\n";
+        return 1;
+    }
+    return 0;
+}
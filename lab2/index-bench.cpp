@@ -0,0 +1,146 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <vector>
+#include <tuple>
+#include <cstdlib>
+#include "page-index.h"
+
+// Same geometry as the shared cache in lab2.cpp
+constexpr size_t FRAMES = 16 * 16 * 50;
+constexpr size_t BUCKETS = 16384;
+constexpr size_t PAGE_SIZE = 4096;
+
+// The sorted array index that lab2.cpp used before the hash index, kept here as the baseline
+struct SortedIndex {
+    struct Entry {
+        PageKey key;
+        int32_t frame;
+
+        bool operator<(const Entry &other) const {
+            return std::tie(key.dev, key.inode, key.offset) <
+                   std::tie(other.key.dev, other.key.inode, other.key.offset);
+        }
+    };
+
+    Entry entries[FRAMES];
+    size_t count = 0;
+
+    int32_t find(const PageKey &key) const {
+        Entry probe = {key, NO_FRAME};
+        size_t left = 0, right = count;
+        while (left < right) {
+            size_t mid = left + (right - left) / 2;
+            if (entries[mid] < probe) {
+                left = mid + 1;
+            } else {
+                right = mid;
+            }
+        }
+        if (left < count && entries[left].key == key) {
+            return entries[left].frame;
+        }
+        return NO_FRAME;
+    }
+
+    void update(const PageKey *old_key, const PageKey &new_key, int32_t frame) {
+        size_t pos = 0;
+        if (old_key) {
+            while (pos < count && !(entries[pos].key == *old_key)) {
+                pos++;
+            }
+            if (pos < count) {
+                // Remove the old entry, keeping the array sorted
+                for (size_t i = pos; i + 1 < count; i++) {
+                    entries[i] = entries[i + 1];
+                }
+                count--;
+            }
+        }
+        Entry entry = {new_key, frame};
+        pos = 0;
+        while (pos < count && entries[pos] < entry) {
+            pos++;
+        }
+        for (size_t i = count; i > pos; --i) {
+            entries[i] = entries[i - 1];
+        }
+        entries[pos] = entry;
+        count++;
+    }
+};
+
+// Access trace: a few files scanned sequentially with some random probes mixed in,
+// with a working set larger than the cache so that most accesses are misses
+std::vector<PageKey> make_trace(size_t operations) {
+    std::mt19937_64 gen(42);
+    std::uniform_int_distribution<size_t> file_dis(0, 3);
+    std::uniform_int_distribution<size_t> page_dis(0, FRAMES);
+    std::vector<PageKey> trace;
+    trace.reserve(operations);
+    size_t cursor[4] = {0, 0, 0, 0};
+    for (size_t i = 0; i < operations; i++) {
+        size_t file = file_dis(gen);
+        size_t page = (i % 8 == 0) ? page_dis(gen) : cursor[file]++ % FRAMES;
+        trace.push_back({2049, static_cast<ino_t>(1000 + file), static_cast<off_t>(page * PAGE_SIZE)});
+    }
+    return trace;
+}
+
+template<typename Index, typename Update>
+double run(const std::vector<PageKey> &trace, Index &index, PageKey *frame_keys, bool *frame_used,
+           std::vector<int32_t> &results, Update update) {
+    size_t clock_hand = 0;
+    results.clear();
+    auto start = std::chrono::steady_clock::now();
+    for (const PageKey &key: trace) {
+        int32_t frame = index.find(key);
+        if (frame == NO_FRAME) {
+            frame = static_cast<int32_t>(clock_hand);
+            update(index, frame_used[frame] ? &frame_keys[frame] : nullptr, key, frame);
+            frame_keys[frame] = key;
+            frame_used[frame] = true;
+            clock_hand = (clock_hand + 1) % FRAMES;
+        }
+        results.push_back(frame);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(trace.size());
+}
+
+int main(int argc, char *argv[]) {
+    size_t operations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+    std::vector<PageKey> trace = make_trace(operations);
+
+    auto keys = std::make_unique<PageKey[]>(FRAMES);
+    auto used = std::make_unique<bool[]>(FRAMES);
+    std::vector<int32_t> sorted_results, hash_results;
+
+    auto sorted = std::make_unique<SortedIndex>();
+    double sorted_ns = run(trace, *sorted, keys.get(), used.get(), sorted_results,
+                           [](SortedIndex &index, const PageKey *old_key, const PageKey &key, int32_t frame) {
+                               index.update(old_key, key, frame);
+                           });
+
+    std::fill(used.get(), used.get() + FRAMES, false);
+    auto hash_memory = std::make_unique<char[]>(PageIndex::bytes_for(FRAMES, BUCKETS));
+    auto *hash = reinterpret_cast<PageIndex *>(hash_memory.get());
+    hash->init(FRAMES, BUCKETS);
+    double hash_ns = run(trace, *hash, keys.get(), used.get(), hash_results,
+                         [](PageIndex &index, const PageKey *, const PageKey &key, int32_t frame) {
+                             index.remove(frame);
+                             index.insert(frame, key);
+                         });
+
+    if (sorted_results != hash_results || hash->count != sorted->count) {
+        std::cerr << "Hash index disagrees with sorted index.\n";
+        return 1;
+    }
+
+    std::cout << "Operations: " << operations << "\n";
+    std::cout << "Sorted array index: " << sorted_ns << " ns/op\n";
+    std::cout << "Hash index:         " << hash_ns << " ns/op\n";
+    std::cout << "Speedup: " << sorted_ns / hash_ns << "x\n";
+    return 0;
+}
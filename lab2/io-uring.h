@@ -0,0 +1,192 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Один запрос ввода-вывода: preadv или pwritev в fd со смещения offset
+struct IoRequest {
+    int fd;
+    const struct iovec *iov;
+    int iovcnt;
+    off_t offset;
+    bool write;
+    ssize_t result;             // Сколько байт прочитано или записано, -1 и errno в error при ошибке
+    int error;
+};
+
+// Минимальное кольцо io_uring прямо на системных вызовах, без liburing. Одно кольцо на поток:
+// очередь отправки не потокобезопасна. После fork кольцо родителя не трогаем, а заводим свое
+struct IoUring {
+    int fd = -1;
+    pid_t owner = 0;            // Процесс, который создал кольцо
+    unsigned entries = 0;
+    void *sqRing = nullptr;
+    size_t sqRingSize = 0;
+    void *cqRing = nullptr;
+    size_t cqRingSize = 0;
+    io_uring_sqe *sqes = nullptr;
+    std::atomic<unsigned> *sqHead = nullptr;
+    std::atomic<unsigned> *sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned *sqArray = nullptr;
+    std::atomic<unsigned> *cqHead = nullptr;
+    std::atomic<unsigned> *cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe *cqes = nullptr;
+
+    ~IoUring() {
+        teardown();
+    }
+
+    bool ready() const {
+        return fd != -1 && owner == getpid();
+    }
+
+    bool setup(unsigned queue_depth) {
+        if (fd != -1 && owner != getpid()) {
+            teardown();
+        }
+        if (fd != -1) {
+            return true;
+        }
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, queue_depth, &params));
+        if (fd == -1) {
+            return false;
+        }
+        owner = getpid();
+        entries = params.sq_entries;
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        // С IORING_FEAT_SINGLE_MMAP обе очереди лежат в одном отображении
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        cqRing = single_mmap ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                             fd, IORING_OFF_CQ_RING);
+        void *sqe_memory = mmap(nullptr, entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqe_memory == MAP_FAILED) {
+            sqRing = sqRing == MAP_FAILED ? nullptr : sqRing;
+            cqRing = cqRing == MAP_FAILED ? nullptr : cqRing;
+            sqes = nullptr;
+            if (sqe_memory != MAP_FAILED) {
+                munmap(sqe_memory, entries * sizeof(io_uring_sqe));
+            }
+            teardown();
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe *>(sqe_memory);
+        char *sq = static_cast<char *>(sqRing);
+        char *cq = static_cast<char *>(cqRing);
+        sqHead = reinterpret_cast<std::atomic<unsigned> *>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<std::atomic<unsigned> *>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<std::atomic<unsigned> *>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<std::atomic<unsigned> *>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    void teardown() {
+        if (sqes) {
+            munmap(sqes, entries * sizeof(io_uring_sqe));
+        }
+        if (cqRing && cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        if (sqRing) {
+            munmap(sqRing, sqRingSize);
+        }
+        if (fd != -1) {
+            close(fd);
+        }
+        fd = -1;
+        sqes = nullptr;
+        sqRing = cqRing = nullptr;
+    }
+
+    // Кладем запрос в очередь отправки. Ядро увидит его только после io_uring_enter
+    void push(const IoRequest &request, uint64_t user_data) {
+        unsigned tail = sqTail->load(std::memory_order_relaxed);
+        unsigned index = tail & sqMask;
+        io_uring_sqe &sqe = sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = request.write ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe.fd = request.fd;
+        sqe.addr = reinterpret_cast<uint64_t>(request.iov);
+        sqe.len = static_cast<unsigned>(request.iovcnt);
+        sqe.off = static_cast<uint64_t>(request.offset);
+        sqe.user_data = user_data;
+        sqArray[index] = index;
+        sqTail->store(tail + 1, std::memory_order_release);
+    }
+
+    // Отправляем все, что положили, и ждем хотя бы wait_for завершений
+    int enter(unsigned to_submit, unsigned wait_for) {
+        while (true) {
+            long submitted = syscall(__NR_io_uring_enter, fd, to_submit, wait_for,
+                                     wait_for ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (submitted >= 0 || errno != EINTR) {
+                return static_cast<int>(submitted);
+            }
+        }
+    }
+
+    // Забираем одно завершение, false - очередь завершений пуста
+    bool pop(uint64_t &user_data, int32_t &result) {
+        unsigned head = cqHead->load(std::memory_order_relaxed);
+        if (head == cqTail->load(std::memory_order_acquire)) {
+            return false;
+        }
+        const io_uring_cqe &cqe = cqes[head & cqMask];
+        user_data = cqe.user_data;
+        result = cqe.res;
+        cqHead->store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Выполняем все запросы, держа в полете сколько влезает в кольцо. false - кольцо сломалось,
+    // и все запросы, про которые нет уверенности, что они выполнены, помечены ошибкой
+    bool run(IoRequest *requests, size_t count) {
+        size_t pushed = 0, completed = 0;
+        while (completed < count) {
+            while (pushed < count && pushed - completed < entries) {
+                push(requests[pushed], pushed);
+                pushed++;
+            }
+            // Ядро могло в прошлый раз взять не все, поэтому отправляем все, что еще лежит в очереди
+            unsigned to_submit = sqTail->load(std::memory_order_relaxed) - sqHead->load(std::memory_order_acquire);
+            if (enter(to_submit, 1) < 0) {
+                int error = errno;
+                for (size_t i = completed; i < count; i++) {
+                    requests[i].result = -1;
+                    requests[i].error = error;
+                }
+                return false;
+            }
+            uint64_t user_data;
+            int32_t result;
+            while (pop(user_data, result)) {
+                IoRequest &request = requests[user_data];
+                request.result = result < 0 ? -1 : result;
+                request.error = result < 0 ? -result : 0;
+                completed++;
+            }
+        }
+        return true;
+    }
+};
@@ -0,0 +1,174 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "lab2.h"
+#include "test-util.h"
+
+constexpr size_t PAGE_SIZE = 4096;
+constexpr size_t HOT_PAGES = 256;       // 1 MB working set, fits the default 4 MB L1
+constexpr size_t RECORD = 512;          // Small reads, so the lookup costs more than the copy
+const char *FILE_NAME = "l1-bench.dat";
+
+// Filled in by the child of a run
+struct Run {
+    double nsPerRead;
+    double l1HitPercent;
+    uint64_t readL1P50;             // Median latency of reads served by the L1, ns
+    uint64_t readHitP50;            // Median latency of reads served by the shared cache, ns
+    std::atomic<int> phase;         // Coherence check: 1 page 0 is in the reader's L1, 2 another process rewrote it
+};
+
+uint64_t median(const uint64_t *buckets) {
+    uint64_t count = 0, seen = 0;
+    for (size_t b = 0; b < LAB2_LATENCY_BUCKETS; b++) {
+        count += buckets[b];
+    }
+    for (size_t b = 0; b < LAB2_LATENCY_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen > 0 && 2 * seen >= count) {
+            return b == 0 ? 0 : 1ull << b;
+        }
+    }
+    return 0;
+}
+
+// Random record reads over the hot set from several threads
+bool reader(Run &run, int threads, size_t reads) {
+    initialize_library();
+    int fd = lab2_open(FILE_NAME, O_RDWR);
+    if (fd < 0) {
+        return false;
+    }
+    std::vector<uint64_t> buffer(PAGE_SIZE / sizeof(uint64_t));
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t p = 0; p < HOT_PAGES; p++) {
+            lab2_pread(fd, buffer.data(), PAGE_SIZE, static_cast<off_t>(p * PAGE_SIZE));
+        }
+    }
+    lab2_stats before, after;
+    lab2_get_stats(getpid(), &before);
+    std::atomic<bool> ok = true;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            std::mt19937 gen(t);
+            std::uniform_int_distribution<size_t> page_dis(0, HOT_PAGES - 1), record_dis(0, PAGE_SIZE / RECORD - 1);
+            uint64_t record[RECORD / sizeof(uint64_t)];
+            for (size_t i = 0; i < reads; i++) {
+                size_t page = page_dis(gen);
+                off_t offset = static_cast<off_t>(page * PAGE_SIZE + record_dis(gen) * RECORD);
+                if (lab2_pread(fd, record, RECORD, offset) != RECORD || record[0] != page) {
+                    ok = false;
+                    return;
+                }
+            }
+        });
+    }
+    for (std::thread &worker: workers) {
+        worker.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    lab2_get_stats(getpid(), &after);
+    lab2_latency latency;
+    lab2_get_latency(getpid(), &latency);
+    run.nsPerRead = std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(threads * reads);
+    run.l1HitPercent = 100.0 * static_cast<double>(after.l1Hits - before.l1Hits) /
+                       static_cast<double>(after.hits + after.misses - before.hits - before.misses);
+    run.readL1P50 = median(latency.buckets[LAB2_LATENCY_READ_L1]);
+    run.readHitP50 = median(latency.buckets[LAB2_LATENCY_READ_HIT]);
+
+    // Another process rewrites page 0 while this one holds it in its L1: the next read must see the new data
+    lab2_pread(fd, buffer.data(), PAGE_SIZE, 0);
+    run.phase = 1;
+    while (run.phase != 2) {
+        sched_yield();
+    }
+    bool fresh = lab2_pread(fd, buffer.data(), PAGE_SIZE, 0) == PAGE_SIZE && buffer[0] == 1000;
+    lab2_close(fd);
+    return ok && fresh;
+}
+
+bool writer(Run &run) {
+    while (run.phase != 1) {
+        sched_yield();
+    }
+    initialize_library();
+    int fd = lab2_open(FILE_NAME, O_RDWR);
+    std::vector<uint64_t> page(PAGE_SIZE / sizeof(uint64_t), 1000);
+    bool ok = fd >= 0 && lab2_pwrite(fd, page.data(), PAGE_SIZE, 0) == PAGE_SIZE;
+    run.phase = 2;
+    if (fd >= 0) {
+        lab2_close(fd);
+    }
+    return ok;
+}
+
+bool measure(const char *l1_size, int threads, size_t reads, Run &result) {
+    // The coherence check of the previous run rewrote page 0
+    if (!create_numbered_file(FILE_NAME, HOT_PAGES, PAGE_SIZE)) {
+        return false;
+    }
+    auto *run = static_cast<Run *>(mmap(nullptr, sizeof(Run), PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (run == MAP_FAILED) {
+        return false;
+    }
+    setenv("LAB2_L1_SIZE", l1_size, 1);
+    std::cout.flush();
+    pid_t children[2];
+    for (int child = 0; child < 2; child++) {
+        children[child] = fork();
+        if (children[child] == 0) {
+            bool ok = child == 0 ? reader(*run, threads, reads) : writer(*run);
+            // The reader gave up early: let the writer go
+            int waiting = 0;
+            run->phase.compare_exchange_strong(waiting, 1);
+            exit(ok ? 0 : 1);
+        }
+    }
+    bool ok = true;
+    for (pid_t child: children) {
+        int status;
+        waitpid(child, &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    result.nsPerRead = run->nsPerRead;
+    result.l1HitPercent = run->l1HitPercent;
+    result.readL1P50 = run->readL1P50;
+    result.readHitP50 = run->readHitP50;
+    munmap(run, sizeof(Run));
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    int threads = argc > 1 ? std::atoi(argv[1]) : 4;
+    size_t reads = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 200000;
+    Run shared_only = {}, with_l1 = {};
+    bool ok = measure("0", threads, reads, shared_only) && measure("4M", threads, reads, with_l1);
+    unlink(FILE_NAME);
+    if (!ok) {
+        std::cerr << "Run failed or a write of another process was not visible.\n";
+        return 1;
+    }
+
+    std::cout << "L1 | ns per read | L1 hit % | p50 L1 read, ns | p50 shared cache read, ns\n";
+    for (auto &[name, run]: {std::pair{"off", &shared_only}, std::pair{"4 MB", &with_l1}}) {
+        std::cout << name << " | " << run->nsPerRead << " | " << run->l1HitPercent << " | " << run->readL1P50
+                  << " | " << run->readHitP50 << "\n";
+    }
+    if (with_l1.l1HitPercent < 90) {
+        std::cerr << "The hot set was not served from the L1.\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,363 @@
+// liblab2-preload.so: пускаем обычные программы через кэш без пересборки.
+//
+//     LAB2_PRELOAD_PATHS=/data:/tmp/lab LD_PRELOAD=liblab2-preload.so ./program
+//
+// Перехватываем open, read, write, lseek, ftruncate, fsync, close и их 64-битные и позиционные варианты.
+// Обычные файлы, чей путь начинается с одного из префиксов (через двоеточие), открываем через
+// lab2_open, остальное уходит в libc как есть. Дескриптор у программы настоящий (тот, что
+// lab2_open открыл с O_DIRECT), так что fstat, fcntl и mmap на нем работают; перехватчик только
+// помнит, какие дескрипторы его. Через кэш не идут: stdio (fopen ходит в ядро мимо этих символов),
+// O_APPEND, O_DIRECT самой программы, а также копии дескриптора после dup.
+//
+// Вызовы из самой liblab2 (чтение с диска, сброс страниц, файл кэша) тоже приходят сюда, их
+// узнаем по адресу возврата и отдаем libc, иначе кэш читал бы сам себя.
+#include <atomic>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <string>
+#include <vector>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <link.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "lab2.h"
+
+constexpr int MAX_CACHED_FDS = 65536;   // lab2_open does not hand out larger descriptors either
+constexpr size_t MAX_CODE_RANGES = 8;   // Executable segments of liblab2 and of this library
+
+// Настоящие функции libc, берем через RTLD_NEXT при первом вызове
+struct RealCalls {
+    int (*open)(const char *, int, ...);
+    int (*openat)(int, const char *, int, ...);
+    ssize_t (*read)(int, void *, size_t);
+    ssize_t (*write)(int, const void *, size_t);
+    ssize_t (*pread)(int, void *, size_t, off_t);
+    ssize_t (*pwrite)(int, const void *, size_t, off_t);
+    off_t (*lseek)(int, off_t, int);
+    int (*ftruncate)(int, off_t);
+    int (*fsync)(int);
+    int (*fdatasync)(int);
+    int (*close)(int);
+};
+
+// Кусок кода, вызовы из которого идут мимо кэша
+struct CodeRange {
+    uintptr_t start;
+    uintptr_t end;
+};
+
+RealCalls real;
+pthread_once_t realOnce = PTHREAD_ONCE_INIT;
+std::vector<std::string> cachedPrefixes;    // LAB2_PRELOAD_PATHS, absolute, without trailing slashes
+CodeRange codeRanges[MAX_CODE_RANGES];
+size_t codeRangeCount = 0;
+pthread_once_t libraryOnce = PTHREAD_ONCE_INIT;
+std::atomic<bool> cachedFds[MAX_CACHED_FDS];
+
+// Путь как абсолютный, без разбора .. и симлинков: файла может еще не быть
+std::string absolute_path(const char *path) {
+    if (path[0] == '/') {
+        return path;
+    }
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        return "";
+    }
+    std::string absolute = cwd;
+    if (strncmp(path, "./", 2) == 0) {
+        path += 2;
+    }
+    return absolute + "/" + path;
+}
+
+// Запоминаем исполняемые сегменты объекта, в котором лежит address
+int find_code_ranges(struct dl_phdr_info *info, size_t, void *address) {
+    auto target = reinterpret_cast<uintptr_t>(address);
+    bool contains = false;
+    for (int i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) &header = info->dlpi_phdr[i];
+        uintptr_t start = info->dlpi_addr + header.p_vaddr;
+        contains = contains || (header.p_type == PT_LOAD && target >= start && target < start + header.p_memsz);
+    }
+    for (int i = 0; contains && i < info->dlpi_phnum && codeRangeCount < MAX_CODE_RANGES; i++) {
+        const ElfW(Phdr) &header = info->dlpi_phdr[i];
+        if (header.p_type == PT_LOAD && (header.p_flags & PF_X)) {
+            uintptr_t start = info->dlpi_addr + header.p_vaddr;
+            codeRanges[codeRangeCount++] = {start, start + header.p_memsz};
+        }
+    }
+    return contains ? 1 : 0;
+}
+
+void resolve_real_calls() {
+    real.open = reinterpret_cast<decltype(real.open)>(dlsym(RTLD_NEXT, "open"));
+    real.openat = reinterpret_cast<decltype(real.openat)>(dlsym(RTLD_NEXT, "openat"));
+    real.read = reinterpret_cast<decltype(real.read)>(dlsym(RTLD_NEXT, "read"));
+    real.write = reinterpret_cast<decltype(real.write)>(dlsym(RTLD_NEXT, "write"));
+    real.pread = reinterpret_cast<decltype(real.pread)>(dlsym(RTLD_NEXT, "pread"));
+    real.pwrite = reinterpret_cast<decltype(real.pwrite)>(dlsym(RTLD_NEXT, "pwrite"));
+    real.lseek = reinterpret_cast<decltype(real.lseek)>(dlsym(RTLD_NEXT, "lseek"));
+    real.ftruncate = reinterpret_cast<decltype(real.ftruncate)>(dlsym(RTLD_NEXT, "ftruncate"));
+    real.fsync = reinterpret_cast<decltype(real.fsync)>(dlsym(RTLD_NEXT, "fsync"));
+    real.fdatasync = reinterpret_cast<decltype(real.fdatasync)>(dlsym(RTLD_NEXT, "fdatasync"));
+    real.close = reinterpret_cast<decltype(real.close)>(dlsym(RTLD_NEXT, "close"));
+
+    dl_iterate_phdr(find_code_ranges, reinterpret_cast<void *>(&lab2_open));
+    dl_iterate_phdr(find_code_ranges, reinterpret_cast<void *>(&resolve_real_calls));
+
+    const char *paths = getenv("LAB2_PRELOAD_PATHS");
+    for (const char *begin = paths; begin && *begin;) {
+        const char *end = strchr(begin, ':');
+        std::string prefix(begin, end ? end - begin : strlen(begin));
+        if (!prefix.empty()) {
+            prefix = absolute_path(prefix.c_str());
+            while (prefix.size() > 1 && prefix.back() == '/') {
+                prefix.pop_back();
+            }
+            cachedPrefixes.push_back(prefix);
+        }
+        begin = end ? end + 1 : nullptr;
+    }
+}
+
+const RealCalls &real_calls() {
+    pthread_once(&realOnce, resolve_real_calls);
+    return real;
+}
+
+// Вызов пришел из liblab2 или из нас самих - это кэш работает с диском
+bool called_by_cache(void *return_address) {
+    real_calls();
+    auto address = reinterpret_cast<uintptr_t>(return_address);
+    for (size_t i = 0; i < codeRangeCount; i++) {
+        if (address >= codeRanges[i].start && address < codeRanges[i].end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool is_cached_fd(int fd, void *return_address) {
+    return fd >= 0 && fd < MAX_CACHED_FDS && cachedFds[fd].load(std::memory_order_acquire) &&
+           !called_by_cache(return_address);
+}
+
+// Файл под одним из префиксов: сам префикс или путь, который продолжается за ним через /
+bool under_cached_prefix(const char *path) {
+    real_calls();
+    if (cachedPrefixes.empty()) {
+        return false;
+    }
+    std::string absolute = absolute_path(path);
+    for (const std::string &prefix: cachedPrefixes) {
+        if (absolute.compare(0, prefix.size(), prefix) == 0 &&
+            (absolute.size() == prefix.size() || absolute[prefix.size()] == '/' || prefix == "/")) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void start_library() {
+    initialize_library();
+}
+
+// Открываем через кэш, если можно; -1 - пусть открывает libc. Создание и O_TRUNC делаем сами:
+// lab2_open не принимает mode, а у урезанного файла в кэше не должно остаться старых страниц.
+// Файл создали, а через кэш не открыли - O_EXCL снимаем, чтобы libc открыла уже наш файл
+int open_cached(const char *path, int &flags, mode_t mode) {
+    if (flags & (O_APPEND | O_DIRECT | O_PATH | O_DIRECTORY | O_TMPFILE)) {
+        return -1;
+    }
+    int saved_errno = errno;
+    if (flags & O_CREAT) {
+        int created = real.open(path, O_RDONLY | O_CREAT | O_CLOEXEC | (flags & O_EXCL), mode);
+        if (created == -1) {
+            errno = saved_errno;
+            return -1;
+        }
+        real.close(created);
+        flags &= ~O_EXCL;
+    }
+    struct stat file_stat;
+    if (stat(path, &file_stat) == -1 || !S_ISREG(file_stat.st_mode)) {
+        errno = saved_errno;
+        return -1;
+    }
+    pthread_once(&libraryOnce, start_library);
+    int fd = lab2_open(path, flags & ~(O_CREAT | O_EXCL | O_TRUNC));
+    if (fd == -1) {
+        errno = saved_errno;
+        return -1;
+    }
+    if ((flags & O_TRUNC) && (flags & O_ACCMODE) != O_RDONLY && lab2_ftruncate(fd, 0) == -1) {
+        lab2_close(fd);
+        return -1;
+    }
+    cachedFds[fd].store(true, std::memory_order_release);
+    return fd;
+}
+
+int open_with(const char *path, int flags, mode_t mode, void *return_address) {
+    if (under_cached_prefix(path) && !called_by_cache(return_address)) {
+        int fd = open_cached(path, flags, mode);
+        if (fd != -1) {
+            return fd;
+        }
+    }
+    return real_calls().open(path, flags, mode);
+}
+
+mode_t open_mode(int flags, va_list args) {
+    return (flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE ? va_arg(args, mode_t) : 0;
+}
+
+extern "C" {
+
+int open(const char *path, int flags, ...) {
+    va_list args;
+    va_start(args, flags);
+    mode_t mode = open_mode(flags, args);
+    va_end(args);
+    return open_with(path, flags, mode, __builtin_return_address(0));
+}
+
+int open64(const char *path, int flags, ...) {
+    va_list args;
+    va_start(args, flags);
+    mode_t mode = open_mode(flags, args);
+    va_end(args);
+    return open_with(path, flags, mode, __builtin_return_address(0));
+}
+
+// Относительно каталога, отличного от текущего, не перехватываем
+int openat(int dir_fd, const char *path, int flags, ...) {
+    va_list args;
+    va_start(args, flags);
+    mode_t mode = open_mode(flags, args);
+    va_end(args);
+    if (dir_fd == AT_FDCWD || path[0] == '/') {
+        return open_with(path, flags, mode, __builtin_return_address(0));
+    }
+    return real_calls().openat(dir_fd, path, flags, mode);
+}
+
+int openat64(int dir_fd, const char *path, int flags, ...) {
+    va_list args;
+    va_start(args, flags);
+    mode_t mode = open_mode(flags, args);
+    va_end(args);
+    if (dir_fd == AT_FDCWD || path[0] == '/') {
+        return open_with(path, flags, mode, __builtin_return_address(0));
+    }
+    return real_calls().openat(dir_fd, path, flags, mode);
+}
+
+int creat(const char *path, mode_t mode) {
+    return open_with(path, O_WRONLY | O_CREAT | O_TRUNC, mode, __builtin_return_address(0));
+}
+
+int creat64(const char *path, mode_t mode) {
+    return open_with(path, O_WRONLY | O_CREAT | O_TRUNC, mode, __builtin_return_address(0));
+}
+
+ssize_t read(int fd, void *buf, size_t count) {
+    if (is_cached_fd(fd, __builtin_return_address(0))) {
+        return lab2_read(fd, buf, count);
+    }
+    return real_calls().read(fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+    if (is_cached_fd(fd, __builtin_return_address(0))) {
+        return lab2_write(fd, buf, count);
+    }
+    return real_calls().write(fd, buf, count);
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset) {
+    if (is_cached_fd(fd, __builtin_return_address(0))) {
+        return lab2_pread(fd, buf, count, offset);
+    }
+    return real_calls().pread(fd, buf, count, offset);
+}
+
+ssize_t pread64(int fd, void *buf, size_t count, off_t offset) {
+    if (is_cached_fd(fd, __builtin_return_address(0))) {
+        return lab2_pread(fd, buf, count, offset);
+    }
+    return real_calls().pread(fd, buf, count, offset);
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset) {
+    if (is_cached_fd(fd, __builtin_return_address(0))) {
+        return lab2_pwrite(fd, buf, count, offset);
+    }
+    return real_calls().pwrite(fd, buf, count, offset);
+}
+
+ssize_t pwrite64(int fd, const void *buf, size_t count, off_t offset) {
+    if (is_cached_fd(fd, __builtin_return_address(0))) {
+        return lab2_pwrite(fd, buf, count, offset);
+    }
+    return real_calls().pwrite(fd, buf, count, offset);
+}
+
+off_t lseek(int fd, off_t offset, int whence) {
+    if (is_cached_fd(fd, __builtin_return_address(0))) {
+        return lab2_lseek(fd, offset, whence);
+    }
+    return real_calls().lseek(fd, offset, whence);
+}
+
+off_t lseek64(int fd, off_t offset, int whence) {
+    if (is_cached_fd(fd, __builtin_return_address(0))) {
+        return lab2_lseek(fd, offset, whence);
+    }
+    return real_calls().lseek(fd, offset, whence);
+}
+
+int ftruncate(int fd, off_t length) {
+    if (is_cached_fd(fd, __builtin_return_address(0))) {
+        return lab2_ftruncate(fd, length);
+    }
+    return real_calls().ftruncate(fd, length);
+}
+
+int ftruncate64(int fd, off_t length) {
+    if (is_cached_fd(fd, __builtin_return_address(0))) {
+        return lab2_ftruncate(fd, length);
+    }
+    return real_calls().ftruncate(fd, length);
+}
+
+int fsync(int fd) {
+    if (is_cached_fd(fd, __builtin_return_address(0))) {
+        return lab2_fsync(fd);
+    }
+    return real_calls().fsync(fd);
+}
+
+// Метаданные lab2_fsync и так не бережет: тот же групповой коммит
+int fdatasync(int fd) {
+    if (is_cached_fd(fd, __builtin_return_address(0))) {
+        return lab2_fsync(fd);
+    }
+    return real_calls().fdatasync(fd);
+}
+
+// Флаг снимаем до lab2_close: как только ядро закроет fd, тот же номер может открыть другой поток
+int close(int fd) {
+    if (is_cached_fd(fd, __builtin_return_address(0))) {
+        cachedFds[fd].store(false, std::memory_order_release);
+        return lab2_close(fd);
+    }
+    return real_calls().close(fd);
+}
+
+}
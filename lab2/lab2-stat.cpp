@@ -0,0 +1,302 @@
+#include <iostream>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include "lab2.h"
+
+// Counter fields of lab2_stats with their names, in the order of the struct
+const std::pair<const char *, uint64_t lab2_stats::*> COUNTERS[] = {
+        {"hits", &lab2_stats::hits},
+        {"misses", &lab2_stats::misses},
+        {"readahead_pages", &lab2_stats::readaheadPages},
+        {"evictions", &lab2_stats::evictions},
+        {"dirty_evictions", &lab2_stats::dirtyEvictions},
+        {"writeback_pages", &lab2_stats::writebackPages},
+        {"bytes_read", &lab2_stats::bytesRead},
+        {"bytes_written", &lab2_stats::bytesWritten},
+        {"disk_bytes_read", &lab2_stats::diskBytesRead},
+        {"disk_bytes_written", &lab2_stats::diskBytesWritten},
+        {"lock_wait_ns", &lab2_stats::lockWaitNs},
+        {"l1_hits", &lab2_stats::l1Hits},
+        {"device_flushes", &lab2_stats::deviceFlushes},
+        {"cold_hits", &lab2_stats::coldHits},
+        {"cold_misses", &lab2_stats::coldMisses},
+        {"cold_stores", &lab2_stats::coldStores},
+        {"cold_page_bytes", &lab2_stats::coldPageBytes},
+        {"cold_compressed_bytes", &lab2_stats::coldCompressedBytes},
+};
+const char *LATENCY_NAMES[LAB2_LATENCY_KINDS] = {
+        "open", "read_hit", "read_miss", "read_l1", "write_hit", "write_miss", "fsync", "close", "lock_wait", "disk_io",
+};
+const std::pair<const char *, double> PERCENTILES[] = {{"p50", 0.5}, {"p90", 0.9}, {"p99", 0.99}, {"p99.9", 0.999}};
+const std::pair<const char *, uint64_t lab2_stats::*> GAUGES[] = {
+        {"cache_pages", &lab2_stats::cachePages},
+        {"page_size", &lab2_stats::pageSize},
+        {"resident_pages", &lab2_stats::residentPages},
+        {"dirty_pages", &lab2_stats::dirtyPages},
+        {"cold_pages", &lab2_stats::coldPages},
+};
+
+struct Options {
+    bool json = false;
+    bool processes = false;
+    bool latency = false;       // Latency percentiles instead of counter rates
+    double interval = 1;        // Seconds between samples, 0 prints the totals once
+    long count = -1;            // Samples to print, -1 for no limit
+};
+
+void usage(const char *program) {
+    std::cerr << "Usage: " << program << " [--json] [--processes] [--latency] [interval_seconds [count]]\n"
+              << "Prints rates of the shared lab2 cache every interval, like vmstat.\n"
+              << "Interval 0 prints the totals since the cache was created once.\n"
+              << "--latency prints latency percentiles of lab2 calls over the interval instead.\n";
+}
+
+bool parse_options(int argc, char *argv[], Options &options) {
+    std::vector<const char *> positional;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0 || strcmp(argv[i], "-j") == 0) {
+            options.json = true;
+        } else if (strcmp(argv[i], "--processes") == 0 || strcmp(argv[i], "-p") == 0) {
+            options.processes = true;
+        } else if (strcmp(argv[i], "--latency") == 0 || strcmp(argv[i], "-l") == 0) {
+            options.latency = true;
+        } else if (argv[i][0] == '-') {
+            return false;
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+    if (positional.size() > 2) {
+        return false;
+    }
+    if (!positional.empty()) {
+        options.interval = std::strtod(positional[0], nullptr);
+        options.count = options.interval == 0 ? 1 : -1;
+    }
+    if (positional.size() == 2) {
+        options.count = std::strtol(positional[1], nullptr, 10);
+    }
+    return options.interval >= 0;
+}
+
+uint64_t latency_count(const uint64_t *buckets) {
+    uint64_t count = 0;
+    for (size_t b = 0; b < LAB2_LATENCY_BUCKETS; b++) {
+        count += buckets[b];
+    }
+    return count;
+}
+
+// Upper bound of the bucket that holds the percentile, in ns
+uint64_t latency_percentile(const uint64_t *buckets, double percentile) {
+    uint64_t count = latency_count(buckets), seen = 0;
+    for (size_t b = 0; b < LAB2_LATENCY_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen > 0 && seen >= percentile * count) {
+            return b == 0 ? 0 : 1ull << b;
+        }
+    }
+    return 0;
+}
+
+// Histograms of the interval: the current ones minus the previous ones
+lab2_latency latency_delta(const lab2_latency &latency, const lab2_latency &previous) {
+    lab2_latency delta = latency;
+    for (size_t kind = 0; kind < LAB2_LATENCY_KINDS; kind++) {
+        for (size_t b = 0; b < LAB2_LATENCY_BUCKETS; b++) {
+            delta.buckets[kind][b] -= previous.buckets[kind][b];
+        }
+    }
+    return delta;
+}
+
+std::string format_ns(uint64_t ns) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(0);
+    if (ns < 1000) {
+        out << ns << "ns";
+    } else if (ns < 1000 * 1000) {
+        out << static_cast<double>(ns) / 1e3 << "us";
+    } else if (ns < 1000 * 1000 * 1000) {
+        out << static_cast<double>(ns) / 1e6 << "ms";
+    } else {
+        out << std::setprecision(1) << static_cast<double>(ns) / 1e9 << "s";
+    }
+    return out.str();
+}
+
+std::string json_latency(const lab2_latency &latency) {
+    std::ostringstream out;
+    out << "{";
+    for (size_t kind = 0; kind < LAB2_LATENCY_KINDS; kind++) {
+        const uint64_t *buckets = latency.buckets[kind];
+        out << (kind ? "," : "") << "\"" << LATENCY_NAMES[kind] << "\":{\"count\":" << latency_count(buckets)
+            << ",\"p50_ns\":" << latency_percentile(buckets, 0.5) << ",\"p99_ns\":" << latency_percentile(buckets, 0.99)
+            << ",\"p999_ns\":" << latency_percentile(buckets, 0.999) << ",\"buckets\":[";
+        for (size_t b = 0; b < LAB2_LATENCY_BUCKETS; b++) {
+            out << (b ? "," : "") << buckets[b];
+        }
+        out << "]}";
+    }
+    out << "}";
+    return out.str();
+}
+
+void print_latency(const lab2_latency &latency) {
+    std::cout << std::setw(11) << "call" << std::setw(10) << "count";
+    for (const auto &[name, percentile]: PERCENTILES) {
+        std::cout << std::setw(9) << name;
+    }
+    std::cout << "\n";
+    for (size_t kind = 0; kind < LAB2_LATENCY_KINDS; kind++) {
+        const uint64_t *buckets = latency.buckets[kind];
+        std::cout << std::setw(11) << LATENCY_NAMES[kind] << std::setw(10) << latency_count(buckets);
+        for (const auto &[name, percentile]: PERCENTILES) {
+            std::cout << std::setw(9) << format_ns(latency_percentile(buckets, percentile));
+        }
+        std::cout << "\n";
+    }
+    std::cout << std::endl;
+}
+
+std::string json_object(const lab2_stats &stats, const lab2_stats *previous, double seconds) {
+    std::ostringstream out;
+    out << "{";
+    const char *separator = "";
+    for (const auto &[name, field]: COUNTERS) {
+        out << separator << "\"" << name << "\":" << stats.*field;
+        separator = ",";
+    }
+    for (const auto &[name, field]: GAUGES) {
+        out << ",\"" << name << "\":" << stats.*field;
+    }
+    if (previous) {
+        out << ",\"rates\":{" << std::fixed << std::setprecision(1);
+        separator = "";
+        for (const auto &[name, field]: COUNTERS) {
+            out << separator << "\"" << name << "\":" << static_cast<double>(stats.*field - previous->*field) / seconds;
+            separator = ",";
+        }
+        out << "}";
+    }
+    out << "}";
+    return out.str();
+}
+
+void print_json(const lab2_stats &stats, const lab2_stats *previous, double seconds, bool processes,
+                const lab2_latency *latency) {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    std::cout << "{\"timestamp_ms\":" << std::chrono::duration_cast<std::chrono::milliseconds>(now).count()
+              << ",\"interval_s\":" << seconds << ",\"global\":" << json_object(stats, previous, seconds);
+    if (latency) {
+        std::cout << ",\"latency\":" << json_latency(*latency);
+    }
+    if (processes) {
+        std::vector<pid_t> pids(64);
+        pids.resize(std::min(pids.size(), lab2_stat_processes(pids.data(), pids.size())));
+        std::cout << ",\"processes\":[";
+        const char *separator = "";
+        for (pid_t pid: pids) {
+            lab2_stats process;
+            if (lab2_get_stats(pid, &process) == 0) {
+                std::cout << separator << "{\"pid\":" << pid << ",\"stats\":" << json_object(process, nullptr, 0)
+                          << "}";
+                separator = ",";
+            }
+        }
+        std::cout << "]";
+    }
+    std::cout << "}" << std::endl;
+}
+
+void print_header() {
+    std::cout << std::setw(9) << "hit/s" << std::setw(9) << "miss/s" << std::setw(6) << "hit%" << std::setw(6) << "l1%"
+              << std::setw(6) << "cold%"
+              << std::setw(8) << "ra/s" << std::setw(8) << "evict/s" << std::setw(8) << "wb/s"
+              << std::setw(10) << "rd MB/s" << std::setw(10) << "wr MB/s" << std::setw(10) << "dskr MB/s"
+              << std::setw(10) << "dskw MB/s" << std::setw(7) << "wait%" << std::setw(10) << "resident"
+              << std::setw(8) << "dirty" << "\n";
+}
+
+void print_row(const lab2_stats &stats, const lab2_stats &previous, double seconds) {
+    auto rate = [&](uint64_t lab2_stats::*field) {
+        return static_cast<double>(stats.*field - previous.*field) / seconds;
+    };
+    double hits = rate(&lab2_stats::hits), misses = rate(&lab2_stats::misses);
+    double cold_hits = rate(&lab2_stats::coldHits), cold_misses = rate(&lab2_stats::coldMisses);
+    double megabyte = 1024 * 1024;
+    std::cout << std::fixed << std::setprecision(0) << std::setw(9) << hits << std::setw(9) << misses
+              << std::setw(6) << (hits + misses > 0 ? 100 * hits / (hits + misses) : 0)
+              << std::setw(6) << (hits + misses > 0 ? 100 * rate(&lab2_stats::l1Hits) / (hits + misses) : 0)
+              << std::setw(6) << (cold_hits + cold_misses > 0 ? 100 * cold_hits / (cold_hits + cold_misses) : 0)
+              << std::setw(8) << rate(&lab2_stats::readaheadPages) << std::setw(8) << rate(&lab2_stats::evictions)
+              << std::setw(8) << rate(&lab2_stats::writebackPages) << std::setprecision(1)
+              << std::setw(10) << rate(&lab2_stats::bytesRead) / megabyte
+              << std::setw(10) << rate(&lab2_stats::bytesWritten) / megabyte
+              << std::setw(10) << rate(&lab2_stats::diskBytesRead) / megabyte
+              << std::setw(10) << rate(&lab2_stats::diskBytesWritten) / megabyte
+              << std::setw(7) << rate(&lab2_stats::lockWaitNs) / 1e7
+              << std::setw(10) << stats.residentPages << std::setw(8) << stats.dirtyPages << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (lab2_attach_stats() != 0) {
+        std::cerr << "No lab2 cache is running (/globalCache_shm does not exist).\n";
+        return 1;
+    }
+
+    lab2_stats previous;
+    lab2_latency previous_latency;
+    lab2_get_stats(0, &previous);
+    lab2_get_latency(0, &previous_latency);
+    if (options.interval == 0) {
+        if (options.json) {
+            print_json(previous, nullptr, 0, options.processes, options.latency ? &previous_latency : nullptr);
+        } else if (options.latency) {
+            print_latency(previous_latency);
+        } else {
+            for (const auto &[name, field]: COUNTERS) {
+                std::cout << std::setw(20) << name << " " << previous.*field << "\n";
+            }
+            for (const auto &[name, field]: GAUGES) {
+                std::cout << std::setw(20) << name << " " << previous.*field << "\n";
+            }
+        }
+        return 0;
+    }
+
+    auto interval = std::chrono::duration<double>(options.interval);
+    for (long sample = 0; options.count < 0 || sample < options.count; sample++) {
+        if (!options.json && !options.latency && sample % 20 == 0) {
+            print_header();
+        }
+        std::this_thread::sleep_for(interval);
+        lab2_stats stats;
+        lab2_latency latency;
+        lab2_get_stats(0, &stats);
+        lab2_get_latency(0, &latency);
+        lab2_latency delta = latency_delta(latency, previous_latency);
+        if (options.json) {
+            print_json(stats, &previous, options.interval, options.processes, options.latency ? &delta : nullptr);
+        } else if (options.latency) {
+            print_latency(delta);
+        } else {
+            print_row(stats, previous, options.interval);
+        }
+        previous = stats;
+        previous_latency = latency;
+    }
+    return 0;
+}
@@ -1,414 +1,3935 @@
 #include <iostream>
-#include <unordered_map>
 #include <cstring>
+#include <cstddef>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <linux/userfaultfd.h>
+#include <ctime>
+#include <linux/futex.h>
+#include <linux/fs.h>
 #include <cstdlib>
+#include <climits>
 #include <atomic>
 #include <pthread.h>
+#include <csignal>
+#include <sched.h>
+#include <algorithm>
 #include <vector>
+#include <array>
 #include <unistd.h>
+#include "lab2.h"
+#include "page-index.h"
+#include "replacement-policy.h"
+#include "frame-bitmap.h"
+#include "io-uring.h"
+#include "page-codec.h"
+#include "access-trace.h"
+#include "usdt.h"
 
-constexpr size_t GLOBAL_CACHE_SIZE = 16 * 16 * 50;   // Count of cache pages (50 MB)
-constexpr size_t PAGE_SIZE = 4096;                   // Size of single page (4 KB)
+constexpr size_t DEFAULT_CACHE_BYTES = 16 * 16 * 50 * 4096; // Default cache size (50 MB), LAB2_CACHE_SIZE
+constexpr size_t DEFAULT_PAGE_SIZE = 4096;           // Default size of single page (4 KB), LAB2_PAGE_SIZE
+constexpr size_t DEFAULT_L1_BYTES = 4 * 1024 * 1024; // Default size of the process-local L1 (4 MB), LAB2_L1_SIZE
+constexpr size_t MIN_PAGE_SIZE = 4096;               // Smallest page, O_DIRECT needs at least this alignment
+constexpr size_t MIN_CACHE_PAGES = 16;               // Smallest cache, a batch of misses takes a quarter of it at most
+constexpr size_t MAX_PAGE_SIZE = 2 * 1024 * 1024;    // Largest page, one huge page
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;   // Size of a huge page on x86-64
+constexpr size_t SECTOR_SIZE = 512;                  // Granularity of valid and dirty ranges inside a frame
+constexpr size_t MAX_SECTOR_WORDS = MAX_PAGE_SIZE / SECTOR_SIZE / 64; // Words of a frame's sector bitmap at most
+constexpr uint64_t SHARED_MEMORY_MAGIC = 0x6C616232'00000009; // "lab2" and layout version
+constexpr size_t LOCK_STRIPES = 256;                 // Count of mutexes over index buckets and over frames
+constexpr uint32_t FRAME_EXCLUSIVE = 1u << 31;       // Frame is being loaded or evicted
+constexpr int32_t NO_VICTIM = -2;                    // No frame could be evicted, errno is ENOBUFS
+constexpr int64_t EVICTION_TIMEOUT_MS = 5000;        // An eviction that finds no victim this long gives up
+constexpr size_t OPTIMISTIC_READ_RETRIES = 4;        // Lock-free hit attempts before the locked path
+constexpr size_t READAHEAD_INITIAL_PAGES = 4;        // First readahead window of a sequential stream
+constexpr size_t READAHEAD_MAX_BYTES = 256 * 1024;  // Default limit of the readahead window
+constexpr size_t MAX_SHARED_FILES = 1024;            // Count of files the cache can hold pages of at once
+constexpr size_t DIRTY_RATIO_PERCENT = 20;           // Default dirty ratio that wakes the background flusher
+constexpr int64_t DIRTY_EXPIRE_MS = 3000;            // Default age after which a dirty page gets flushed
+constexpr int64_t FLUSH_INTERVAL_MS = 100;           // How often the flusher looks at the cache
+constexpr size_t FLUSH_BATCH_PAGES = 256;            // Pages flushed when an eviction asks for clean victims
+constexpr long COMMIT_WAIT_NS = 10'000'000;          // An fsync waiting for a group commit checks the leader is alive this often
+constexpr unsigned IO_URING_DEPTH = 64;              // Requests in flight in the io_uring ring of a thread
+constexpr size_t IO_REQUEST_BYTES = 64 * 1024;       // Split of a batched read into io_uring requests
+constexpr size_t READ_BATCH_MAX_PAGES = 256;         // Most pages a single read miss loads at once
+constexpr int MAX_FILE_DESCRIPTORS = 65536;         // Size of the fd-indexed descriptor table
+constexpr uint32_t DESCRIPTOR_OPEN = 1u << 31;       // Descriptor slot holds an open file
+constexpr uint32_t DESCRIPTOR_CLOSING = 1u << 30;    // lab2_close is tearing the slot down
+constexpr size_t STAT_PROCESS_SLOTS = 64;            // Processes with counters of their own, slot 0 is shared
+constexpr size_t STAT_SHARDS = 8;                    // Counter shards per process, threads spread over them
+constexpr uint32_t ADVICE_SEQUENTIAL = 1u << 0;      // lab2_fadvise SEQUENTIAL: widest readahead window at once
+constexpr uint32_t ADVICE_RANDOM = 1u << 1;          // lab2_fadvise RANDOM: no readahead
+constexpr uint32_t ADVICE_NOREUSE = 1u << 2;         // lab2_fadvise NOREUSE: pages go in cold and are never referenced
+constexpr size_t RECYCLED_FRAMES = READ_BATCH_MAX_PAGES; // Frames a NOREUSE reader freed, kept for its next batch of misses
+constexpr size_t COLD_ENTRY_BYTES = 512;             // Bytes of the compressed tier per entry, better compressed pages run out of entries first
+constexpr size_t COLD_STORE_PERCENT = 75;            // An evicted page is kept compressed only if it shrinks to this share or less
+constexpr size_t TRACE_MAX_PAGES = 1 << 20;          // Longest access trace one descriptor records
+constexpr size_t PREWARM_WINDOW_PAGES = 64;          // Pages of the recorded trace kept loaded ahead of the reader
+constexpr size_t TRACE_NAME_MAX = 48;                // Room after LAB2_TRACE_DIR for "/<hash>.trace.<pid>"
 const char *SHARED_MEMORY_NAME = "/globalCache_shm";
+const char *HUGETLB_SHARED_MEMORY_PATH = "/dev/hugepages/globalCache_shm";
+const char *BOOT_ID_PATH = "/proc/sys/kernel/random/boot_id";
+constexpr size_t BOOT_ID_SIZE = 40;                  // UUID of the boot with the terminating zero
+constexpr off_t CACHE_FILE_ATTACH_LOCK = 0;          // Byte of the cache file locked while a process attaches or detaches
+constexpr off_t CACHE_FILE_USERS_LOCK = 1;           // Byte of the cache file read-locked by every attached process
+constexpr off_t FORKED_USER_LOCKS = 0;               // Byte FORKED_USER_LOCKS + i of the segment is locked by the forked child in stats slot i
+
+// Чем подкреплены фреймы кэша
+enum class HugePages : uint32_t {
+    OFF,        // Обычные страницы по 4 KB
+    THP,        // Прозрачные huge pages через madvise, если ядро разрешает их для shmem
+    HUGETLB,    // Сегмент в hugetlbfs, страницы по 2 MB заранее зарезервированы в системе
+};
 
 
 struct CachePage {
+    dev_t dev;                  // Device of the file
     ino_t inode;                // Inode number of the file
     off_t offset;               // Offset of this page in the file
-    char data[PAGE_SIZE];       // Data buffer of the page in shared memory
-    bool used;                  // Used flag for clock policy
-    bool dirty;                 // Dirty flag
+    std::atomic<uint32_t> state; // Pin count, FRAME_EXCLUSIVE while loading or evicting
+    std::atomic<uint32_t> seq;  // Odd while tag or data are being changed
+    uint32_t length;            // Count of valid bytes in the frame
+    std::atomic<int64_t> dirtySince; // CLOCK_MONOTONIC ms when the page became dirty
+    int32_t file;               // Slot in SharedMemory::files, -1 for an empty frame
+    int32_t fileNext;           // Next frame of the same file, -1 at the end of the list
+    int32_t filePrev;           // Previous frame of the same file, -1 at the head
 };
 
-struct CachePageIndex {
-    ino_t inode;
-    off_t offset;
-    CachePage *page;
-
-    bool operator<(const CachePageIndex &other) const {
-        return std::tie(inode, offset) < std::tie(other.inode, other.offset);
-    }
+// Файл, страницы которого лежат в кэше. Путь нужен, чтобы любой процесс мог переоткрыть
+// файл и скинуть чужую грязную страницу
+struct SharedFile {
+    dev_t dev;                  // Device of the file
+    ino_t inode;                // Inode number of the file
+    uint32_t generation;        // Bumped whenever the slot is taken by a file again
+    std::atomic<int> openCount; // lab2_open descriptors in all processes
+    std::atomic<int> residentPages; // Frames tagged with this file
+    pthread_mutex_t pagesLock;  // Guards the list of frames of this file
+    int32_t firstPage;          // Head of the list of frames tagged with this file, -1 if none
+    pthread_mutex_t sizeLock;   // Guards growing size and trimming the file on disk down to it
+    std::atomic<off_t> size;    // Size lab2 calls see: the file on disk plus what cached writes appended
+    uint32_t ioSectors;         // Sectors in the smallest O_DIRECT read or write of the file
+    std::atomic<uint32_t> commitStarted;  // Group commits of lab2_fsync started on the file
+    std::atomic<uint32_t> commitDone;     // Group commits finished, futex word of the waiting fsyncs
+    std::atomic<pid_t> commitLeader;      // Process running the current group commit, 0 if none
+    uint32_t commitFailed;      // Last group commit that failed, its fsyncs return commitErrno
+    int commitErrno;
+    bool snapshotValid;         // The fields below describe the file when its cached pages last matched the disk
+    int64_t snapshotMtimeNs;    // st_mtim of the file
+    off_t snapshotSize;         // st_size of the file
+    int snapshotVersion;        // Inode generation (FS_IOC_GETVERSION), 0 if the file system has none
+    char path[PATH_MAX];        // Absolute path to reopen the file for write-back
 };
 
 
 struct FileDescriptor {
     int fd;                     // File descriptor
     off_t cursor;               // Current cursor position in the file
+    dev_t dev;                  // Device of the file for cache identification
     ino_t inode;                // Inode number for cache identification
+    int32_t file;               // Slot in SharedMemory::files
+    off_t lastReadEnd;          // Cursor after the previous read, to detect sequential access
+    size_t readaheadPages;      // Current readahead window, 0 while access looks random
+    bool writable;              // Opened for writing, so dirty pages can be written back through fd
+    int readFd;                 // Reads the disk blocks at the edges of writes: fd, a second descriptor if fd is
+                                // O_WRONLY, or -1 if the file cannot be read
+    std::atomic<uint32_t> advice; // ADVICE_* flags set by lab2_fadvise, read by calls on any thread
+    pthread_mutex_t traceLock;  // Guards the fields below, positional reads record from many threads
+    std::vector<uint8_t> trace; // Pages read through the descriptor in order, encoded as on disk, LAB2_TRACE_DIR only
+    size_t tracePages;          // Pages in trace
+    uint64_t traceLast;         // Number of the last page in trace, the next one is stored relative to it
+    off_t lastTracedPage;       // A page read again right away is recorded once
+    size_t pagesRead;           // Page reads recorded so far, where the reader is along prewarm
+    std::vector<off_t> prewarm; // Pages in the order the last recorded run read them
+    size_t prewarmNext;         // First page of prewarm not loaded yet
+};
+
+// Ячейка таблицы дескрипторов процесса, индекс - сам fd. state - флаги и число вызовов, которые
+// сейчас пользуются ячейкой: lab2_close меняет OPEN на CLOSING и ждет, пока они закончат.
+// Позиционные вызовы берут ячейку без блокировок, вызовы с курсором еще и cursorLock
+struct DescriptorSlot {
+    std::atomic<uint32_t> state;
+    pthread_mutex_t cursorLock; // Serializes calls that use or move the cursor
+    FileDescriptor desc;        // Valid while DESCRIPTOR_OPEN is set, fd/dev/inode/file do not change
+};
+
+// Отображение lab2_mmap. Страницы лежат в анонимной памяти процесса и приходят из кэша по первому
+// обращению через userfaultfd; записанные возвращаются в кэш на lab2_fsync и lab2_munmap
+struct Mapping {
+    char *address;
+    size_t length;              // Mapped bytes, whole cache pages
+    size_t size;                // Bytes asked for, written pages are copied back up to here
+    int fd;                     // lab2 descriptor of the file, held by the mapping like mmap holds the file
+    int32_t file;               // Slot in SharedMemory::files
+    bool writable;
+    std::vector<bool> dirty;    // Cache pages written since they were last copied back
+};
+
+// Ячейка L1 - копия страницы общего кэша в памяти процесса. Копия верна, пока не сдвинулся seq
+// фрейма, с которого ее сняли: его двигает любая запись, загрузка и вытеснение в любом процессе.
+// version - seqlock самой ячейки, нечетный, пока поток ее перезаписывает. Читатель может застать
+// запись посередине, поэтому поля и сама копия читаются и пишутся атомарно, порядок дает version
+struct L1Slot {
+    std::atomic<uint32_t> version;
+    std::atomic<dev_t> dev;             // Key of the copied page
+    std::atomic<ino_t> inode;
+    std::atomic<off_t> offset;
+    std::atomic<int32_t> frame;         // Frame of the shared cache the copy was taken from, -1 if the slot is empty
+    std::atomic<uint32_t> frameSeq;     // seq of that frame when the copy was taken
+    std::atomic<uint32_t> length;       // Count of valid bytes in the copy
+};
+
+// Счетчики статистики, порядок как у полей lab2_stats
+enum StatCounter : size_t {
+    STAT_HITS,
+    STAT_MISSES,
+    STAT_READAHEAD_PAGES,
+    STAT_EVICTIONS,
+    STAT_DIRTY_EVICTIONS,
+    STAT_WRITEBACK_PAGES,
+    STAT_BYTES_READ,
+    STAT_BYTES_WRITTEN,
+    STAT_DISK_BYTES_READ,
+    STAT_DISK_BYTES_WRITTEN,
+    STAT_LOCK_WAIT_NS,
+    STAT_L1_HITS,
+    STAT_DEVICE_FLUSHES,
+    STAT_COLD_HITS,
+    STAT_COLD_MISSES,
+    STAT_COLD_STORES,
+    STAT_COLD_PAGE_BYTES,
+    STAT_COLD_COMPRESSED_BYTES,
+    STAT_COUNTERS,
+};
+
+// Шард счетчиков и гистограмм задержек на свои строки кэша, чтобы потоки не дрались за них
+struct alignas(64) StatShard {
+    std::atomic<uint64_t> values[STAT_COUNTERS];
+    std::atomic<uint64_t> latency[LAB2_LATENCY_KINDS][LAB2_LATENCY_BUCKETS];
 };
 
+// Счетчики одного процесса. Слот 0 общий: туда складывают счетчики вышедшие процессы
+// и пишут те, кому не хватило своего слота
+struct ProcessStats {
+    std::atomic<pid_t> pid;         // Owner of the slot, 0 if the slot is free
+    std::atomic<bool> forkedUser;   // The owner came from fork and holds a refCount it may never return itself
+    StatShard shards[STAT_SHARDS];
+};
+
+// Размеры кэша и где в сегменте лежат массивы, которые от них зависят
+struct CacheGeometry {
+    size_t cacheSize;               // Count of cache pages
+    size_t pageSize;                // Size of single page, a power of two
+    size_t mappedSize;              // Size of the whole segment
+    HugePages hugePages;            // What backs the segment
+    size_t cacheOffset;             // CachePage[cacheSize]
+    size_t indexOffset;             // Hash index (dev, inode, offset) -> cache page
+    size_t ghostsOffset;            // Ghost history of the replacement policy
+    size_t usedOffset;              // Bitmap: referenced since the replacement policy last looked at the frame
+    size_t hotOffset;               // Bitmap: hot page of CLOCK-Pro or Am page of 2Q
+    size_t dirtyOffset;             // Bitmap: frame data differs from the file
+    size_t validSectorsOffset;      // Per frame bits of sectors that hold file data (or written data)
+    size_t dirtySectorsOffset;      // Per frame bits of sectors that differ from the file
+    size_t coldEntries;             // Entries of the compressed tier, 0 if the tier is off
+    size_t coldBytes;               // Ring of compressed pages
+    size_t coldIndexOffset;         // Hash index (dev, inode, offset) -> entry of the compressed tier
+    size_t coldEntriesOffset;       // ColdEntry[coldEntries]
+    size_t coldDataOffset;          // The ring itself
+    size_t framesOffset;            // Page data, aligned to the page so O_DIRECT reads land there
+};
+
+// Сжатая страница холодного яруса: где в кольце лежит и сколько байт файла в ней было
+struct ColdEntry {
+    uint64_t start;             // Position in the ring, counted from the creation of the tier
+    uint32_t bytes;             // Compressed size
+    uint32_t length;            // Count of valid bytes of the page
+};
+
+// Холодный ярус: вытесненные чистые страницы, сжатые, в кольце байт. Записи занимают кольцо и место
+// в нем в одном порядке, так что место для новой страницы освобождают самые старые. Поднятая
+// обратно в кэш страница из индекса уходит сразу, а ее байты - когда до них дойдет хвост
+struct ColdTier {
+    pthread_mutex_t lock;       // Guards the tier: index, entries and ring
+    uint64_t entryHead;         // Entries ever stored, the next one goes to slot entryHead % coldEntries
+    uint64_t entryTail;         // Oldest entry that still holds its bytes
+    uint64_t dataHead;          // Ring bytes ever taken
+    uint64_t dataTail;          // Start of the oldest bytes still in use
+};
 
+// Заголовок сегмента. Геометрию выбирает первый процесс, остальные берут ее отсюда
 struct SharedMemory {
+    uint64_t magic;                 // SHARED_MEMORY_MAGIC once the segment is initialized
     std::atomic<int> refCount;      // Count of active processes
-    std::atomic<size_t> clockHand;  // Clock hand for cache replacement
-    pthread_mutex_t mutex;          // Mutex
-    CachePage cache[GLOBAL_CACHE_SIZE]; // Cache page structure
-    CachePageIndex cacheIndex[GLOBAL_CACHE_SIZE];  // Array for cache index
-    size_t cacheIndexCount = 0;                    // Number of active elements in cacheIndex
+    std::atomic<bool> ready;        // Set by the first process once the segment is initialized
+    CacheGeometry geometry;         // Sizes and offsets of the arrays after the header
+    pthread_mutex_t indexLocks[LOCK_STRIPES]; // Stripe i guards index buckets b with b % LOCK_STRIPES == i
+    pthread_mutex_t frameLocks[LOCK_STRIPES]; // Stripe i guards data of frames f with f % LOCK_STRIPES == i
+    ReplacementState replacement;       // Replacement policy and its clock hand
+    pthread_mutex_t policyLock;         // Guards ghost history of the replacement policy
+    pthread_mutex_t filesLock;          // Guards registration of files
+    SharedFile files[MAX_SHARED_FILES]; // Files with pages in the cache or open descriptors
+    std::atomic<size_t> dirtyCount;     // Count of dirty frames
+    std::atomic<bool> flushRequested;   // An eviction met a dirty victim and wants the flusher to run
+    pthread_mutex_t flusherLock;        // Held by the process whose flusher is running a pass
+    ProcessStats stats[STAT_PROCESS_SLOTS]; // Counters per process, the sum over slots is global
+    ColdTier cold;                  // Compressed tier of evicted clean pages
+    std::atomic<bool> saved;        // Cache file: the last process wrote it to disk in full
+    char bootId[BOOT_ID_SIZE];      // Cache file: boot whose page cache holds the newest contents
+};
 
+// Дескриптор, через который этот процесс пишет чужие грязные страницы файла из SharedMemory::files
+struct ReopenedFile {
+    int fd;
+    uint32_t generation;
+    bool failed;                // Reopening this generation failed and was reported, retries stay quiet
 };
 
 
-std::unordered_map<int, FileDescriptor> fileDescriptors;
+DescriptorSlot descriptorTable[MAX_FILE_DESCRIPTORS];
 SharedMemory *sharedMemory = nullptr;
+// Геометрия кэша из заголовка сегмента и указатели на его массивы в этом процессе
+size_t cacheSize = 0;
+size_t pageSize = 0;
+CachePage *cachePages = nullptr;
+char *cacheFrames = nullptr;
+PageIndex *cacheIndex = nullptr;
+PageIndex *ghostIndex = nullptr;
+FrameBitmap *usedBits = nullptr;
+FrameBitmap *hotBits = nullptr;
+FrameBitmap *dirtyBits = nullptr;
+size_t pageSectors = 0;                 // Sectors in a page
+size_t sectorWords = 0;                 // Words of the sector bitmaps of one frame
+std::atomic<uint64_t> *validSectors = nullptr;
+std::atomic<uint64_t> *dirtySectors = nullptr;
+size_t coldEntryCount = 0;              // 0 while the compressed tier is off
+size_t coldBytes = 0;
+PageIndex *coldIndex = nullptr;
+ColdEntry *coldEntries = nullptr;
+char *coldData = nullptr;
+// Чего хочет этот процесс, если сегмент создает он
+size_t requestedCacheBytes = DEFAULT_CACHE_BYTES; // LAB2_CACHE_SIZE, suffixes K, M, G
+size_t requestedPageSize = DEFAULT_PAGE_SIZE;     // LAB2_PAGE_SIZE, power of two from 4K to 2M
+size_t requestedColdBytes = 0;                    // LAB2_COLD_SIZE: compressed tier for evicted pages, 0 turns it off
+HugePages requestedHugePages = HugePages::OFF;    // LAB2_HUGE_PAGES: off, thp, hugetlb
+bool sectorTracking = true;                       // LAB2_SECTORS=0 reads and writes back whole pages only
+bool groupCommit = true;                          // LAB2_GROUP_COMMIT=0: every lab2_fsync flushes and syncs on its own
+size_t readaheadMaxPages = 0;                     // LAB2_READAHEAD_MAX, 0 turns readahead off
+size_t readBatchPages = READ_BATCH_MAX_PAGES;     // Most pages one batch of misses holds, a quarter of the cache at most
+bool readaheadMaxFromEnv = false;
+ReplacementPolicy replacementPolicy = ReplacementPolicy::CLOCK; // LAB2_POLICY, used by the first process only
+char cacheFilePath[PATH_MAX] = "";                // LAB2_CACHE_FILE: keep the cache in this file across restarts
+int cacheFileFd = -1;                             // Open while attached, holds the OFD locks of the cache file
+pid_t attachedPid = 0;                            // Process that attached, a child after fork does not save the cache file
+int forkedUserFd = -1;                            // A forked child's own open segment, holds the lock of its stats slot
+char traceDir[PATH_MAX] = "";                     // LAB2_TRACE_DIR: record page reads per file, prewarm the next run from them
+bool prewarmOnOpen = true;                        // LAB2_PREWARM=0: only lab2_prewarm loads pages from a trace
+ReopenedFile reopenedFiles[MAX_SHARED_FILES];
+pthread_mutex_t reopenedFilesLock = PTHREAD_MUTEX_INITIALIZER;
 
-extern "C" {
+// Фоновый сброс грязных страниц: по потоку в каждом процессе, проход делает тот, кто взял flusherLock
+bool flusherEnabled = true;                     // LAB2_FLUSHER=0 turns it off
+size_t dirtyRatioPercent = DIRTY_RATIO_PERCENT; // LAB2_DIRTY_RATIO
+int64_t dirtyExpireMs = DIRTY_EXPIRE_MS;        // LAB2_DIRTY_EXPIRE_MS
+pthread_t flusherThread;
+bool flusherStarted = false;
+bool flusherStop = false;
+pthread_mutex_t flusherMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t flusherCond = PTHREAD_COND_INITIALIZER;
 
-// Это надо чтобы общую память сделатт
-void attach_shared_memory() {
-    int shm_fd = shm_open(SHARED_MEMORY_NAME, O_CREAT | O_RDWR, 0666);
-    if (shm_fd == -1) {
-        perror("Failed to open shared memory");
-        exit(1);
-    }
-    if (ftruncate(shm_fd, sizeof(SharedMemory)) == -1) {
-        perror("Failed to set shared memory size");
-        close(shm_fd);
-        exit(1);
+// Статистика: слот этого процесса в SharedMemory::stats и шард счетчиков этого потока
+ProcessStats *processStats = nullptr;
+std::atomic<size_t> statThreads = 0;
+thread_local size_t statShard = statThreads.fetch_add(1, std::memory_order_relaxed) % STAT_SHARDS;
+// Промахи этого потока за все время: вызов, во время которого их стало больше, - промах
+thread_local uint64_t threadMisses = 0;
+
+// L1 процесса перед общим кэшем: прямое отображение ключа страницы на ячейку, без блокировок
+size_t l1Bytes = DEFAULT_L1_BYTES;              // LAB2_L1_SIZE, 0 turns the L1 off
+size_t l1Slots = 0;                             // Power of two, 0 while the L1 is off
+L1Slot *l1Table = nullptr;
+char *l1Data = nullptr;                         // Page-sized copies, slot i at i * pageSize
+// Чтения страниц этого потока, которые L1 не обслужил: вызов без них - попадание в L1
+thread_local uint64_t threadSharedReads = 0;
+
+// Пакетный ввод-вывод промахов, упреждающего чтения и сброса: через io_uring, если ядро дает
+bool ioUringEnabled = true;                     // LAB2_IO_URING=0 falls back to preadv/pwritev
+thread_local IoUring ioRing;
+
+// Выровненная страница потока, выделяется при первом обращении
+struct BounceBuffer {
+    char *data = nullptr;
+
+    char *page() {
+        if (!data) {
+            data = static_cast<char *>(aligned_alloc(MIN_PAGE_SIZE, pageSize));
+        }
+        return data;
     }
 
-    sharedMemory = static_cast<SharedMemory *>(mmap(nullptr, sizeof(SharedMemory), PROT_READ | PROT_WRITE, MAP_SHARED,
-                                                    shm_fd, 0));
-    if (sharedMemory == MAP_FAILED) {
-        perror("Failed to map shared memory");
-        close(shm_fd);
-        exit(1);
+    // Деструкторы thread_local идут раньше atexit, а detach еще пишет отображения через кэш
+    ~BounceBuffer() {
+        free(data);
+        data = nullptr;
     }
-    close(shm_fd);
+};
+// O_DIRECT читает в нее секторы, рядом с которыми во фрейме записанные данные
+thread_local BounceBuffer bounceBuffer;
+// Страница, которую поток сжимает в холодный ярус
+thread_local std::vector<char> coldBuffer;
 
-    if (sharedMemory->refCount.fetch_add(1) == 0) {
-        sharedMemory->clockHand = 0;
-        pthread_mutexattr_t attr;
-        pthread_mutexattr_init(&attr);
-        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
-        pthread_mutex_init(&sharedMemory->mutex, &attr);
-        pthread_mutexattr_destroy(&attr);
-
-        // Инициализируем стронички
-        for (CachePage &page: sharedMemory->cache) {
-            page.used = false;
-            page.dirty = false;
-            page.inode = 0;
-            page.offset = 0;
-        }
+// lab2_mmap: userfaultfd процесса и поток, который обслуживает его промахи
+std::vector<Mapping> mappings;                  // Guarded by mappingsLock, as is everything below
+pthread_mutex_t mappingsLock = PTHREAD_MUTEX_INITIALIZER;
+int faultFd = -1;
+int faultStopFd = -1;                           // eventfd that stops the fault thread
+pthread_t faultThread;
+bool faultWriteProtect = false;                 // The kernel reports first writes, so only written pages are dirty
+char *faultBuffer = nullptr;                    // Zero-filled tail of a page the fault thread maps
+
+extern "C" {
+
+void start_flusher();
+void stop_flusher();
+int sync_file_mappings(int32_t file);
+void unmap_all_mappings();
+void forget_mappings();
+void link_file_page(int32_t frame);
+int flush_file_pages(int fd, int32_t file, bool mark_unused, off_t start = 0, off_t end = LLONG_MAX);
+void evict_file_pages(int32_t file, off_t start, off_t end);
+void start_prewarm(FileDescriptor &fileDesc);
+
+size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Корзин индекса - степень двойки не меньше числа фреймов
+size_t index_buckets(size_t cache_size) {
+    size_t buckets = 2;
+    while (buckets < cache_size) {
+        buckets *= 2;
     }
+    return buckets;
 }
 
-// Штука для того, чтобы потом эта библиотека завелась
-void detach_shared_memory() {
-    if (sharedMemory && sharedMemory->refCount.fetch_sub(1) == 1) {
-        pthread_mutex_destroy(&sharedMemory->mutex);
-        shm_unlink(SHARED_MEMORY_NAME);
+// Раскладываем массивы кэша за заголовком. Фреймы выравниваем по странице кэша (и по huge page),
+// чтобы ОДИРЕКТ читал прямо в них, а страница в 2 MB ложилась ровно в одну huge page
+void plan_shared_memory(CacheGeometry &layout, size_t cache_bytes, size_t page_size, HugePages huge_pages,
+                        size_t cold_bytes) {
+    layout.pageSize = page_size;
+    layout.cacheSize = std::max(cache_bytes / page_size, MIN_CACHE_PAGES);
+    layout.hugePages = huge_pages;
+    size_t buckets = index_buckets(layout.cacheSize);
+    size_t offset = align_up(sizeof(SharedMemory), alignof(CachePage));
+    layout.cacheOffset = offset;
+    offset = align_up(offset + layout.cacheSize * sizeof(CachePage), alignof(PageIndex));
+    layout.indexOffset = offset;
+    offset = align_up(offset + PageIndex::bytes_for(layout.cacheSize, buckets), alignof(PageIndex));
+    layout.ghostsOffset = offset;
+    offset = align_up(offset + PageIndex::bytes_for(layout.cacheSize, buckets), alignof(FrameBitmap));
+    // Битмапы флагов отдельно от метаданных фреймов, чтобы проход по ним был плотным
+    for (size_t *bitmap_offset: {&layout.usedOffset, &layout.hotOffset, &layout.dirtyOffset}) {
+        *bitmap_offset = offset;
+        offset += FrameBitmap::bytes_for(layout.cacheSize);
+    }
+    // Секторы фрейма по 512 байт: какие совпадают с файлом и какие надо записать
+    size_t sector_bytes = layout.cacheSize * ((page_size / SECTOR_SIZE + 63) / 64) * sizeof(uint64_t);
+    layout.validSectorsOffset = align_up(offset, alignof(std::atomic<uint64_t>));
+    layout.dirtySectorsOffset = layout.validSectorsOffset + sector_bytes;
+    offset = layout.dirtySectorsOffset + sector_bytes;
+    // Холодный ярус: в кольцо должны влезать хотя бы две сжатые страницы
+    layout.coldBytes = cold_bytes >= 2 * page_size ? cold_bytes : 0;
+    layout.coldEntries = layout.coldBytes / COLD_ENTRY_BYTES;
+    layout.coldIndexOffset = align_up(offset, alignof(PageIndex));
+    offset = layout.coldIndexOffset + PageIndex::bytes_for(layout.coldEntries, index_buckets(layout.coldEntries));
+    layout.coldEntriesOffset = align_up(offset, alignof(ColdEntry));
+    layout.coldDataOffset = layout.coldEntriesOffset + layout.coldEntries * sizeof(ColdEntry);
+    offset = layout.coldDataOffset + layout.coldBytes;
+    size_t frames_alignment = huge_pages == HugePages::OFF ? page_size : std::max(page_size, HUGE_PAGE_SIZE);
+    layout.framesOffset = align_up(offset, frames_alignment);
+    layout.mappedSize = layout.framesOffset + layout.cacheSize * page_size;
+    if (huge_pages == HugePages::HUGETLB) {
+        layout.mappedSize = align_up(layout.mappedSize, HUGE_PAGE_SIZE);
     }
-    munmap(sharedMemory, sizeof(SharedMemory));
 }
 
-// из названия и так понятно что это
-void initialize_library() {
-    attach_shared_memory();
-    atexit(detach_shared_memory);
+// Указатели этого процесса на массивы сегмента
+void map_shared_arrays() {
+    char *base = reinterpret_cast<char *>(sharedMemory);
+    const CacheGeometry &geometry = sharedMemory->geometry;
+    cacheSize = geometry.cacheSize;
+    pageSize = geometry.pageSize;
+    cachePages = reinterpret_cast<CachePage *>(base + geometry.cacheOffset);
+    cacheIndex = reinterpret_cast<PageIndex *>(base + geometry.indexOffset);
+    ghostIndex = reinterpret_cast<PageIndex *>(base + geometry.ghostsOffset);
+    usedBits = reinterpret_cast<FrameBitmap *>(base + geometry.usedOffset);
+    hotBits = reinterpret_cast<FrameBitmap *>(base + geometry.hotOffset);
+    dirtyBits = reinterpret_cast<FrameBitmap *>(base + geometry.dirtyOffset);
+    pageSectors = pageSize / SECTOR_SIZE;
+    sectorWords = (pageSectors + 63) / 64;
+    validSectors = reinterpret_cast<std::atomic<uint64_t> *>(base + geometry.validSectorsOffset);
+    dirtySectors = reinterpret_cast<std::atomic<uint64_t> *>(base + geometry.dirtySectorsOffset);
+    coldEntryCount = geometry.coldEntries;
+    coldBytes = geometry.coldBytes;
+    coldIndex = reinterpret_cast<PageIndex *>(base + geometry.coldIndexOffset);
+    coldEntries = reinterpret_cast<ColdEntry *>(base + geometry.coldEntriesOffset);
+    coldData = base + geometry.coldDataOffset;
+    cacheFrames = base + geometry.framesOffset;
+}
+
+int64_t monotonic_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
 }
 
+int64_t monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
 
-// валидируем дескриптор
-void found_file_descriptor(int fd) {
-    if (fileDescriptors.find(fd) == fileDescriptors.end()) {
-        exit(1);
+void count_stat(StatCounter counter, uint64_t value = 1) {
+    if (processStats) {
+        processStats->shards[statShard].values[counter].fetch_add(value, std::memory_order_relaxed);
     }
 }
 
-// получаем инод файла из дескриптора
-ino_t get_file_inode(int fd) {
-    struct stat file_stat;
-    if (fstat(fd, &file_stat) == -1) {
-        perror("Failed to get file inode");
-        close(fd);
-        exit(1);
+// Корзина гистограммы: 0 нс в нулевой, дальше по степеням двойки
+size_t latency_bucket(int64_t ns) {
+    if (ns <= 0) {
+        return 0;
     }
-    return file_stat.st_ino;
+    return std::min<size_t>(64 - __builtin_clzll(static_cast<uint64_t>(ns)), LAB2_LATENCY_BUCKETS - 1);
 }
 
-// открываем и сохраняем инод
-int lab2_open(const char *path, int flags) {
-    // ОДИРЕКТ надо чтобы без всех этих вашей пейдж кэшей работать с файлом
-    flags |= O_DIRECT;
-    int fd = open(path, flags);
-    if (fd == -1) return -1;
-    ino_t inode = get_file_inode(fd);
-    fileDescriptors[fd] = {fd, 0, inode};
-    return fd;
+void record_latency(lab2_latency_kind kind, int64_t ns) {
+    if (processStats) {
+        processStats->shards[statShard].latency[kind][latency_bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    }
 }
 
-// Находим страницу в кэше по иноду и оффсету
-CachePage *find_cache_page(ino_t inode, off_t offset) {
-    CachePageIndex key = {inode, offset, nullptr};
-    size_t left = 0, right = sharedMemory->cacheIndexCount;
+void count_hit(const PageKey &key) {
+    count_stat(STAT_HITS);
+    LAB2_PROBE3(cache_hit, key.dev, key.inode, key.offset);
+}
 
-    while (left < right) {
-        size_t mid = left + (right - left) / 2;
-        if (sharedMemory->cacheIndex[mid] < key) {
-            left = mid + 1;
-        } else {
-            right = mid;
-        }
+void count_miss(const PageKey &key) {
+    count_stat(STAT_MISSES);
+    threadMisses++;
+    LAB2_PROBE3(cache_miss, key.dev, key.inode, key.offset);
+}
+
+// Замер одного вызова API от конструктора до деструктора. Попадание или промах решают промахи,
+// которые поток насчитал за время вызова, попадание в L1 - что общий кэш вызову не понадобился
+struct LatencyTimer {
+    lab2_latency_kind hit;      // Kind to record if the call missed no page
+    lab2_latency_kind miss;
+    lab2_latency_kind l1;       // Kind to record if the call did not read the shared cache
+    uint64_t missesBefore = threadMisses;
+    uint64_t sharedReadsBefore = threadSharedReads;
+    int64_t start = monotonic_ns();
+
+    explicit LatencyTimer(lab2_latency_kind kind) : hit(kind), miss(kind), l1(kind) {}
+    LatencyTimer(lab2_latency_kind hit, lab2_latency_kind miss) : hit(hit), miss(miss), l1(hit) {}
+    LatencyTimer(lab2_latency_kind hit, lab2_latency_kind miss, lab2_latency_kind l1) : hit(hit), miss(miss), l1(l1) {}
+    ~LatencyTimer() {
+        lab2_latency_kind kind = threadMisses != missesBefore ? miss :
+                                 threadSharedReads != sharedReadsBefore ? hit : l1;
+        record_latency(kind, monotonic_ns() - start);
     }
+};
 
-    if (left < sharedMemory->cacheIndexCount &&
-        sharedMemory->cacheIndex[left].inode == inode &&
-        sharedMemory->cacheIndex[left].offset == offset) {
-        return sharedMemory->cacheIndex[left].page;
+// Ожидание блокировки курсора считаем, только если она занята
+void lock_cursor(pthread_mutex_t &lock) {
+    if (pthread_mutex_trylock(&lock) == 0) {
+        return;
     }
-    return nullptr;
+    int64_t start = monotonic_ns();
+    pthread_mutex_lock(&lock);
+    int64_t waited = monotonic_ns() - start;
+    count_stat(STAT_LOCK_WAIT_NS, waited);
+    record_latency(LAB2_LATENCY_LOCK_WAIT, waited);
 }
 
-// обновляем индекс
-void update_cache_page_index(ino_t inode, off_t offset, ino_t new_inode, off_t new_offset, CachePage *page) {
-    size_t pos = 0;
-    while (pos < sharedMemory->cacheIndexCount && !(sharedMemory->cacheIndex[pos].inode == inode && sharedMemory->cacheIndex[pos].offset == offset)) {
-        pos++;
+// Переносим счетчики и гистограммы слота в общий слот 0, обнуляя их
+void retire_process_stats(ProcessStats &stats) {
+    StatShard &shared = sharedMemory->stats[0].shards[0];
+    for (StatShard &shard: stats.shards) {
+        for (size_t i = 0; i < STAT_COUNTERS; i++) {
+            uint64_t value = shard.values[i].exchange(0, std::memory_order_relaxed);
+            shared.values[i].fetch_add(value, std::memory_order_relaxed);
+        }
+        for (size_t kind = 0; kind < LAB2_LATENCY_KINDS; kind++) {
+            for (size_t bucket = 0; bucket < LAB2_LATENCY_BUCKETS; bucket++) {
+                uint64_t value = shard.latency[kind][bucket].exchange(0, std::memory_order_relaxed);
+                shared.latency[kind][bucket].fetch_add(value, std::memory_order_relaxed);
+            }
+        }
     }
-    if (pos < sharedMemory->cacheIndexCount) {
-        sharedMemory->cacheIndex[pos].inode = new_inode;
-        sharedMemory->cacheIndex[pos].offset = new_offset;
-    } else {
-        CachePageIndex newIndex = {new_inode, new_offset, page};
-        while (pos < sharedMemory->cacheIndexCount && sharedMemory->cacheIndex[pos] < newIndex) {
-            pos++;
+}
+
+// Берем свободный слот статистики. Слот упавшего процесса, который не успел его вернуть, тоже
+// свободен, а если это был ребенок после fork, возвращаем и его refCount. Слотов не хватило - пишем в общий
+void claim_process_stats() {
+    pid_t pid = getpid();
+    processStats = &sharedMemory->stats[0];
+    for (size_t i = 1; i < STAT_PROCESS_SLOTS; i++) {
+        ProcessStats &stats = sharedMemory->stats[i];
+        pid_t owner = stats.pid.load(std::memory_order_relaxed);
+        if (owner != 0 && (kill(owner, 0) == 0 || errno != ESRCH)) {
+            continue;
         }
-        for (size_t i = sharedMemory->cacheIndexCount; i > pos; --i) {
-            sharedMemory->cacheIndex[i] = sharedMemory->cacheIndex[i - 1];
+        if (stats.pid.compare_exchange_strong(owner, pid, std::memory_order_acquire)) {
+            if (stats.forkedUser.exchange(false)) {
+                sharedMemory->refCount.fetch_sub(1);
+            }
+            retire_process_stats(stats);
+            processStats = &stats;
+            return;
         }
+    }
+}
+
+void release_process_stats() {
+    if (processStats && processStats != &sharedMemory->stats[0]) {
+        retire_process_stats(*processStats);
+        processStats->pid.store(0, std::memory_order_release);
+    }
+    processStats = nullptr;
+}
 
-        sharedMemory->cacheIndex[pos] = newIndex;
-        sharedMemory->cacheIndexCount++;
+// Открываем сегмент в hugetlbfs, если его просили и он есть, иначе обычный shm
+int open_shared_memory(int flags, HugePages &huge_pages) {
+    if (huge_pages == HugePages::HUGETLB) {
+        int shm_fd = open(HUGETLB_SHARED_MEMORY_PATH, flags | O_RDWR, 0666);
+        if (shm_fd != -1 || errno == EEXIST) {
+            return shm_fd;
+        }
+        fprintf(stderr, "hugetlbfs is not available, using regular shared memory\n");
+        huge_pages = HugePages::OFF;
     }
+    return shm_open(SHARED_MEMORY_NAME, flags | O_RDWR, 0666);
 }
 
+void *map_shared_memory(int shm_fd, size_t size, HugePages huge_pages) {
+    int flags = MAP_SHARED | (huge_pages == HugePages::HUGETLB ? MAP_HUGETLB : 0);
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, shm_fd, 0);
+    if (memory == MAP_FAILED) {
+        perror("Failed to map shared memory");
+        close(shm_fd);
+        exit(1);
+    }
+    return memory;
+}
 
-// Читаем что нибудь из файла
-ssize_t read_data_from_file(int fd, off_t offset, char *chunk, size_t bytes_to_read) {
-    if (lseek(fd, offset, SEEK_SET) == -1) {
-        perror("Failed to seek");
-        return -1;
+// Мьютексы сегмента. Живут только пока есть процессы: кэш из файла их заводит заново
+void init_shared_locks() {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    for (size_t i = 0; i < LOCK_STRIPES; i++) {
+        pthread_mutex_init(&sharedMemory->indexLocks[i], &attr);
+        pthread_mutex_init(&sharedMemory->frameLocks[i], &attr);
     }
-    ssize_t bytes_from_file = read(fd, chunk, bytes_to_read);
-    if (bytes_from_file < bytes_to_read && bytes_from_file > 0) {
-        memset(chunk + bytes_from_file, 0, bytes_to_read - bytes_from_file);
+    pthread_mutex_init(&sharedMemory->filesLock, &attr);
+    pthread_mutex_init(&sharedMemory->policyLock, &attr);
+    pthread_mutex_init(&sharedMemory->cold.lock, &attr);
+    for (SharedFile &file: sharedMemory->files) {
+        pthread_mutex_init(&file.pagesLock, &attr);
+        pthread_mutex_init(&file.sizeLock, &attr);
     }
-    return bytes_from_file;
+    // Процесс может умереть посреди прохода флашера, поэтому его блокировка robust
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&sharedMemory->flusherLock, &attr);
+    pthread_mutexattr_destroy(&attr);
 }
 
-// Записываем страницу в кэш
-void update_cache_page(CachePage &current_page, ino_t inode, off_t offset, const char *data, size_t bytes_to_read) {
-    update_cache_page_index(current_page.inode, current_page.offset, inode, offset, &current_page);
-    current_page.used = true;
-    current_page.dirty = false;
-    current_page.inode = inode;
-    current_page.offset = offset;
-    memcpy(current_page.data, data, bytes_to_read);
+// Пустой холодный ярус. Из файла кэша его не поднимаем: сжатые копии не привязаны к слотам файлов,
+// и проверить, что их файлы с тех пор не менялись, не по чему
+void reset_cold_tier() {
+    coldIndex->init(coldEntryCount, index_buckets(coldEntryCount));
+    ColdTier &cold = sharedMemory->cold;
+    cold.entryHead = 0;
+    cold.entryTail = 0;
+    cold.dataHead = 0;
+    cold.dataTail = 0;
 }
 
-// Проверяем, и если страница испачкана, то скидываем ее на диск
-void flush_dirty_page(CachePage &page, int fd) {
-    if (page.dirty) {
-        if (lseek(fd, page.offset, SEEK_SET) != -1) {
-            write(fd, page.data, PAGE_SIZE);
+// Первый процесс размечает сегмент под свою геометрию
+void create_shared_memory(int shm_fd, HugePages huge_pages) {
+    CacheGeometry layout;
+    plan_shared_memory(layout, requestedCacheBytes, requestedPageSize, huge_pages, requestedColdBytes);
+    if (ftruncate(shm_fd, static_cast<off_t>(layout.mappedSize)) == -1) {
+        perror("Failed to set shared memory size");
+        close(shm_fd);
+        exit(1);
+    }
+    sharedMemory = static_cast<SharedMemory *>(map_shared_memory(shm_fd, layout.mappedSize, huge_pages));
+    sharedMemory->ready = false;
+    sharedMemory->geometry = layout;
+    map_shared_arrays();
+    if (huge_pages == HugePages::THP &&
+        madvise(cacheFrames, cacheSize * pageSize, MADV_HUGEPAGE) == -1) {
+        perror("Failed to request transparent huge pages");
+    }
+    init_shared_locks();
+
+    // Инициализируем стронички
+    for (size_t i = 0; i < cacheSize; i++) {
+        CachePage &page = cachePages[i];
+        page.state = 0;
+        page.seq = 0;
+        page.length = 0;
+        page.dirtySince = 0;
+        page.file = -1;
+        page.fileNext = -1;
+        page.filePrev = -1;
+        page.dev = 0;
+        page.inode = 0;
+        page.offset = 0;
+    }
+    cacheIndex->init(cacheSize, index_buckets(cacheSize));
+    ghostIndex->init(cacheSize, index_buckets(cacheSize));
+    usedBits->init(cacheSize);
+    hotBits->init(cacheSize);
+    dirtyBits->init(cacheSize);
+    reset_cold_tier();
+    for (size_t i = 0; i < cacheSize * sectorWords; i++) {
+        validSectors[i] = 0;
+        dirtySectors[i] = 0;
+    }
+    sharedMemory->replacement.init(replacementPolicy, cacheSize);
+    for (SharedFile &file: sharedMemory->files) {
+        file.dev = 0;
+        file.inode = 0;
+        file.generation = 0;
+        file.openCount = 0;
+        file.residentPages = 0;
+        file.firstPage = -1;
+        file.ioSectors = 0;
+        file.commitStarted = 0;
+        file.commitDone = 0;
+        file.commitLeader = 0;
+        file.commitFailed = 0;
+        file.snapshotValid = false;
+        file.path[0] = '\0';
+    }
+    // Файл кэша мог остаться от старой разметки, поэтому обнуляем и гистограммы
+    for (ProcessStats &stats: sharedMemory->stats) {
+        stats.pid = 0;
+        stats.forkedUser = false;
+        for (StatShard &shard: stats.shards) {
+            for (std::atomic<uint64_t> &value: shard.values) {
+                value = 0;
+            }
+            for (auto &buckets: shard.latency) {
+                for (std::atomic<uint64_t> &bucket: buckets) {
+                    bucket = 0;
+                }
+            }
         }
-        page.dirty = false;
     }
+    sharedMemory->dirtyCount = 0;
+    sharedMemory->flushRequested = false;
+    sharedMemory->refCount = 1;
+    sharedMemory->magic = SHARED_MEMORY_MAGIC;
+    sharedMemory->ready.store(true, std::memory_order_release);
 }
 
-// Находим страницу которую можно выкинуть
-CachePage *get_cache_page_to_replace(int fd) {
-    while (true) {
-        CachePage &page = sharedMemory->cache[sharedMemory->clockHand];
-        if (!page.used) {
-            flush_dirty_page(page, fd);
-            sharedMemory->clockHand = (sharedMemory->clockHand + 1) % GLOBAL_CACHE_SIZE;
-            return &page;
-        }
-        page.used = false;
-        sharedMemory->clockHand = (sharedMemory->clockHand + 1) % GLOBAL_CACHE_SIZE;
+// Остальные процессы ждут, пока первый все разметит, и отображают сегмент его размера
+void join_shared_memory(int shm_fd, HugePages huge_pages) {
+    size_t header_size = huge_pages == HugePages::HUGETLB ? HUGE_PAGE_SIZE : sizeof(SharedMemory);
+    struct stat shm_stat;
+    while (fstat(shm_fd, &shm_stat) == 0 && static_cast<size_t>(shm_stat.st_size) < header_size) {
+        sched_yield();
+    }
+    auto *header = static_cast<SharedMemory *>(map_shared_memory(shm_fd, header_size, huge_pages));
+    // Процессы стартуют пачкой, ждем пока первый все разметит
+    while (!header->ready.load(std::memory_order_acquire)) {
+        sched_yield();
+    }
+    if (header->magic != SHARED_MEMORY_MAGIC) {
+        fprintf(stderr, "Shared memory %s has an unknown layout, remove it\n", SHARED_MEMORY_NAME);
+        exit(1);
     }
+    header->refCount.fetch_add(1);
+    size_t mapped_size = header->geometry.mappedSize;
+    munmap(header, header_size);
+    sharedMemory = static_cast<SharedMemory *>(map_shared_memory(shm_fd, mapped_size, huge_pages));
+    map_shared_arrays();
 }
 
+int64_t mtime_ns(const struct stat &file_stat) {
+    return static_cast<int64_t>(file_stat.st_mtim.tv_sec) * 1000000000 + file_stat.st_mtim.tv_nsec;
+}
 
-void *allocate_aligned_memory(size_t size) {
-    void *ptr;
-    posix_memalign(&ptr, PAGE_SIZE, size);
-    return ptr;
+// Поколение инода: файл удалили и создали заново с тем же номером инода - поколение другое
+int inode_version(const char *path) {
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    int version = 0;
+    if (fd != -1) {
+        if (ioctl(fd, FS_IOC_GETVERSION, &version) == -1) {
+            version = 0;
+        }
+        close(fd);
+    }
+    return version;
 }
 
-ssize_t lab2_read(int fd, void *buf, size_t count) {
-    if (count > GLOBAL_CACHE_SIZE * PAGE_SIZE) {
-        return pread(fd, buf, count, 0);
+// Запоминаем, каким был файл, пока его страницы в кэше совпадают с диском
+void snapshot_shared_file(int32_t file) {
+    SharedFile &shared_file = sharedMemory->files[file];
+    struct stat file_stat;
+    if (stat(shared_file.path, &file_stat) == -1 || file_stat.st_dev != shared_file.dev ||
+        file_stat.st_ino != shared_file.inode) {
+        shared_file.snapshotValid = false;
+        return;
     }
-    found_file_descriptor(fd);
-    FileDescriptor &fileDesc = fileDescriptors[fd];
-    size_t bytes_read_total = 0;
-    std::vector<std::pair<char *, size_t>> temp_chunks;
-    pthread_mutex_lock(&sharedMemory->mutex);
+    shared_file.snapshotMtimeNs = mtime_ns(file_stat);
+    shared_file.snapshotSize = file_stat.st_size;
+    shared_file.snapshotVersion = inode_version(shared_file.path);
+    shared_file.snapshotValid = true;
+}
 
-    while (bytes_read_total < count) {
-        off_t page_aligned_offset = fileDesc.cursor / PAGE_SIZE * PAGE_SIZE;
-        size_t page_offset = fileDesc.cursor % PAGE_SIZE;
-        size_t bytes_to_read = std::min(PAGE_SIZE - page_offset, count - bytes_read_total);
+// Файл на диске тот же и с тех пор не менялся
+bool file_matches_snapshot(const SharedFile &file) {
+    struct stat file_stat;
+    return file.snapshotValid && stat(file.path, &file_stat) == 0 && file_stat.st_dev == file.dev &&
+           file_stat.st_ino == file.inode && mtime_ns(file_stat) == file.snapshotMtimeNs &&
+           file_stat.st_size == file.snapshotSize && inode_version(file.path) == file.snapshotVersion;
+}
 
-        char *chunk = static_cast<char *>(allocate_aligned_memory(PAGE_SIZE));
+void read_boot_id(char *boot_id) {
+    memset(boot_id, 0, BOOT_ID_SIZE);
+    int fd = open(BOOT_ID_PATH, O_RDONLY | O_CLOEXEC);
+    if (fd != -1) {
+        ssize_t bytes = read(fd, boot_id, BOOT_ID_SIZE - 1);
+        close(fd);
+        if (bytes > 0 && boot_id[bytes - 1] == '\n') {
+            boot_id[bytes - 1] = '\0';
+        }
+    }
+}
 
-        CachePage *page = find_cache_page(fileDesc.inode, page_aligned_offset);
-        if (!page) {
-            ssize_t bytes_from_file = read_data_from_file(fd, fileDesc.cursor, chunk, bytes_to_read);
-            if (bytes_from_file <= 0) {
-                free(chunk);
-                break;
-            }
+// Первый процесс поднимает кэш, оставшийся в файле от прошлых запусков. Все, что принадлежало
+// процессам (мьютексы, закрепления, счетчики ссылок), заводим заново. Индекс и списки страниц
+// файлов строим по тегам фреймов: процесс мог упасть посреди их правки. Фрейм оставляем, если
+// он не был захвачен, чистый и его файл не менялся с последнего снимка (dev, inode, поколение,
+// mtime, размер). Грязные страницы после падения на диск не попали - их данные выбрасываем
+void recover_shared_memory() {
+    map_shared_arrays();
+    init_shared_locks();
+    std::vector<bool> valid_files(MAX_SHARED_FILES);
+    for (size_t i = 0; i < MAX_SHARED_FILES; i++) {
+        SharedFile &file = sharedMemory->files[i];
+        valid_files[i] = file.path[0] != '\0' && file_matches_snapshot(file);
+        file.openCount = 0;
+        file.residentPages = 0;
+        file.firstPage = -1;
+        file.commitLeader = 0;
+        file.size = file.snapshotSize;
+        if (!valid_files[i]) {
+            file.dev = 0;
+            file.inode = 0;
+            file.snapshotValid = false;
+            file.path[0] = '\0';
+        }
+    }
+    std::vector<bool> keep(cacheSize);
+    for (size_t i = 0; i < cacheSize; i++) {
+        const CachePage &page = cachePages[i];
+        keep[i] = page.file >= 0 && page.file < static_cast<int32_t>(MAX_SHARED_FILES) && valid_files[page.file] &&
+                  page.dev == sharedMemory->files[page.file].dev &&
+                  page.inode == sharedMemory->files[page.file].inode && page.state == 0 && page.seq % 2 == 0 &&
+                  page.length <= pageSize && !dirtyBits->test(i);
+    }
 
-            CachePage &current_page = *get_cache_page_to_replace(fd);
-            update_cache_page(current_page, fileDesc.inode, page_aligned_offset, chunk, bytes_to_read);
+    cacheIndex->init(cacheSize, index_buckets(cacheSize));
+    ghostIndex->init(cacheSize, index_buckets(cacheSize));
+    usedBits->init(cacheSize);
+    hotBits->init(cacheSize);
+    dirtyBits->init(cacheSize);
+    reset_cold_tier();
+    sharedMemory->replacement.init(replacementPolicy, cacheSize);
+    for (size_t i = 0; i < cacheSize; i++) {
+        CachePage &page = cachePages[i];
+        auto frame = static_cast<int32_t>(i);
+        page.state = 0;
+        page.seq = 0;
+        page.dirtySince = 0;
+        page.fileNext = -1;
+        page.filePrev = -1;
+        for (size_t word = i * sectorWords; word < (i + 1) * sectorWords; word++) {
+            dirtySectors[word] = 0;
+            if (!keep[i]) {
+                validSectors[word] = 0;
+            }
+        }
+        if (keep[i]) {
+            cacheIndex->insert(frame, {page.dev, page.inode, page.offset});
+            link_file_page(frame);
+            sharedMemory->replacement.loaded(frame, *usedBits, *hotBits, false);
         } else {
-            memcpy(chunk, page->data + page_offset, bytes_to_read);
+            page.file = -1;
+            page.length = 0;
+            page.dev = 0;
+            page.inode = 0;
+            page.offset = 0;
         }
+    }
+    // Счетчики процессов прошлых запусков уходят в общий слот
+    for (size_t i = 1; i < STAT_PROCESS_SLOTS; i++) {
+        retire_process_stats(sharedMemory->stats[i]);
+        sharedMemory->stats[i].pid = 0;
+    }
+    sharedMemory->dirtyCount = 0;
+    sharedMemory->flushRequested = false;
+    sharedMemory->refCount = 1;
+    sharedMemory->ready.store(true, std::memory_order_release);
+}
 
-        temp_chunks.push_back({chunk, bytes_to_read});
-        bytes_read_total += bytes_to_read;
-        fileDesc.cursor += bytes_to_read;
+// Берем кэш из файла, если он размечен нашей версией и его содержимому можно верить: последний
+// процесс записал его на диск целиком или машина с тех пор не перезагружалась (тогда свежие данные
+// в страничном кэше ядра, даже если процессы падали)
+bool restore_cache_file() {
+    struct stat file_stat;
+    if (fstat(cacheFileFd, &file_stat) == -1 || static_cast<size_t>(file_stat.st_size) < sizeof(SharedMemory)) {
+        return false;
+    }
+    auto *header = static_cast<SharedMemory *>(map_shared_memory(cacheFileFd, sizeof(SharedMemory), HugePages::OFF));
+    char boot_id[BOOT_ID_SIZE];
+    read_boot_id(boot_id);
+    bool usable = header->magic == SHARED_MEMORY_MAGIC && header->ready.load(std::memory_order_acquire) &&
+                  header->geometry.hugePages == HugePages::OFF &&
+                  header->geometry.mappedSize == static_cast<size_t>(file_stat.st_size) &&
+                  (header->saved || strncmp(header->bootId, boot_id, BOOT_ID_SIZE) == 0);
+    size_t mapped_size = header->geometry.mappedSize;
+    munmap(header, sizeof(SharedMemory));
+    if (!usable) {
+        return false;
     }
+    sharedMemory = static_cast<SharedMemory *>(map_shared_memory(cacheFileFd, mapped_size, HugePages::OFF));
+    sharedMemory->ready = false;
+    recover_shared_memory();
+    return true;
+}
 
-    pthread_mutex_unlock(&sharedMemory->mutex);
+// OFD-блокировка одного байта файла кэша: принадлежит открытому файлу, а не процессу,
+// и снимается ядром, когда процесс закрывает файл или падает
+bool lock_cache_file(off_t byte, short type, bool wait) {
+    struct flock lock = {};
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = byte;
+    lock.l_len = 1;
+    return fcntl(cacheFileFd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &lock) == 0;
+}
 
-    size_t assembled_offset = 0;
-    for (auto &[temp_chunk, chunk_size]: temp_chunks) {
-        memcpy(static_cast<char *>(buf) + assembled_offset, temp_chunk, chunk_size);
-        assembled_offset += chunk_size;
-        free(temp_chunk);
+// Кэш в обычном файле (LAB2_CACHE_FILE) переживает процессы и перезагрузки. Подключение и
+// отключение идут под блокировкой байта 0, каждый подключенный процесс держит на чтение байт 1.
+// Байт 1 удалось взять на запись - живых процессов нет, кэш из файла поднимаем мы
+void attach_cache_file() {
+    cacheFileFd = open(cacheFilePath, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (cacheFileFd == -1) {
+        perror("Failed to open cache file");
+        exit(1);
+    }
+    lock_cache_file(CACHE_FILE_ATTACH_LOCK, F_WRLCK, true);
+    if (!lock_cache_file(CACHE_FILE_USERS_LOCK, F_WRLCK, false)) {
+        join_shared_memory(cacheFileFd, HugePages::OFF);
+    } else {
+        if (!restore_cache_file()) {
+            create_shared_memory(cacheFileFd, HugePages::OFF);
+        }
+        // Пока мы работаем, файл на диске может отставать от памяти: после перезагрузки ему не верим
+        read_boot_id(sharedMemory->bootId);
+        sharedMemory->saved = false;
+        msync(sharedMemory, sizeof(SharedMemory), MS_SYNC);
     }
+    // Запись на байте 1 превращается в чтение без окна, в которое влез бы другой процесс
+    lock_cache_file(CACHE_FILE_USERS_LOCK, F_RDLCK, true);
+    lock_cache_file(CACHE_FILE_ATTACH_LOCK, F_UNLCK, true);
+}
 
-    return bytes_read_total;
+// Последний процесс сбрасывает грязные страницы, запоминает, какими были файлы, и пишет файл
+// кэша на диск. saved ставим последним: перезагрузка посреди записи оставит его false
+void save_cache_file() {
+    for (size_t i = 0; i < MAX_SHARED_FILES; i++) {
+        auto file = static_cast<int32_t>(i);
+        if (sharedMemory->files[i].residentPages > 0) {
+            flush_file_pages(-1, file, false);
+            snapshot_shared_file(file);
+        }
+    }
+    msync(sharedMemory, sharedMemory->geometry.mappedSize, MS_SYNC);
+    sharedMemory->saved = true;
+    msync(sharedMemory, sizeof(SharedMemory), MS_SYNC);
 }
 
+// Это надо чтобы общую память сделатт. Кто создал сегмент, тот его и размечает
+void attach_shared_memory() {
+    if (cacheFilePath[0] != '\0') {
+        attach_cache_file();
+        claim_process_stats();
+        return;
+    }
+    HugePages huge_pages = requestedHugePages;
+    int shm_fd = open_shared_memory(O_CREAT | O_EXCL, huge_pages);
+    bool created = shm_fd != -1;
+    if (!created && errno == EEXIST) {
+        shm_fd = open_shared_memory(0, huge_pages);
+    }
+    if (shm_fd == -1) {
+        perror("Failed to open shared memory");
+        exit(1);
+    }
+    if (created) {
+        create_shared_memory(shm_fd, huge_pages);
+    } else {
+        join_shared_memory(shm_fd, huge_pages);
+    }
+    close(shm_fd);
+    claim_process_stats();
+}
 
-ssize_t lab2_write(int fd, const char *buffer, size_t size) {
-    if (size > GLOBAL_CACHE_SIZE * PAGE_SIZE) {
-        return pwrite(fd, buffer, size, 0);
+// L1 под страницы той геометрии, что досталась от сегмента: данные с начала отображения,
+// чтобы копии были выровнены по странице, ячейки за ними
+void setup_l1() {
+    size_t slots = l1Bytes / pageSize;
+    if (slots == 0) {
+        return;
     }
-    found_file_descriptor(fd);
-    FileDescriptor &fileDesc = fileDescriptors[fd];
-    size_t bytes_written = 0;
-    pthread_mutex_lock(&sharedMemory->mutex);
-    while (bytes_written < size) {
-        off_t offset = fileDesc.cursor / PAGE_SIZE * PAGE_SIZE;
-        size_t page_offset = fileDesc.cursor % PAGE_SIZE;
-        size_t bytes_to_write = std::min(PAGE_SIZE - page_offset, size - bytes_written);
-        CachePage *page = find_cache_page(fileDesc.inode, offset);
-
-        if (page) {
-            // если страница нашлась, то пишем туды и отмечаем ее как очень грязную
-            memcpy(page->data + page_offset, buffer + bytes_written, bytes_to_write);
-            page->dirty = true;
-        } else {
-            // если страница не нашлась, то подрубаем клок и вытесняем и загружаем нужную страницу
-            CachePage &current_page = *get_cache_page_to_replace(fd);
-            update_cache_page(current_page, fileDesc.inode, offset, buffer + bytes_written, bytes_to_write);
-            current_page.dirty = true;
-            }
-        fileDesc.cursor += bytes_to_write;
-        bytes_written += bytes_to_write;
+    size_t slot_count = 1;
+    while (slot_count * 2 <= slots) {
+        slot_count *= 2;
     }
-    pthread_mutex_unlock(&sharedMemory->mutex);
-    return bytes_written;
+    void *memory = mmap(nullptr, slot_count * (pageSize + sizeof(L1Slot)), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        perror("Failed to allocate the L1 cache");
+        return;
+    }
+    l1Data = static_cast<char *>(memory);
+    l1Table = reinterpret_cast<L1Slot *>(l1Data + slot_count * pageSize);
+    for (size_t i = 0; i < slot_count; i++) {
+        l1Table[i].version = 0;
+        l1Table[i].frame = -1;
+    }
+    l1Slots = slot_count;
 }
 
+void release_l1() {
+    if (l1Slots != 0) {
+        munmap(l1Data, l1Slots * (pageSize + sizeof(L1Slot)));
+        l1Slots = 0;
+        l1Table = nullptr;
+        l1Data = nullptr;
+    }
+}
 
-int lab2_close(int fd) {
-    found_file_descriptor(fd);
-    ino_t inode = fileDescriptors[fd].inode;
-    pthread_mutex_lock(&sharedMemory->mutex);
-    for (size_t i = 0; i < GLOBAL_CACHE_SIZE; i++) {
-        CachePage &page = sharedMemory->cache[i];
-        if (page.inode == inode) {
-            page.used = false;
-            flush_dirty_page(page, fd);
+bool lock_segment_byte(int fd, off_t byte, short type, int command, struct flock &lock) {
+    lock = {};
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = byte;
+    lock.l_len = 1;
+    return fcntl(fd, command, &lock) == 0;
+}
+
+// Ребенок после fork входит в refCount, но может уйти в exec или в _exit и не отключиться. Поэтому
+// он держит OFD-блокировку байта своего слота в своем открытом сегменте с O_CLOEXEC: ядро снимет ее
+// при exec или выходе, и его refCount вернет тот, кто это заметит. У файла кэша сегмент не удаляют
+void track_forked_user() {
+    if (forkedUserFd != -1) {
+        close(forkedUserFd);
+        forkedUserFd = -1;
+    }
+    auto slot = static_cast<off_t>(processStats - sharedMemory->stats);
+    if (slot == 0 || cacheFileFd != -1) {
+        return;
+    }
+    HugePages huge_pages = sharedMemory->geometry.hugePages;
+    int fd = open_shared_memory(O_CLOEXEC, huge_pages);
+    struct flock lock;
+    if (fd != -1 && lock_segment_byte(fd, FORKED_USER_LOCKS + slot, F_WRLCK, F_OFD_SETLK, lock)) {
+        forkedUserFd = fd;
+        processStats->forkedUser.store(true);
+    } else if (fd != -1) {
+        close(fd);
+    }
+}
+
+// Дети, которые ушли в exec или вышли без atexit: блокировки их слотов нет, refCount возвращаем за них
+void release_gone_children() {
+    if (!sharedMemory || cacheFileFd != -1) {
+        return;
+    }
+    HugePages huge_pages = sharedMemory->geometry.hugePages;
+    int fd = open_shared_memory(O_CLOEXEC, huge_pages);
+    if (fd == -1) {
+        return;
+    }
+    for (size_t i = 1; i < STAT_PROCESS_SLOTS; i++) {
+        ProcessStats &stats = sharedMemory->stats[i];
+        struct flock lock;
+        if (stats.forkedUser.load() &&
+            lock_segment_byte(fd, FORKED_USER_LOCKS + static_cast<off_t>(i), F_WRLCK, F_OFD_GETLK, lock) &&
+            lock.l_type == F_UNLCK && stats.forkedUser.exchange(false)) {
+            sharedMemory->refCount.fetch_sub(1);
         }
     }
-    pthread_mutex_unlock(&sharedMemory->mutex);
-    fileDescriptors.erase(fd);
-    return close(fd);
+    close(fd);
 }
 
+// Штука для того, чтобы потом эта библиотека завелась
+void detach_shared_memory() {
+    unmap_all_mappings();
+    stop_flusher();
+    release_l1();
+    bool forked_child = getpid() != attachedPid;
+    if (!forked_child && cacheFileFd != -1 && lock_cache_file(CACHE_FILE_ATTACH_LOCK, F_WRLCK, true) &&
+        lock_cache_file(CACHE_FILE_USERS_LOCK, F_WRLCK, false)) {
+        save_cache_file();
+    }
+    for (ReopenedFile &reopened: reopenedFiles) {
+        if (reopened.fd != -1) {
+            close(reopened.fd);
+            reopened.fd = -1;
+        }
+    }
+    release_gone_children();
+    if (forkedUserFd != -1) {
+        processStats->forkedUser.store(false);
+    }
+    release_process_stats();
+    // Файл кэша остается на диске, как есть: мьютексы в нем заведет следующий первый процесс
+    if (sharedMemory && sharedMemory->refCount.fetch_sub(1) == 1 && cacheFileFd == -1) {
+        for (size_t i = 0; i < LOCK_STRIPES; i++) {
+            pthread_mutex_destroy(&sharedMemory->indexLocks[i]);
+            pthread_mutex_destroy(&sharedMemory->frameLocks[i]);
+        }
+        pthread_mutex_destroy(&sharedMemory->filesLock);
+        pthread_mutex_destroy(&sharedMemory->policyLock);
+        pthread_mutex_destroy(&sharedMemory->cold.lock);
+        for (SharedFile &file: sharedMemory->files) {
+            pthread_mutex_destroy(&file.pagesLock);
+            pthread_mutex_destroy(&file.sizeLock);
+        }
+        pthread_mutex_destroy(&sharedMemory->flusherLock);
+        if (sharedMemory->geometry.hugePages == HugePages::HUGETLB) {
+            unlink(HUGETLB_SHARED_MEMORY_PATH);
+        } else {
+            shm_unlink(SHARED_MEMORY_NAME);
+        }
+    }
+    munmap(sharedMemory, sharedMemory->geometry.mappedSize);
+    if (forkedUserFd != -1) {
+        close(forkedUserFd);
+        forkedUserFd = -1;
+    }
+    // Копия дескриптора в ребенке: закрытие не снимает блокировки OFD, пока файл держит родитель
+    if (cacheFileFd != -1) {
+        close(cacheFileFd);
+        cacheFileFd = -1;
+    }
+}
 
-off_t lab2_lseek(int fd, off_t offset, int whence) {
-    found_file_descriptor(fd);
+// Ребенок после fork получает отображение сегмента и дескрипторы, но не поток флашера. Он входит
+// в refCount: родитель может выйти раньше, и тогда сегмент снимает последний из детей. Файл кэша
+// сохраняет только процесс, который его открыл. Блокировки потоков родителя в ребенке могли остаться захваченными
+void prepare_forked_child() {
+    sharedMemory->refCount.fetch_add(1);
+    pthread_mutex_init(&flusherMutex, nullptr);
+    pthread_cond_init(&flusherCond, nullptr);
+    pthread_mutex_init(&reopenedFilesLock, nullptr);
+    flusherStarted = false;
+    forget_mappings();
+    claim_process_stats();
+    track_forked_user();
+}
 
-    FileDescriptor &fileDesc = fileDescriptors[fd];
-    off_t new_offset;
-    switch (whence) {
-        case SEEK_SET:
-            new_offset = offset;
+// Размер с суффиксом K, M или G. false, если в строке не только размер или он не влезает в size_t
+bool parse_size(const char *value, size_t &size) {
+    if (*value < '0' || *value > '9') {
+        return false;
+    }
+    char *suffix;
+    errno = 0;
+    unsigned long long number = strtoull(value, &suffix, 10);
+    size_t shift = 0;
+    switch (*suffix) {
+        case 'G':
+        case 'g':
+            shift = 30;
             break;
-        case SEEK_CUR:
-            new_offset = fileDesc.cursor + offset;
+        case 'M':
+        case 'm':
+            shift = 20;
             break;
-        case SEEK_END: {
-            struct stat st;
-            if (fstat(fd, &st) == -1) {
-                return -1;
-            }
-            new_offset = st.st_size + offset;
+        case 'K':
+        case 'k':
+            shift = 10;
             break;
-        }
         default:
-            errno = EINVAL;
-            return -1;
+            break;
     }
-
-    if (new_offset < 0) {
-        errno = EINVAL;
-        return -1;
+    if (shift != 0) {
+        suffix++;
     }
-    fileDesc.cursor = new_offset;
-    return new_offset;
+    if (errno == ERANGE || *suffix != '\0' || number > (SIZE_MAX >> shift)) {
+        return false;
+    }
+    size = static_cast<size_t>(number) << shift;
+    return true;
 }
 
+// Размер из переменной окружения. Не размер - предупреждаем и оставляем значение по умолчанию
+void read_size_env(const char *name, size_t &size) {
+    const char *value = getenv(name);
+    size_t parsed;
+    if (!value) {
+        return;
+    }
+    if (parse_size(value, parsed)) {
+        size = parsed;
+    } else {
+        fprintf(stderr, "%s must be a size like 64M, using %zu\n", name, size);
+    }
+}
 
-int lab2_fsync(int fd) {
-    found_file_descriptor(fd);
-    FileDescriptor &fileDesc = fileDescriptors[fd];
-    ino_t inode = fileDesc.inode;
-
-    pthread_mutex_lock(&sharedMemory->mutex);
-    for (size_t i = 0; i < GLOBAL_CACHE_SIZE; i++) {
-        CachePage &page = sharedMemory->cache[i];
-        if (page.dirty && page.inode == inode) {
-            char *aligned_buffer;
-            posix_memalign(reinterpret_cast<void **>(&aligned_buffer), PAGE_SIZE, PAGE_SIZE);
-            memcpy(aligned_buffer, page.data, PAGE_SIZE);
-
-            if (lseek(fd, page.offset, SEEK_SET) != -1) {
-                if (write(fd, aligned_buffer, PAGE_SIZE) == -1) {
-                    perror("Failed to write page to disk");
-                    free(aligned_buffer);
-                    pthread_mutex_unlock(&sharedMemory->mutex);
-                    return -1;
-                }
-            } else {
-                perror("Failed to seek in file");
-                free(aligned_buffer);
-                pthread_mutex_unlock(&sharedMemory->mutex);
-                return -1;
+// из названия и так понятно что это
+void initialize_library() {
+    if (const char *readahead = getenv("LAB2_READAHEAD_MAX")) {
+        readaheadMaxPages = std::min<size_t>(strtoull(readahead, nullptr, 10), IOV_MAX);
+        readaheadMaxFromEnv = true;
+    }
+    read_size_env("LAB2_CACHE_SIZE", requestedCacheBytes);
+    read_size_env("LAB2_COLD_SIZE", requestedColdBytes);
+    if (const char *page_size = getenv("LAB2_PAGE_SIZE")) {
+        size_t size = 0;
+        if (!parse_size(page_size, size) || size < MIN_PAGE_SIZE || size > MAX_PAGE_SIZE || (size & (size - 1)) != 0) {
+            fprintf(stderr, "LAB2_PAGE_SIZE must be a power of two from 4K to 2M, using %zu\n", DEFAULT_PAGE_SIZE);
+        } else {
+            requestedPageSize = size;
+        }
+    }
+    if (requestedCacheBytes / requestedPageSize < MIN_CACHE_PAGES) {
+        fprintf(stderr, "LAB2_CACHE_SIZE is below %zu pages, using %zu\n", MIN_CACHE_PAGES,
+                MIN_CACHE_PAGES * requestedPageSize);
+    }
+    if (const char *huge_pages = getenv("LAB2_HUGE_PAGES")) {
+        if (strcmp(huge_pages, "thp") == 0) {
+            requestedHugePages = HugePages::THP;
+        } else if (strcmp(huge_pages, "hugetlb") == 0) {
+            requestedHugePages = HugePages::HUGETLB;
+        }
+    }
+    if (const char *policy = getenv("LAB2_POLICY")) {
+        if (!parse_replacement_policy(policy, replacementPolicy)) {
+            fprintf(stderr, "Unknown LAB2_POLICY %s, using clock\n", policy);
+        }
+    }
+    if (const char *flusher = getenv("LAB2_FLUSHER")) {
+        flusherEnabled = strcmp(flusher, "0") != 0;
+    }
+    if (const char *ratio = getenv("LAB2_DIRTY_RATIO")) {
+        dirtyRatioPercent = std::min<size_t>(strtoull(ratio, nullptr, 10), 100);
+    }
+    if (const char *expire = getenv("LAB2_DIRTY_EXPIRE_MS")) {
+        dirtyExpireMs = strtoll(expire, nullptr, 10);
+    }
+    if (const char *group_commit = getenv("LAB2_GROUP_COMMIT")) {
+        groupCommit = strcmp(group_commit, "0") != 0;
+    }
+    if (const char *sectors = getenv("LAB2_SECTORS")) {
+        sectorTracking = strcmp(sectors, "0") != 0;
+    }
+    read_size_env("LAB2_L1_SIZE", l1Bytes);
+    if (const char *trace_dir = getenv("LAB2_TRACE_DIR")) {
+        if (strlen(trace_dir) > PATH_MAX - TRACE_NAME_MAX) {
+            fprintf(stderr, "LAB2_TRACE_DIR is longer than %zu, not tracing\n", PATH_MAX - TRACE_NAME_MAX);
+        } else {
+            strncpy(traceDir, trace_dir, PATH_MAX - 1);
+            if (mkdir(traceDir, 0777) == -1 && errno != EEXIST) {
+                perror("Failed to create trace directory");
             }
-
-            free(aligned_buffer);
-            page.dirty = false;
         }
     }
-    pthread_mutex_unlock(&sharedMemory->mutex);
-
-    return fsync(fd);
+    if (const char *prewarm = getenv("LAB2_PREWARM")) {
+        prewarmOnOpen = strcmp(prewarm, "0") != 0;
+    }
+    if (const char *cache_file = getenv("LAB2_CACHE_FILE")) {
+        strncpy(cacheFilePath, cache_file, PATH_MAX - 1);
+    }
+    if (const char *io_uring = getenv("LAB2_IO_URING")) {
+        ioUringEnabled = strcmp(io_uring, "0") != 0;
+    }
+    // Ядро без io_uring (или с запретом на него) - молча работаем обычными вызовами
+    if (ioUringEnabled && !ioRing.setup(IO_URING_DEPTH)) {
+        ioUringEnabled = false;
+    }
+    for (ReopenedFile &reopened: reopenedFiles) {
+        reopened = {-1, 0, false};
+    }
+    attach_shared_memory();
+    // Окно упреждающего чтения по умолчанию в байтах: большие страницы сами по себе читают наперед.
+    // Пачка промахов держит свои фреймы эксклюзивно, пока ставит следующие: больше четверти кэша
+    // ей не даем, иначе ей (и соседям) станет нечего вытеснять
+    if (!readaheadMaxFromEnv) {
+        readaheadMaxPages = READAHEAD_MAX_BYTES / pageSize;
+    }
+    readBatchPages = std::min(READ_BATCH_MAX_PAGES, std::max<size_t>(cacheSize / 4, 1));
+    readaheadMaxPages = std::min(readaheadMaxPages, readBatchPages);
+    setup_l1();
+    atexit(detach_shared_memory);
+    attachedPid = getpid();
+    pthread_atfork(nullptr, nullptr, prepare_forked_child);
+    start_flusher();
+}
+
+
+// Берем дескриптор на время вызова. Плохой fd - EBADF, а не выход из процесса
+FileDescriptor *acquire_file_descriptor(int fd) {
+    if (fd < 0 || fd >= MAX_FILE_DESCRIPTORS) {
+        errno = EBADF;
+        return nullptr;
+    }
+    DescriptorSlot &slot = descriptorTable[fd];
+    if (!(slot.state.fetch_add(1, std::memory_order_acquire) & DESCRIPTOR_OPEN)) {
+        slot.state.fetch_sub(1, std::memory_order_release);
+        errno = EBADF;
+        return nullptr;
+    }
+    return &slot.desc;
+}
+
+void release_file_descriptor(int fd) {
+    descriptorTable[fd].state.fetch_sub(1, std::memory_order_release);
+}
+
+// Дескриптор, взятый на время одного вызова. desc = nullptr, если его нет
+struct DescriptorRef {
+    int fd;
+    FileDescriptor *desc;
+
+    explicit DescriptorRef(int file_fd) : fd(file_fd), desc(acquire_file_descriptor(file_fd)) {}
+
+    ~DescriptorRef() {
+        if (desc) {
+            release_file_descriptor(fd);
+        }
+    }
+};
+
+// получаем устройство и инод файла из дескриптора
+struct stat get_file_stat(int fd) {
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1) {
+        perror("Failed to get file inode");
+        close(fd);
+        exit(1);
+    }
+    return file_stat;
+}
+
+// Сколько секторов в самом маленьком чтении или записи O_DIRECT для файла. Ядро не сказало
+// (нет STATX_DIOALIGN) или слежение за секторами выключено - работаем целыми страницами, как раньше
+uint32_t direct_io_sectors(int fd) {
+    size_t alignment = pageSize;
+#ifdef STATX_DIOALIGN
+    struct statx file_statx;
+    if (sectorTracking && statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &file_statx) == 0 &&
+        (file_statx.stx_mask & STATX_DIOALIGN) && file_statx.stx_dio_offset_align != 0) {
+        alignment = std::max<size_t>({SECTOR_SIZE, file_statx.stx_dio_offset_align, file_statx.stx_dio_mem_align});
+        alignment = std::min(alignment, pageSize);
+    }
+#endif
+    return static_cast<uint32_t>(alignment / SECTOR_SIZE);
+}
+
+// Таблица файлов полна: освобождаем слот закрытого файла, у которого в кэше меньше всего страниц.
+// Скидываем его грязные страницы и выкидываем фреймы. Закрепленные кем-то страницы остаются,
+// тогда слот все еще занят - такой файл помечаем в tried и в следующий раз берем другой.
+// Зовут без filesLock: сброс идет на диск. false - закрытых файлов со страницами больше нет
+bool reclaim_shared_file(std::vector<bool> &tried) {
+    int32_t victim = -1;
+    pthread_mutex_lock(&sharedMemory->filesLock);
+    for (size_t i = 0; i < MAX_SHARED_FILES; i++) {
+        const SharedFile &file = sharedMemory->files[i];
+        if (!tried[i] && file.openCount == 0 && file.residentPages > 0 &&
+            (victim == -1 || file.residentPages < sharedMemory->files[victim].residentPages)) {
+            victim = static_cast<int32_t>(i);
+        }
+    }
+    pthread_mutex_unlock(&sharedMemory->filesLock);
+    if (victim == -1) {
+        return false;
+    }
+    tried[victim] = true;
+    flush_file_pages(-1, victim, false);
+    evict_file_pages(victim, 0, LLONG_MAX);
+    return true;
+}
+
+// Регистрируем файл в общей таблице (или находим, если его уже кто-то открыл).
+// Слот без открытых дескрипторов и страниц в кэше свободен и может достаться другому файлу.
+// Свободных нет - освобождаем слот закрытого файла, ENFILE - только если открыты все
+int32_t register_shared_file(const char *path, const struct stat &file_stat, uint32_t io_sectors) {
+    std::vector<bool> tried;
+    int32_t slot = -1;
+    while (true) {
+        pthread_mutex_lock(&sharedMemory->filesLock);
+        for (size_t i = 0; i < MAX_SHARED_FILES; i++) {
+            SharedFile &file = sharedMemory->files[i];
+            bool busy = file.openCount > 0 || file.residentPages > 0;
+            if (file.dev == file_stat.st_dev && file.inode == file_stat.st_ino) {
+                slot = static_cast<int32_t>(i);
+                break;
+            }
+            if (!busy && slot == -1) {
+                slot = static_cast<int32_t>(i);
+            }
+        }
+        if (slot != -1) {
+            break;
+        }
+        pthread_mutex_unlock(&sharedMemory->filesLock);
+        tried.resize(MAX_SHARED_FILES);
+        if (!reclaim_shared_file(tried)) {
+            errno = ENFILE;
+            return -1;
+        }
+    }
+
+    SharedFile &file = sharedMemory->files[slot];
+    if (file.openCount == 0 && file.residentPages == 0) {
+        // Слот занимает файл заново: переоткрытые раньше дескрипторы к нему больше не подходят
+        file.dev = file_stat.st_dev;
+        file.inode = file_stat.st_ino;
+        file.generation++;
+        file.ioSectors = io_sectors;
+        file.size = file_stat.st_size;
+        file.snapshotValid = false;
+    }
+    if (!realpath(path, file.path)) {
+        strncpy(file.path, path, PATH_MAX - 1);
+        file.path[PATH_MAX - 1] = '\0';
+    }
+    file.openCount++;
+    pthread_mutex_unlock(&sharedMemory->filesLock);
+    return slot;
+}
+
+// открываем и сохраняем инод
+int open_descriptor(const char *path, int flags) {
+    // ОДИРЕКТ надо чтобы без всех этих вашей пейдж кэшей работать с файлом
+    flags |= O_DIRECT;
+    int fd = open(path, flags);
+    if (fd == -1) return -1;
+    if (fd >= MAX_FILE_DESCRIPTORS) {
+        close(fd);
+        errno = EMFILE;
+        return -1;
+    }
+    struct stat file_stat = get_file_stat(fd);
+    int32_t file = register_shared_file(path, file_stat, direct_io_sectors(fd));
+    if (file == -1) {
+        close(fd);
+        return -1;
+    }
+    // Номер fd ядро не выдаст снова, пока lab2_close его не закроет, так что ячейка свободна.
+    // Читаем state, чтобы увидеть все, что сделал с ячейкой прошлый lab2_close
+    DescriptorSlot &slot = descriptorTable[fd];
+    slot.state.load(std::memory_order_acquire);
+    FileDescriptor &fileDesc = slot.desc;
+    fileDesc.fd = fd;
+    fileDesc.cursor = 0;
+    fileDesc.dev = file_stat.st_dev;
+    fileDesc.inode = file_stat.st_ino;
+    fileDesc.file = file;
+    fileDesc.lastReadEnd = 0;
+    fileDesc.readaheadPages = 0;
+    fileDesc.writable = (flags & O_ACCMODE) != O_RDONLY;
+    fileDesc.readFd = fd;
+    if ((flags & O_ACCMODE) == O_WRONLY) {
+        // Края записей дочитываем с диска, а через O_WRONLY читать нельзя. Через /proc/self/fd - тот же инод
+        char self_path[32];
+        snprintf(self_path, sizeof(self_path), "/proc/self/fd/%d", fd);
+        fileDesc.readFd = open(self_path, O_RDONLY | O_DIRECT | O_CLOEXEC);
+    }
+    fileDesc.advice.store(0, std::memory_order_relaxed);
+    fileDesc.tracePages = 0;
+    fileDesc.traceLast = 0;
+    fileDesc.lastTracedPage = -1;
+    fileDesc.pagesRead = 0;
+    fileDesc.prewarmNext = 0;
+    pthread_mutex_init(&fileDesc.traceLock, nullptr);
+    pthread_mutex_init(&slot.cursorLock, nullptr);
+    slot.state.fetch_or(DESCRIPTOR_OPEN, std::memory_order_release);
+    return fd;
+}
+
+// Файл, который читали с записью трассы, начинаем грузить по ней сразу
+int lab2_open(const char *path, int flags) {
+    LatencyTimer timer(LAB2_LATENCY_OPEN);
+    int fd = open_descriptor(path, flags);
+    if (fd != -1 && traceDir[0] != '\0' && prewarmOnOpen) {
+        start_prewarm(descriptorTable[fd].desc);
+    }
+    return fd;
+}
+
+// Файл удалили или переименовали, но у этого процесса он открыт: переоткрываем его дескриптор
+// через /proc/self/fd, так под именем точно тот же инод. -1, если такого дескриптора нет
+int reopen_local_file(int32_t file) {
+    const SharedFile &shared_file = sharedMemory->files[file];
+    DIR *descriptors = opendir("/proc/self/fd");
+    if (!descriptors) {
+        return -1;
+    }
+    int fd = -1;
+    while (struct dirent *entry = readdir(descriptors)) {
+        char path[PATH_MAX];
+        struct stat file_stat;
+        snprintf(path, sizeof(path), "/proc/self/fd/%s", entry->d_name);
+        if (entry->d_name[0] != '.' && stat(path, &file_stat) == 0 && file_stat.st_dev == shared_file.dev &&
+            file_stat.st_ino == shared_file.inode) {
+            fd = open(path, O_WRONLY | O_DIRECT | O_CLOEXEC);
+            if (fd != -1) {
+                break;
+            }
+        }
+    }
+    closedir(descriptors);
+    return fd;
+}
+
+// Через что скидывать страницы файла дескриптора: открытый только на чтение fd для этого не годится,
+// тогда -1, и write_dirty_pages переоткроет файл сам
+int writeback_fd(const FileDescriptor &fileDesc) {
+    return fileDesc.writable ? fileDesc.fd : -1;
+}
+
+// Дескриптор для записи страниц файла из общей таблицы, даже если этот процесс его не открывал.
+// Переоткрываем по пути и проверяем, что под ним все еще тот же инод
+int get_writeback_fd(int32_t file) {
+    SharedFile &shared_file = sharedMemory->files[file];
+    ReopenedFile &reopened = reopenedFiles[file];
+    pthread_mutex_lock(&reopenedFilesLock);
+    if (reopened.fd != -1 && reopened.generation == shared_file.generation) {
+        int fd = reopened.fd;
+        pthread_mutex_unlock(&reopenedFilesLock);
+        return fd;
+    }
+    if (reopened.fd != -1) {
+        close(reopened.fd);
+        reopened.fd = -1;
+    }
+    int fd = open(shared_file.path, O_WRONLY | O_DIRECT);
+    struct stat file_stat;
+    if (fd != -1 && (fstat(fd, &file_stat) == -1 || file_stat.st_dev != shared_file.dev ||
+                     file_stat.st_ino != shared_file.inode)) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd == -1) {
+        fd = reopen_local_file(file);
+    }
+    if (fd == -1) {
+        if (!reopened.failed || reopened.generation != shared_file.generation) {
+            fprintf(stderr, "Failed to reopen %s for write-back\n", shared_file.path);
+        }
+        reopened = {-1, shared_file.generation, true};
+    } else {
+        reopened = {fd, shared_file.generation, false};
+    }
+    pthread_mutex_unlock(&reopenedFilesLock);
+    return fd;
+}
+
+
+// Данные фрейма. Выровнены по странице, так что ОДИРЕКТ читает прямо сюда
+char *frame_data(int32_t frame) {
+    return cacheFrames + static_cast<size_t>(frame) * pageSize;
+}
+
+// Блокировка корзины индекса, в которую попадает ключ
+pthread_mutex_t &index_lock(const PageKey &key) {
+    return sharedMemory->indexLocks[cacheIndex->bucket_of(key) % LOCK_STRIPES];
+}
+
+// Блокировка данных фрейма
+pthread_mutex_t &frame_lock(int32_t frame) {
+    return sharedMemory->frameLocks[frame % LOCK_STRIPES];
+}
+
+// Фьютекс на state фрейма: без PRIVATE, потому что ждут друг друга разные процессы
+void wait_frame(CachePage &page, uint32_t observed) {
+    int64_t start = monotonic_ns();
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&page.state), FUTEX_WAIT, observed, nullptr, nullptr, 0);
+    int64_t waited = monotonic_ns() - start;
+    count_stat(STAT_LOCK_WAIT_NS, waited);
+    record_latency(LAB2_LATENCY_LOCK_WAIT, waited);
+}
+
+void wake_frame(CachePage &page) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&page.state), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+// Закрепляем фрейм, чтобы его не вытеснили. Не получится, если он сейчас грузится или вытесняется
+bool try_pin_frame(CachePage &page) {
+    uint32_t state = page.state.load(std::memory_order_acquire);
+    while (!(state & FRAME_EXCLUSIVE)) {
+        if (page.state.compare_exchange_weak(state, state + 1, std::memory_order_acquire)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void unpin_frame(CachePage &page) {
+    page.state.fetch_sub(1, std::memory_order_release);
+}
+
+// Счетчик версии фрейма: нечетный, пока меняются тег или данные. Оптимистичные читатели
+// сверяют его до и после копирования и при несовпадении повторяют
+void begin_frame_update(CachePage &page) {
+    page.seq.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void end_frame_update(CachePage &page) {
+    page.seq.fetch_add(1, std::memory_order_release);
+}
+
+// Отпускаем эксклюзивный фрейм (pins = 0 или 1) и будим всех, кто ждал конца загрузки
+void release_exclusive_frame(CachePage &page, uint32_t pins) {
+    end_frame_update(page);
+    page.state.store(pins, std::memory_order_release);
+    wake_frame(page);
+}
+
+// Находим страницу в индексе и закрепляем ее. Если страница грузится, ждем только этот фрейм
+int32_t pin_cache_page(const PageKey &key) {
+    while (true) {
+        pthread_mutex_t &lock = index_lock(key);
+        pthread_mutex_lock(&lock);
+        int32_t frame = cacheIndex->find(key);
+        if (frame == NO_FRAME) {
+            pthread_mutex_unlock(&lock);
+            return NO_FRAME;
+        }
+        CachePage &page = cachePages[frame];
+        if (try_pin_frame(page)) {
+            pthread_mutex_unlock(&lock);
+            return frame;
+        }
+        uint32_t observed = page.state.load(std::memory_order_acquire);
+        pthread_mutex_unlock(&lock);
+        if (observed & FRAME_EXCLUSIVE) {
+            wait_frame(page, observed);
+        }
+    }
+}
+
+
+// Читаем что нибудь из файла
+ssize_t read_data_from_file(int fd, off_t offset, char *chunk, size_t bytes_to_read) {
+    int64_t start = monotonic_ns();
+    ssize_t bytes_from_file = pread(fd, chunk, bytes_to_read, offset);
+    record_latency(LAB2_LATENCY_DISK_IO, monotonic_ns() - start);
+    if (bytes_from_file == -1) {
+        perror("Failed to read page from disk");
+        return -1;
+    }
+    if (static_cast<size_t>(bytes_from_file) < bytes_to_read) {
+        memset(chunk + bytes_from_file, 0, bytes_to_read - bytes_from_file);
+    }
+    return bytes_from_file;
+}
+
+// Выполняем пачку запросов: через кольцо io_uring этого потока все разом, иначе по одному
+// preadv/pwritev. Если кольцо сломалось посреди пачки, невыполненные запросы помечены ошибкой
+void submit_io(IoRequest *requests, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    int64_t start = monotonic_ns();
+    if (ioUringEnabled && ioRing.setup(IO_URING_DEPTH)) {
+        if (!ioRing.run(requests, count)) {
+            perror("io_uring failed, falling back to preadv/pwritev");
+            ioUringEnabled = false;
+        }
+        record_latency(LAB2_LATENCY_DISK_IO, monotonic_ns() - start);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        IoRequest &request = requests[i];
+        request.result = request.write ? pwritev(request.fd, request.iov, request.iovcnt, request.offset)
+                                       : preadv(request.fd, request.iov, request.iovcnt, request.offset);
+        request.error = request.result == -1 ? errno : 0;
+    }
+    record_latency(LAB2_LATENCY_DISK_IO, monotonic_ns() - start);
+}
+
+
+// Пачкаем страницу. Время и счетчик трогаем только на переходе из чистой в грязную
+void mark_page_dirty(int32_t frame) {
+    if (!dirtyBits->set(frame)) {
+        cachePages[frame].dirtySince.store(monotonic_ms(), std::memory_order_relaxed);
+        sharedMemory->dirtyCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Снимаем флаг перед записью на диск. false - страница и так была чистой
+bool clean_page(int32_t frame) {
+    if (dirtyBits->clear(frame)) {
+        sharedMemory->dirtyCount.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+// Маска секторов [first, last) в слове word битмапа секторов фрейма
+uint64_t sector_mask(size_t word, size_t first, size_t last) {
+    size_t low = std::max(first, word * 64) - word * 64;
+    size_t high = std::min(last, word * 64 + 64) - word * 64;
+    return high - low == 64 ? ~0ULL : ((1ULL << (high - low)) - 1) << low;
+}
+
+std::atomic<uint64_t> *frame_sectors(std::atomic<uint64_t> *bits, int32_t frame) {
+    return bits + static_cast<size_t>(frame) * sectorWords;
+}
+
+void set_sectors(std::atomic<uint64_t> *bits, int32_t frame, size_t first, size_t last) {
+    std::atomic<uint64_t> *words = frame_sectors(bits, frame);
+    for (size_t word = first / 64; word * 64 < last; word++) {
+        words[word].fetch_or(sector_mask(word, first, last), std::memory_order_relaxed);
+    }
+}
+
+// Все секторы [first, last) отмечены (all = true) или хоть один (all = false)
+bool test_sectors(std::atomic<uint64_t> *bits, int32_t frame, size_t first, size_t last, bool all) {
+    std::atomic<uint64_t> *words = frame_sectors(bits, frame);
+    for (size_t word = first / 64; word * 64 < last; word++) {
+        uint64_t mask = sector_mask(word, first, last);
+        uint64_t set = words[word].load(std::memory_order_relaxed) & mask;
+        if (all ? set != mask : set != 0) {
+            return !all;
+        }
+    }
+    return all;
+}
+
+// Новая страница во фрейме: ни один сектор еще не прочитан и не записан
+void reset_frame_sectors(int32_t frame) {
+    for (size_t word = 0; word < sectorWords; word++) {
+        frame_sectors(validSectors, frame)[word].store(0, std::memory_order_relaxed);
+        frame_sectors(dirtySectors, frame)[word].store(0, std::memory_order_relaxed);
+    }
+}
+
+// Во фрейме вся страница: читать из него можно, ничего не дочитывая с диска
+bool frame_complete(int32_t frame) {
+    return test_sectors(validSectors, frame, 0, pageSectors, true);
+}
+
+size_t io_sectors(int32_t frame) {
+    return std::max<size_t>(sharedMemory->files[cachePages[frame].file].ioSectors, 1);
+}
+
+// Дочитываем с диска невалидные секторы [first, last) фрейма, края округляем до блока O_DIRECT файла.
+// Если между ними есть валидные (записанные и, может быть, еще не сброшенные), читаем в буфер потока
+// и переносим только невалидные. Зовут под frame_lock между begin_frame_update и end_frame_update.
+// Читать нечем (fd = -1: файл открыт только на запись, а на чтение его не открыть) или не вышло -
+// секторы нули, как раньше было у всей страницы
+void fill_sectors(int fd, int32_t frame, size_t first, size_t last) {
+    CachePage &page = cachePages[frame];
+    size_t unit = io_sectors(frame);
+    first = first / unit * unit;
+    last = std::min(align_up(last, unit), pageSectors);
+    while (first < last && test_sectors(validSectors, frame, first, first + unit, true)) {
+        first += unit;
+    }
+    while (last > first && test_sectors(validSectors, frame, last - unit, last, true)) {
+        last -= unit;
+    }
+    if (first == last) {
+        return;
+    }
+    size_t bytes = (last - first) * SECTOR_SIZE;
+    char *target = frame_data(frame) + first * SECTOR_SIZE;
+    bool direct = !test_sectors(validSectors, frame, first, last, false);
+    char *buffer = direct ? target : bounceBuffer.page();
+    off_t offset = page.offset + static_cast<off_t>(first * SECTOR_SIZE);
+    ssize_t bytes_from_file = fd == -1 ? -1 : read_data_from_file(fd, offset, buffer, bytes);
+    if (bytes_from_file == -1) {
+        memset(buffer, 0, bytes);
+    } else if (bytes_from_file > 0) {
+        count_stat(STAT_DISK_BYTES_READ, bytes_from_file);
+        page.length = std::max<uint32_t>(page.length, first * SECTOR_SIZE + bytes_from_file);
+    }
+    if (!direct) {
+        for (size_t sector = first; sector < last; sector++) {
+            if (!test_sectors(validSectors, frame, sector, sector + 1, true)) {
+                memcpy(target + (sector - first) * SECTOR_SIZE, buffer + (sector - first) * SECTOR_SIZE, SECTOR_SIZE);
+            }
+        }
+    }
+    set_sectors(validSectors, frame, first, last);
+}
+
+// Грязный кусок страницы в секторах [first, last)
+struct SectorRun {
+    size_t first;
+    size_t last;
+};
+
+// Снимаем грязные секторы фрейма и собираем их в куски из целых блоков O_DIRECT файла. Блок,
+// который задела запись, валиден целиком (запись дочитывает свои края), так что писать его можно весь
+std::vector<SectorRun> take_dirty_runs(int32_t frame) {
+    uint64_t taken[MAX_SECTOR_WORDS];
+    std::atomic<uint64_t> *words = frame_sectors(dirtySectors, frame);
+    for (size_t word = 0; word < sectorWords; word++) {
+        taken[word] = words[word].exchange(0, std::memory_order_acq_rel);
+    }
+    size_t unit = io_sectors(frame);
+    std::vector<SectorRun> runs;
+    for (size_t first = 0; first < pageSectors; first += unit) {
+        bool dirty = false;
+        for (size_t word = first / 64; word * 64 < first + unit && !dirty; word++) {
+            dirty = taken[word] & sector_mask(word, first, first + unit);
+        }
+        if (!dirty) {
+            continue;
+        }
+        if (!runs.empty() && runs.back().last == first) {
+            runs.back().last = first + unit;
+        } else {
+            runs.push_back({first, first + unit});
+        }
+    }
+    return runs;
+}
+
+// Запись не удалась: куски снова грязные
+void restore_dirty_run(int32_t frame, const SectorRun &run) {
+    set_sectors(dirtySectors, frame, run.first, run.last);
+    mark_page_dirty(frame);
+}
+
+// Запись дошла до end: двигаем размер файла. Зовут до того, как страница станет грязной, иначе
+// сброс обрезал бы файл по старому размеру. sizeLock - последняя блокировка, под ней других не берем
+void grow_file_size(int32_t file, off_t end) {
+    SharedFile &shared_file = sharedMemory->files[file];
+    if (end <= shared_file.size.load(std::memory_order_acquire)) {
+        return;
+    }
+    pthread_mutex_lock(&shared_file.sizeLock);
+    if (end > shared_file.size.load(std::memory_order_relaxed)) {
+        shared_file.size.store(end, std::memory_order_release);
+    }
+    pthread_mutex_unlock(&shared_file.sizeLock);
+}
+
+// Сброс пишет целыми блоками O_DIRECT, и последний блок файла дописал за его конец нули до written_end:
+// обрезаем файл обратно до размера. Под sizeLock, чтобы не отрезать то, что допишут и сбросят за это время
+void trim_file_tail(int fd, int32_t file, off_t written_end) {
+    SharedFile &shared_file = sharedMemory->files[file];
+    if (written_end <= shared_file.size.load(std::memory_order_acquire)) {
+        return;
+    }
+    pthread_mutex_lock(&shared_file.sizeLock);
+    off_t size = shared_file.size.load(std::memory_order_relaxed);
+    if (written_end > size && ftruncate(fd, size) == -1) {
+        perror("Failed to trim the file to its size");
+    }
+    pthread_mutex_unlock(&shared_file.sizeLock);
+}
+
+// Проверяем, и если страница испачкана, то скидываем на диск прямо из фрейма ее грязные куски.
+// Флаг снимаем до записи: если кто-то допишет страницу во время pwrite, она снова станет грязной
+int flush_dirty_page(int32_t frame, int fd) {
+    CachePage &page = cachePages[frame];
+    if (!clean_page(frame)) {
+        return 0;
+    }
+    std::vector<SectorRun> runs = take_dirty_runs(frame);
+    for (size_t i = 0; i < runs.size(); i++) {
+        size_t start = runs[i].first * SECTOR_SIZE;
+        size_t bytes = (runs[i].last - runs[i].first) * SECTOR_SIZE;
+        int64_t start_ns = monotonic_ns();
+        ssize_t written = pwrite(fd, frame_data(frame) + start, bytes, page.offset + static_cast<off_t>(start));
+        record_latency(LAB2_LATENCY_DISK_IO, monotonic_ns() - start_ns);
+        if (written != static_cast<ssize_t>(bytes)) {
+            perror("Failed to write page to disk");
+            for (; i < runs.size(); i++) {
+                restore_dirty_run(frame, runs[i]);
+            }
+            return -1;
+        }
+        LAB2_PROBE4(writeback, page.dev, page.inode, page.offset + static_cast<off_t>(start), bytes);
+        count_stat(STAT_DISK_BYTES_WRITTEN, bytes);
+        trim_file_tail(fd, page.file, page.offset + static_cast<off_t>(start + bytes));
+    }
+    if (!runs.empty()) {
+        count_stat(STAT_WRITEBACK_PAGES);
+    }
+    return 0;
+}
+
+// Вешаем фрейм в список страниц его файла, чтобы close и fsync не бегали по всему кэшу.
+// pagesLock - последняя блокировка, под ней никаких других не берем
+void link_file_page(int32_t frame) {
+    CachePage &page = cachePages[frame];
+    SharedFile &file = sharedMemory->files[page.file];
+    pthread_mutex_lock(&file.pagesLock);
+    page.filePrev = -1;
+    page.fileNext = file.firstPage;
+    if (file.firstPage != -1) {
+        cachePages[file.firstPage].filePrev = frame;
+    }
+    file.firstPage = frame;
+    file.residentPages.fetch_add(1);
+    pthread_mutex_unlock(&file.pagesLock);
+}
+
+void unlink_file_page(int32_t frame) {
+    CachePage &page = cachePages[frame];
+    SharedFile &file = sharedMemory->files[page.file];
+    pthread_mutex_lock(&file.pagesLock);
+    if (page.filePrev != -1) {
+        cachePages[page.filePrev].fileNext = page.fileNext;
+    } else {
+        file.firstPage = page.fileNext;
+    }
+    if (page.fileNext != -1) {
+        cachePages[page.fileNext].filePrev = page.filePrev;
+    }
+    page.fileNext = -1;
+    page.filePrev = -1;
+    file.residentPages.fetch_sub(1);
+    pthread_mutex_unlock(&file.pagesLock);
+}
+
+// Фреймы файла на данный момент. Список копируем, чтобы не держать pagesLock, пока ждем фреймы
+std::vector<int32_t> get_file_pages(int32_t file) {
+    SharedFile &shared_file = sharedMemory->files[file];
+    std::vector<int32_t> frames;
+    frames.reserve(shared_file.residentPages.load(std::memory_order_relaxed));
+    pthread_mutex_lock(&shared_file.pagesLock);
+    for (int32_t frame = shared_file.firstPage; frame != -1; frame = cachePages[frame].fileNext) {
+        frames.push_back(frame);
+    }
+    pthread_mutex_unlock(&shared_file.pagesLock);
+    return frames;
+}
+
+// Вынимаем фрейм из индекса и отвязываем от файла. Фрейм должен быть захвачен эксклюзивно
+void unindex_frame(int32_t frame) {
+    CachePage &page = cachePages[frame];
+    pthread_mutex_t &lock = index_lock({page.dev, page.inode, page.offset});
+    pthread_mutex_lock(&lock);
+    cacheIndex->remove(frame);
+    pthread_mutex_unlock(&lock);
+    if (page.file != -1) {
+        unlink_file_page(frame);
+        page.file = -1;
+    }
+}
+
+// Вытесняемую чистую страницу кладем в холодный ярус сжатой, если она того стоит. Сжимаем до
+// блокировки, под ней только освобождаем место со старого конца кольца и копируем байты.
+// Прежняя копия той же страницы, если была, уходит из индекса: найтись должна только новая
+void store_cold_page(int32_t frame) {
+    const CachePage &page = cachePages[frame];
+    if (coldEntryCount == 0 || page.length == 0 || !frame_complete(frame)) {
+        return;
+    }
+    coldBuffer.resize(pageSize);
+    size_t bytes = lz_compress(frame_data(frame), page.length, coldBuffer.data(),
+                               page.length * COLD_STORE_PERCENT / 100);
+    if (bytes == 0) {
+        return;
+    }
+    ColdTier &cold = sharedMemory->cold;
+    pthread_mutex_lock(&cold.lock);
+    int32_t previous = coldIndex->find({page.dev, page.inode, page.offset});
+    if (previous != NO_FRAME) {
+        coldIndex->remove(previous);
+    }
+    // Страница не переходит через конец кольца: не влезла до конца - пишем с начала
+    uint64_t start = cold.dataHead;
+    if (start % coldBytes + bytes > coldBytes) {
+        start = align_up(start, coldBytes);
+    }
+    while (cold.entryTail != cold.entryHead &&
+           (cold.entryHead - cold.entryTail >= coldEntryCount || start + bytes - cold.dataTail > coldBytes)) {
+        coldIndex->remove(static_cast<int32_t>(cold.entryTail % coldEntryCount));
+        cold.entryTail++;
+        cold.dataTail = cold.entryTail != cold.entryHead ? coldEntries[cold.entryTail % coldEntryCount].start : start;
+    }
+    if (cold.entryTail == cold.entryHead) {
+        cold.dataTail = start;
+    }
+    auto slot = static_cast<int32_t>(cold.entryHead++ % coldEntryCount);
+    coldEntries[slot] = {start, static_cast<uint32_t>(bytes), page.length};
+    memcpy(coldData + start % coldBytes, coldBuffer.data(), bytes);
+    coldIndex->insert(slot, {page.dev, page.inode, page.offset});
+    cold.dataHead = start + bytes;
+    pthread_mutex_unlock(&cold.lock);
+    count_stat(STAT_COLD_STORES);
+    count_stat(STAT_COLD_PAGE_BYTES, page.length);
+    count_stat(STAT_COLD_COMPRESSED_BYTES, bytes);
+}
+
+// Страницу ставят на загрузку во фрейм: если она есть в холодном ярусе, разжимаем ее прямо туда.
+// Копию из яруса убираем в любом случае, дальше верная версия страницы - во фрейме.
+// load - страницу иначе прочитали бы с диска, только такие обращения считаем промахами яруса
+bool take_cold_page(const PageKey &key, int32_t frame, bool load) {
+    if (coldEntryCount == 0) {
+        return false;
+    }
+    ColdTier &cold = sharedMemory->cold;
+    ssize_t length = -1;
+    pthread_mutex_lock(&cold.lock);
+    int32_t slot = coldIndex->find(key);
+    if (slot != NO_FRAME) {
+        const ColdEntry &entry = coldEntries[slot];
+        coldIndex->remove(slot);
+        length = lz_decompress(coldData + entry.start % coldBytes, entry.bytes, frame_data(frame), pageSize);
+        if (length != entry.length) {
+            length = -1;
+        }
+    }
+    pthread_mutex_unlock(&cold.lock);
+    if (length <= 0) {
+        if (load) {
+            count_stat(STAT_COLD_MISSES);
+        }
+        return false;
+    }
+    memset(frame_data(frame) + length, 0, pageSize - length);
+    cachePages[frame].length = length;
+    set_sectors(validSectors, frame, 0, pageSectors);
+    count_stat(STAT_COLD_HITS);
+    return true;
+}
+
+// Выкидываем из холодного яруса страницы файла из [start, end): их выкинули и из кэша
+void drop_cold_pages(dev_t dev, ino_t inode, off_t start, off_t end) {
+    if (coldEntryCount == 0) {
+        return;
+    }
+    ColdTier &cold = sharedMemory->cold;
+    pthread_mutex_lock(&cold.lock);
+    for (uint64_t entry = cold.entryTail; entry != cold.entryHead; entry++) {
+        auto slot = static_cast<int32_t>(entry % coldEntryCount);
+        const PageIndex::Node &node = coldIndex->nodes()[slot];
+        if (node.linked && node.key.dev == dev && node.key.inode == inode && node.key.offset >= start &&
+            node.key.offset < end) {
+            coldIndex->remove(slot);
+        }
+    }
+    pthread_mutex_unlock(&cold.lock);
+}
+
+// Слово битмапов, которое стрелка отдала этому потоку, и его еще не разобранные кандидаты
+thread_local size_t sweepWord = 0;
+thread_local uint64_t sweepCandidates = 0;
+// Фреймы, которые поток освободил за читателем с NOREUSE (drop_behind), - под его следующие промахи
+thread_local int32_t recycledFrames[RECYCLED_FRAMES];
+thread_local size_t recycledCount = 0;
+
+// Два круга стрелки без жертвы: все фреймы закреплены или грязные, а записать их нечем (файл удален
+// и открыт только в других процессах). Просим флашеры сбросить грязные - владелец файла запишет
+// его страницы через свой дескриптор - и ждем, сначала уступая процессор, потом засыпая.
+// false - ждем дольше EVICTION_TIMEOUT_MS, пора сдаваться
+bool wait_for_victim(int64_t &stuck_since) {
+    int64_t now = monotonic_ms();
+    if (stuck_since == 0) {
+        stuck_since = now;
+    } else if (now - stuck_since >= EVICTION_TIMEOUT_MS) {
+        fprintf(stderr, "No cache page can be evicted: all are pinned or dirty and cannot be written back\n");
+        return false;
+    }
+    sharedMemory->flushRequested.store(true, std::memory_order_relaxed);
+    if (now - stuck_since < FLUSH_INTERVAL_MS) {
+        sched_yield();
+    } else {
+        struct timespec pause = {0, 1000000};
+        nanosleep(&pause, nullptr);
+    }
+    return true;
+}
+
+// Находим страницу которую можно выкинуть и захватываем ее эксклюзивно. Стрелка идет словами
+// битмапов, кого из 64 фреймов выкидывать, решает политика вытеснения.
+// Первый круг грязные страницы пропускаем и просим флашер их скинуть: чистая жертва дешевле.
+// Если чистых нет, грязную скидываем в ее файл сами, потом вынимаем из индекса.
+// NO_VICTIM и ENOBUFS, если жертвы нет дольше EVICTION_TIMEOUT_MS
+int32_t get_cache_page_to_replace() {
+    // Сначала свои освобожденные фреймы: так проход с NOREUSE крутится в паре фреймов и не двигает
+    // стрелку, которая снимала бы биты used с чужих горячих страниц. Фрейм мог уже забрать другой
+    while (recycledCount > 0) {
+        int32_t frame = recycledFrames[--recycledCount];
+        CachePage &page = cachePages[frame];
+        uint32_t expected = 0;
+        if (page.state.compare_exchange_strong(expected, FRAME_EXCLUSIVE, std::memory_order_acquire)) {
+            begin_frame_update(page);
+            if (page.file == -1) {
+                return frame;
+            }
+            release_exclusive_frame(page, 0);
+        }
+    }
+    ReplacementState &replacement = sharedMemory->replacement;
+    size_t scanned = 0;
+    int64_t stuck_since = 0;
+    while (true) {
+        if (sweepCandidates == 0) {
+            scanned += FrameBitmap::BITS;
+            if (scanned % (2 * cacheSize) < FrameBitmap::BITS && !wait_for_victim(stuck_since)) {
+                errno = ENOBUFS;
+                return NO_VICTIM;
+            }
+            sweepWord = replacement.next_word();
+            sweepCandidates = replacement.sweep_word(sweepWord, *usedBits, *hotBits, cacheIndex->count);
+            continue;
+        }
+        auto frame = static_cast<int32_t>(sweepWord * FrameBitmap::BITS + __builtin_ctzll(sweepCandidates));
+        sweepCandidates &= sweepCandidates - 1;
+        CachePage &page = cachePages[frame];
+        if (page.state.load(std::memory_order_relaxed) != 0) {
+            continue;
+        }
+        if (page.file != -1 && !replacement.still_evictable(frame, *usedBits, *hotBits)) {
+            continue;
+        }
+        if (flusherEnabled && scanned < cacheSize && dirtyBits->test(frame, std::memory_order_relaxed)) {
+            sharedMemory->flushRequested.store(true, std::memory_order_relaxed);
+            continue;
+        }
+        uint32_t expected = 0;
+        if (!page.state.compare_exchange_strong(expected, FRAME_EXCLUSIVE, std::memory_order_acquire)) {
+            continue;
+        }
+        begin_frame_update(page);
+
+        bool dirty = dirtyBits->test(frame) && page.file != -1;
+        if (dirty) {
+            int fd = get_writeback_fd(page.file);
+            if (fd == -1 || flush_dirty_page(frame, fd) == -1) {
+                release_exclusive_frame(page, 0);
+                continue;
+            }
+            count_stat(STAT_DIRTY_EVICTIONS);
+        }
+        if (page.file != -1) {
+            count_stat(STAT_EVICTIONS);
+            LAB2_PROBE4(evict, page.dev, page.inode, page.offset, dirty);
+            store_cold_page(frame);
+        }
+
+        if (replacement.evicted(frame, *hotBits) && page.file != -1) {
+            pthread_mutex_lock(&sharedMemory->policyLock);
+            replacement.remember_evicted(*ghostIndex, {page.dev, page.inode, page.offset});
+            pthread_mutex_unlock(&sharedMemory->policyLock);
+        }
+        unindex_frame(frame);
+        return frame;
+    }
+}
+
+// Страницы этого дескриптора читают один раз (lab2_fadvise NOREUSE): обращение к ним не в счет
+bool no_reuse(const FileDescriptor &fileDesc) {
+    return fileDesc.advice.load(std::memory_order_relaxed) & ADVICE_NOREUSE;
+}
+
+// Окно упреждающего чтения по совету SEQUENTIAL: вдвое шире обычного предела, как у ядра
+size_t sequential_window() {
+    return readaheadMaxPages >= 2 ? std::min(2 * readaheadMaxPages, readBatchPages) : 0;
+}
+
+// Вытесняем фрейм и кладем его в индекс под ключом помеченным как загружаемый.
+// noreuse - страница с дескриптора с советом NOREUSE. NO_FRAME - страница уже есть в кэше,
+// NO_VICTIM - вытеснить нечего
+int32_t install_loading_frame(int32_t file, const PageKey &key, bool noreuse) {
+    int32_t frame = get_cache_page_to_replace();
+    if (frame == NO_VICTIM) {
+        return NO_VICTIM;
+    }
+    CachePage &page = cachePages[frame];
+    pthread_mutex_t &lock = index_lock(key);
+    pthread_mutex_lock(&lock);
+    if (cacheIndex->find(key) != NO_FRAME) {
+        // Пока мы искали фрейм, страницу загрузил кто-то другой
+        pthread_mutex_unlock(&lock);
+        release_exclusive_frame(page, 0);
+        return NO_FRAME;
+    }
+    page.dev = key.dev;
+    page.inode = key.inode;
+    page.offset = key.offset;
+    page.length = 0;
+    page.file = file;
+    reset_frame_sectors(frame);
+    cacheIndex->insert(frame, key);
+    pthread_mutex_unlock(&lock);
+    link_file_page(frame);
+
+    // Страница на один раз (NOREUSE) идет холодной и призраков не трогает: проход по большому
+    // файлу не выдавит горячие страницы и не сотрет их историю
+    if (noreuse) {
+        usedBits->clear(frame, std::memory_order_relaxed);
+        return frame;
+    }
+    // Страница, недавно вытесненная холодной, вернулась - политика кладет ее горячей
+    ReplacementState &replacement = sharedMemory->replacement;
+    bool ghost_hit = false;
+    if (replacement.uses_ghosts()) {
+        pthread_mutex_lock(&sharedMemory->policyLock);
+        ghost_hit = replacement.take_ghost(*ghostIndex, key);
+        pthread_mutex_unlock(&sharedMemory->policyLock);
+    }
+    replacement.loaded(frame, *usedBits, *hotBits, ghost_hit);
+    return frame;
+}
+
+// Загрузка не удалась (конец файла или ошибка): вынимаем фрейм из индекса и отдаем обратно
+void drop_loading_frame(int32_t frame) {
+    CachePage &page = cachePages[frame];
+    unindex_frame(frame);
+    // Тег сбрасываем, чтобы оптимистичный читатель не принял пустой фрейм за страницу
+    page.dev = 0;
+    page.inode = 0;
+    release_exclusive_frame(page, 0);
+}
+
+// Выкидываем страницу из эксклюзивно захваченного чистого фрейма и отдаем фрейм пустым.
+// Призраком ее не запоминаем: выкинуть ее попросили, это не говорит о том, что кэш мал
+void drop_exclusive_frame(int32_t frame) {
+    CachePage &page = cachePages[frame];
+    count_stat(STAT_EVICTIONS);
+    LAB2_PROBE4(evict, page.dev, page.inode, page.offset, 0);
+    sharedMemory->replacement.evicted(frame, *hotBits);
+    unindex_frame(frame);
+    usedBits->clear(frame, std::memory_order_relaxed);
+    page.dev = 0;
+    page.inode = 0;
+    release_exclusive_frame(page, 0);
+}
+
+// Читатель с NOREUSE дочитал страницу до конца - выкидываем ее сразу, если ее никто не держит и
+// никто больше не трогал (сам такой читатель used не ставит), а фрейм оставляем себе под следующий промах
+void drop_behind(const FileDescriptor &fileDesc, off_t offset) {
+    PageKey key = {fileDesc.dev, fileDesc.inode, offset};
+    int32_t frame = cacheIndex->find_unlocked(key, cacheSize);
+    if (frame == NO_FRAME || usedBits->test(frame, std::memory_order_relaxed)) {
+        return;
+    }
+    CachePage &page = cachePages[frame];
+    uint32_t expected = 0;
+    if (!page.state.compare_exchange_strong(expected, FRAME_EXCLUSIVE, std::memory_order_acquire)) {
+        return;
+    }
+    begin_frame_update(page);
+    if (page.file != fileDesc.file || page.dev != key.dev || page.inode != key.inode || page.offset != key.offset ||
+        dirtyBits->test(frame) || usedBits->test(frame)) {
+        release_exclusive_frame(page, 0);
+        return;
+    }
+    drop_exclusive_frame(frame);
+    if (recycledCount < RECYCLED_FRAMES) {
+        recycledFrames[recycledCount++] = frame;
+    }
+}
+
+// Достаем закрепленную страницу файла. На промахе вытесняем фрейм, кладем его в индекс
+// помеченным как загружаемый и читаем с диска уже без блокировок.
+// load = false - страницу собираются перезаписать, читать ее с диска не надо.
+// NO_FRAME - страницы нет в файле (или ее не прочитать), NO_VICTIM - под нее не нашлось фрейма
+int32_t get_cache_page(const FileDescriptor &fileDesc, off_t offset, bool load) {
+    PageKey key = {fileDesc.dev, fileDesc.inode, offset};
+    bool noreuse = no_reuse(fileDesc);
+    while (true) {
+        int32_t frame = pin_cache_page(key);
+        if (frame != NO_FRAME) {
+            if (!noreuse) {
+                usedBits->mark(frame);
+            }
+            return frame;
+        }
+
+        frame = install_loading_frame(fileDesc.file, key, noreuse);
+        if (frame == NO_FRAME) {
+            continue;
+        }
+        if (frame == NO_VICTIM) {
+            return NO_VICTIM;
+        }
+        CachePage &page = cachePages[frame];
+        if (take_cold_page(key, frame, load)) {
+            release_exclusive_frame(page, 1);
+            return frame;
+        }
+        if (load) {
+            ssize_t bytes_from_file = read_data_from_file(fileDesc.fd, offset, frame_data(frame), pageSize);
+            if (bytes_from_file <= 0) {
+                drop_loading_frame(frame);
+                return NO_FRAME;
+            }
+            page.length = bytes_from_file;
+            set_sectors(validSectors, frame, 0, pageSectors);
+            count_stat(STAT_DISK_BYTES_READ, bytes_from_file);
+        }
+        // Без загрузки во фрейме не валиден ни один сектор: старые данные не прочитают и не запишут в файл
+        release_exclusive_frame(page, 1);
+        return frame;
+    }
+}
+
+// Грузим разом все отсутствующие страницы из offsets (по возрастанию): ставим их на загрузку,
+// подряд идущие собираем в запросы и отдаем все запросы одной пачкой. С io_uring запросы режем
+// помельче, чтобы ядро читало их параллельно, без него каждый непрерывный кусок - один preadv.
+// missed - страница, на которой промахнулись, остальные считаем загруженными наперед.
+// Страниц не больше READ_BATCH_MAX_PAGES
+void load_page_list(const FileDescriptor &fileDesc, const off_t *offsets, size_t pages, off_t missed) {
+    std::array<int32_t, READ_BATCH_MAX_PAGES> frames;
+    std::array<struct iovec, READ_BATCH_MAX_PAGES> iov;
+    std::array<IoRequest, READ_BATCH_MAX_PAGES> requests;
+    size_t request_pages = ioUringEnabled ? std::max<size_t>(IO_REQUEST_BYTES / pageSize, 1) : IOV_MAX;
+    size_t count = 0, request_count = 0;
+    for (size_t i = 0; i < pages; i++) {
+        PageKey key = {fileDesc.dev, fileDesc.inode, offsets[i]};
+        // Уже лежащую в кэше страницу пропускаем, не вытесняя ради нее фрейм
+        if (cacheIndex->find_unlocked(key, cacheSize) != NO_FRAME) {
+            continue;
+        }
+        int32_t frame = install_loading_frame(fileDesc.file, key, no_reuse(fileDesc));
+        if (frame == NO_FRAME) {
+            continue;
+        }
+        // Фреймов не осталось - читаем то, что уже поставили
+        if (frame == NO_VICTIM) {
+            break;
+        }
+        // Страница из холодного яруса готова сразу, в запросы к диску она не идет
+        if (take_cold_page(key, frame, true)) {
+            if (key.offset != missed) {
+                count_stat(STAT_READAHEAD_PAGES);
+            }
+            usedBits->clear(frame, std::memory_order_relaxed);
+            release_exclusive_frame(cachePages[frame], 0);
+            continue;
+        }
+        frames[count] = frame;
+        iov[count] = {frame_data(frame), pageSize};
+        IoRequest *last = request_count ? &requests[request_count - 1] : nullptr;
+        if (last && last->offset + static_cast<off_t>(last->iovcnt * pageSize) == key.offset &&
+            static_cast<size_t>(last->iovcnt) < request_pages) {
+            last->iovcnt++;
+        } else {
+            requests[request_count++] = {fileDesc.fd, &iov[count], 1, key.offset, false, 0, 0};
+        }
+        count++;
+    }
+    if (count == 0) {
+        return;
+    }
+
+    submit_io(requests.data(), request_count);
+    size_t index = 0;
+    for (size_t r = 0; r < request_count; r++) {
+        const IoRequest &request = requests[r];
+        if (request.result == -1) {
+            errno = request.error;
+            perror("Failed to read pages from disk");
+        }
+        for (int i = 0; i < request.iovcnt; i++, index++) {
+            ssize_t page_bytes = std::min<ssize_t>(request.result - static_cast<ssize_t>(i * pageSize), pageSize);
+            if (page_bytes <= 0) {
+                drop_loading_frame(frames[index]);
+                continue;
+            }
+            memset(frame_data(frames[index]) + page_bytes, 0, pageSize - page_bytes);
+            CachePage &page = cachePages[frames[index]];
+            page.length = page_bytes;
+            set_sectors(validSectors, frames[index], 0, pageSectors);
+            count_stat(STAT_DISK_BYTES_READ, page_bytes);
+            if (request.offset + static_cast<off_t>(i * pageSize) != missed) {
+                count_stat(STAT_READAHEAD_PAGES);
+            }
+            // Страницу еще никто не читал - пусть клок заберет ее первой, если до нее так и не дойдут
+            usedBits->clear(frames[index], std::memory_order_relaxed);
+            release_exclusive_frame(page, 0);
+        }
+    }
+}
+
+// Кусок [offset, offset + pages), промахнулись на первой его странице
+void load_pages(const FileDescriptor &fileDesc, off_t offset, size_t pages) {
+    std::array<off_t, READ_BATCH_MAX_PAGES> offsets;
+    for (size_t i = 0; i < pages; i++) {
+        offsets[i] = offset + static_cast<off_t>(i * pageSize);
+    }
+    load_page_list(fileDesc, offsets.data(), pages, offset);
+}
+
+// Трасса доступа в LAB2_TRACE_DIR: имя - хэш пути файла (FNV-1a), сам путь в первой строке,
+// формат в access-trace.h. false, если имя не влезло в PATH_MAX
+bool trace_file_path(const char *path, char *trace_path) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (const char *c = path; *c; c++) {
+        hash = (hash ^ static_cast<unsigned char>(*c)) * 0x100000001B3ULL;
+    }
+    int length = snprintf(trace_path, PATH_MAX, "%s/%016llx.trace", traceDir, static_cast<unsigned long long>(hash));
+    return length > 0 && length < PATH_MAX;
+}
+
+void trace_header(const char *path, char *header, size_t size) {
+    snprintf(header, size, "%s%s\n", ACCESS_TRACE_HEADER, path);
+}
+
+// Страницы из трассы прошлого запуска по порядку. Пусто, если трассы нет или она от другого пути.
+// Инод не сверяем: файл могли пересоздать между запусками, а читают его так же
+std::vector<off_t> read_access_trace(const char *path) {
+    std::vector<off_t> pages;
+    char trace_path[PATH_MAX];
+    FILE *trace = trace_file_path(path, trace_path) ? fopen(trace_path, "re") : nullptr;
+    if (!trace) {
+        return pages;
+    }
+    char line[ACCESS_TRACE_LINE_MAX], header[ACCESS_TRACE_LINE_MAX];
+    trace_header(path, header, sizeof(header));
+    AccessTraceInfo info;
+    std::vector<uint64_t> recorded;
+    bool ours = fgets(line, sizeof(line), trace) && strcmp(line, header) == 0 &&
+                read_trace_pages(trace, info, recorded);
+    fclose(trace);
+    for (size_t i = 0; ours && i < recorded.size(); i++) {
+        // Трассу могли записать с другим размером страницы
+        auto offset = static_cast<off_t>(recorded[i] * info.pageSize);
+        off_t page = offset / static_cast<off_t>(pageSize) * static_cast<off_t>(pageSize);
+        if (offset >= 0 && (pages.empty() || pages.back() != page)) {
+            pages.push_back(page);
+        }
+    }
+    return pages;
+}
+
+// Трассу пишем во временный файл и подменяем ей прошлую разом, rename
+void write_access_trace(const FileDescriptor &fileDesc) {
+    const char *path = sharedMemory->files[fileDesc.file].path;
+    char trace_path[PATH_MAX], temporary[PATH_MAX], header[ACCESS_TRACE_LINE_MAX];
+    if (!trace_file_path(path, trace_path) ||
+        snprintf(temporary, sizeof(temporary), "%s.%d", trace_path, getpid()) >= static_cast<int>(sizeof(temporary))) {
+        errno = ENAMETOOLONG;
+        perror("Failed to write access trace");
+        return;
+    }
+    FILE *trace = fopen(temporary, "we");
+    if (!trace) {
+        perror("Failed to write access trace");
+        return;
+    }
+    trace_header(path, header, sizeof(header));
+    fputs(header, trace);
+    format_trace_info(header, sizeof(header), {fileDesc.inode, pageSize, fileDesc.tracePages});
+    fputs(header, trace);
+    bool written = fwrite(fileDesc.trace.data(), 1, fileDesc.trace.size(), trace) == fileDesc.trace.size();
+    if (fclose(trace) != 0 || !written || rename(temporary, trace_path) == -1) {
+        perror("Failed to write access trace");
+        unlink(temporary);
+    }
+}
+
+// Страницы трассы одной пачкой: по возрастанию и без повторов, чтобы соседние ушли одним запросом
+void prewarm_pages(const FileDescriptor &fileDesc, off_t *pages, size_t count) {
+    std::sort(pages, pages + count);
+    count = std::unique(pages, pages + count) - pages;
+    load_page_list(fileDesc, pages, count, -1);
+}
+
+// Держим загруженными PREWARM_WINDOW_PAGES страниц трассы впереди читателя (в маленьком кэше - пачку
+// промахов). Подгружаем, когда запас упал до половины окна, - так пачки выходят крупными, как у упреждающего чтения
+void prewarm_ahead(FileDescriptor &fileDesc) {
+    off_t pages[PREWARM_WINDOW_PAGES];
+    size_t count = 0, window = std::min(PREWARM_WINDOW_PAGES, readBatchPages);
+    pthread_mutex_lock(&fileDesc.traceLock);
+    size_t next = std::max(fileDesc.prewarmNext, fileDesc.pagesRead);
+    if (next < fileDesc.prewarm.size() && next < fileDesc.pagesRead + (window + 1) / 2) {
+        size_t end = std::min(fileDesc.prewarm.size(), fileDesc.pagesRead + window);
+        for (; next < end; next++) {
+            pages[count++] = fileDesc.prewarm[next];
+        }
+        fileDesc.prewarmNext = end;
+    }
+    pthread_mutex_unlock(&fileDesc.traceLock);
+    if (count > 0) {
+        prewarm_pages(fileDesc, pages, count);
+    }
+}
+
+void start_prewarm(FileDescriptor &fileDesc) {
+    fileDesc.prewarm = read_access_trace(sharedMemory->files[fileDesc.file].path);
+    prewarm_ahead(fileDesc);
+}
+
+// Чтение страницы через дескриптор: записываем ее в трассу и двигаем окно прогрева
+void trace_page_read(FileDescriptor &fileDesc, off_t page) {
+    pthread_mutex_lock(&fileDesc.traceLock);
+    bool repeated = fileDesc.lastTracedPage == page;
+    if (!repeated) {
+        fileDesc.lastTracedPage = page;
+        fileDesc.pagesRead++;
+        if (fileDesc.tracePages < TRACE_MAX_PAGES) {
+            append_trace_page(fileDesc.trace, fileDesc.traceLast, static_cast<uint64_t>(page) / pageSize);
+            fileDesc.tracePages++;
+        }
+    }
+    pthread_mutex_unlock(&fileDesc.traceLock);
+    if (!repeated) {
+        prewarm_ahead(fileDesc);
+    }
+}
+
+// Прогрев по трассе прошлого запуска целиком, по порядку, пока страницы занимают не больше половины кэша
+int lab2_prewarm(const char *path) {
+    if (traceDir[0] == '\0') {
+        errno = ENOENT;
+        return -1;
+    }
+    int fd = open_descriptor(path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    FileDescriptor &fileDesc = descriptorTable[fd].desc;
+    std::vector<off_t> pages = read_access_trace(sharedMemory->files[fileDesc.file].path);
+    pages.resize(std::min(pages.size(), std::max<size_t>(cacheSize / 2, 1)));
+    for (size_t first = 0; first < pages.size(); first += readBatchPages) {
+        prewarm_pages(fileDesc, pages.data() + first, std::min(readBatchPages, pages.size() - first));
+    }
+    lab2_close(fd);
+    if (pages.empty()) {
+        errno = ENOENT;
+        return -1;
+    }
+    return 0;
+}
+
+// Промах на чтении: грузим одной пачкой остаток запроса, а при последовательном доступе
+// еще и окно упреждающего чтения, которое растет с каждым промахом. Одна страница читается как раньше.
+// Позиционные вызовы окно не трогают (readahead = false): их зовут из многих потоков разом
+void readahead_on_miss(FileDescriptor &fileDesc, off_t page_aligned_offset, size_t request_pages, bool readahead) {
+    size_t window = readahead && readaheadMaxPages >= 2 ? fileDesc.readaheadPages : 0;
+    if (!readahead && (fileDesc.advice.load(std::memory_order_relaxed) & ADVICE_SEQUENTIAL)) {
+        window = sequential_window();
+    }
+    size_t pages = std::min(std::max(window, request_pages), readBatchPages);
+    if (pages < 2) {
+        return;
+    }
+    load_pages(fileDesc, page_aligned_offset, pages);
+    if (window) {
+        fileDesc.readaheadPages = std::min(window * 2, readaheadMaxPages);
+    }
+}
+
+// Чтение с начала файла или с того места, где закончилось прошлое, считаем последовательным.
+// Иначе окно сбрасываем, пока поток снова не станет последовательным. Совет lab2_fadvise
+// важнее догадок: RANDOM выключает окно, SEQUENTIAL сразу дает самое широкое
+void update_readahead_window(FileDescriptor &fileDesc) {
+    uint32_t advice = fileDesc.advice.load(std::memory_order_relaxed);
+    if (advice & (ADVICE_RANDOM | ADVICE_SEQUENTIAL)) {
+        fileDesc.readaheadPages = advice & ADVICE_SEQUENTIAL ? sequential_window() : 0;
+        return;
+    }
+    bool sequential = fileDesc.cursor == 0 || fileDesc.cursor == fileDesc.lastReadEnd;
+    if (!sequential) {
+        fileDesc.readaheadPages = 0;
+    } else if (fileDesc.readaheadPages == 0) {
+        fileDesc.readaheadPages = std::min(READAHEAD_INITIAL_PAGES, readaheadMaxPages);
+    }
+}
+
+
+L1Slot &l1_slot(const PageKey &key) {
+    return l1Table[hash_page_key(key) & (l1Slots - 1)];
+}
+
+char *l1_data(const L1Slot &slot) {
+    return l1Data + (&slot - l1Table) * pageSize;
+}
+
+// Копируем bytes байт из копии в ячейке L1 с адреса src по словам. Ячейку в это время может
+// перезаписывать другой поток - рваную копию отбросит проверка version
+void load_l1_bytes(char *dst, const char *src, size_t bytes) {
+    auto address = reinterpret_cast<uintptr_t>(src);
+    auto *word = reinterpret_cast<uint64_t *>(address & ~static_cast<uintptr_t>(sizeof(uint64_t) - 1));
+    size_t skip = address % sizeof(uint64_t);
+    while (bytes > 0) {
+        uint64_t value = std::atomic_ref<uint64_t>(*word++).load(std::memory_order_relaxed);
+        size_t chunk = std::min(bytes, sizeof(value) - skip);
+        memcpy(dst, reinterpret_cast<char *>(&value) + skip, chunk);
+        dst += chunk;
+        bytes -= chunk;
+        skip = 0;
+    }
+}
+
+// Копия страницы в ячейку, целыми словами: и ячейка, и фрейм выровнены по странице
+void store_l1_bytes(char *dst, const char *src, size_t bytes) {
+    auto *words = reinterpret_cast<uint64_t *>(dst);
+    for (size_t i = 0; i * sizeof(uint64_t) < bytes; i++) {
+        uint64_t value;
+        memcpy(&value, src + i * sizeof(uint64_t), sizeof(value));
+        std::atomic_ref<uint64_t>(words[i]).store(value, std::memory_order_relaxed);
+    }
+}
+
+// Попадание в L1: общий кэш трогаем, только чтобы сверить seq фрейма, с которого снята копия,
+// и отметить страницу использованной, иначе политика вытеснения сочтет ее холодной
+ssize_t read_l1_page(const PageKey &key, size_t page_offset, char *dst, size_t bytes_to_read) {
+    if (l1Slots == 0) {
+        return -1;
+    }
+    L1Slot &slot = l1_slot(key);
+    uint32_t version = slot.version.load(std::memory_order_acquire);
+    int32_t frame = slot.frame.load(std::memory_order_relaxed);
+    if ((version & 1) || frame < 0 || slot.dev.load(std::memory_order_relaxed) != key.dev ||
+        slot.inode.load(std::memory_order_relaxed) != key.inode ||
+        slot.offset.load(std::memory_order_relaxed) != key.offset ||
+        cachePages[frame].seq.load(std::memory_order_acquire) != slot.frameSeq.load(std::memory_order_relaxed)) {
+        return -1;
+    }
+    uint32_t length = slot.length.load(std::memory_order_relaxed);
+    size_t available = length > page_offset ? length - page_offset : 0;
+    size_t bytes = std::min(bytes_to_read, std::min(available, pageSize - page_offset));
+    load_l1_bytes(dst, l1_data(slot) + page_offset, bytes);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.version.load(std::memory_order_relaxed) != version) {
+        return -1;
+    }
+    usedBits->mark(frame);
+    return static_cast<ssize_t>(bytes);
+}
+
+// Занимаем ячейку L1 под копию. Ячейку уже перезаписывает другой поток - копию не делаем
+L1Slot *begin_l1_fill(const PageKey &key) {
+    if (l1Slots == 0) {
+        return nullptr;
+    }
+    L1Slot &slot = l1_slot(key);
+    uint32_t version = slot.version.load(std::memory_order_relaxed);
+    if ((version & 1) || !slot.version.compare_exchange_strong(version, version + 1, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    return &slot;
+}
+
+// frame = -1: копия вышла рваной, ячейка остается пустой
+void end_l1_fill(L1Slot &slot, const PageKey &key, int32_t frame, uint32_t frame_seq, uint32_t length) {
+    slot.dev.store(key.dev, std::memory_order_relaxed);
+    slot.inode.store(key.inode, std::memory_order_relaxed);
+    slot.offset.store(key.offset, std::memory_order_relaxed);
+    slot.frame.store(frame, std::memory_order_relaxed);
+    slot.frameSeq.store(frame_seq, std::memory_order_relaxed);
+    slot.length.store(length, std::memory_order_relaxed);
+    slot.version.fetch_add(1, std::memory_order_release);
+}
+
+// Попадание без единой блокировки: находим фрейм в индексе, копируем и проверяем, что версия
+// фрейма не поменялась. Возвращает -1, если не вышло - тогда идем обычным путем с закреплением.
+// Страницу, которую читают из общего кэша повторно, копируем еще и в L1; NOREUSE мимо него
+ssize_t read_cache_page_optimistic(const PageKey &key, size_t page_offset, char *dst, size_t bytes_to_read,
+                                   bool noreuse) {
+    for (size_t attempt = 0; attempt < OPTIMISTIC_READ_RETRIES; attempt++) {
+        int32_t frame = cacheIndex->find_unlocked(key, cacheSize);
+        if (frame == NO_FRAME) {
+            return -1;
+        }
+        CachePage &page = cachePages[frame];
+        uint32_t seq = page.seq.load(std::memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+        if (page.dev != key.dev || page.inode != key.inode || page.offset != key.offset) {
+            continue;
+        }
+        // Страницу записали не целиком, а остальное еще не дочитали - дочитает путь с закреплением
+        if (!frame_complete(frame)) {
+            return -1;
+        }
+        uint32_t length = page.length;
+        size_t available = length > page_offset ? length - page_offset : 0;
+        size_t bytes = std::min(bytes_to_read, std::min(available, pageSize - page_offset));
+        memcpy(dst, frame_data(frame) + page_offset, bytes);
+        L1Slot *slot = noreuse ? nullptr : begin_l1_fill(key);
+        if (slot) {
+            length = std::min<uint32_t>(length, pageSize);
+            store_l1_bytes(l1_data(*slot), frame_data(frame), length);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        bool unchanged = page.seq.load(std::memory_order_relaxed) == seq;
+        if (slot) {
+            end_l1_fill(*slot, key, unchanged ? frame : -1, seq, length);
+        }
+        if (unchanged) {
+            if (!noreuse) {
+                usedBits->mark(frame);
+            }
+            return static_cast<ssize_t>(bytes);
+        }
+    }
+    return -1;
+}
+
+
+// Достаем закрепленную страницу с позицией position. request_pages - сколько страниц еще нужно
+// читающему, начиная с этой. Возвращает NO_FRAME на конце файла и NO_VICTIM, если под страницу нет фрейма
+int32_t pin_page_for_read(FileDescriptor &fileDesc, off_t position, size_t &bytes_to_read, size_t request_pages,
+                          bool readahead) {
+    size_t page_offset = position % pageSize;
+    off_t page_aligned_offset = position - static_cast<off_t>(page_offset);
+    PageKey key = {fileDesc.dev, fileDesc.inode, page_aligned_offset};
+    if (cacheIndex->find_unlocked(key, cacheSize) == NO_FRAME) {
+        count_miss(key);
+        readahead_on_miss(fileDesc, page_aligned_offset, request_pages, readahead);
+    } else {
+        count_hit(key);
+    }
+    int32_t frame = get_cache_page(fileDesc, page_aligned_offset, true);
+    if (frame < 0) {
+        return frame;
+    }
+    CachePage &page = cachePages[frame];
+    pthread_mutex_lock(&frame_lock(frame));
+    if (!frame_complete(frame)) {
+        begin_frame_update(page);
+        fill_sectors(fileDesc.fd, frame, 0, pageSectors);
+        end_frame_update(page);
+    }
+    size_t available = page.length > page_offset ? page.length - page_offset : 0;
+    pthread_mutex_unlock(&frame_lock(frame));
+    bytes_to_read = std::min(bytes_to_read, available);
+    return frame;
+}
+
+size_t iov_bytes(const struct iovec *iov, int iovcnt) {
+    size_t bytes = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        bytes += iov[i].iov_len;
+    }
+    return bytes;
+}
+
+// Вектор годится для O_DIRECT мимо кэша: смещение, адреса и длины выровнены по минимальной странице
+bool direct_io_aligned(off_t offset, const struct iovec *iov, int iovcnt) {
+    if (offset % MIN_PAGE_SIZE != 0) {
+        return false;
+    }
+    for (int i = 0; i < iovcnt; i++) {
+        if (reinterpret_cast<uintptr_t>(iov[i].iov_base) % MIN_PAGE_SIZE != 0 || iov[i].iov_len % MIN_PAGE_SIZE != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Буфер пользователя может быть отображением lab2_mmap: первое обращение к его странице обслуживает
+// поток промахов через кэш, под тем же frame_lock. Поэтому трогаем страницы буфера до того, как
+// взять фрейм. В буфер для чтения пишем его же байт - так снимается и защита от записи
+void touch_user_pages(const char *buffer, size_t bytes, bool write) {
+    auto *end = buffer + bytes;
+    for (auto *byte = const_cast<volatile char *>(buffer); byte < end;
+         byte = reinterpret_cast<volatile char *>(align_up(reinterpret_cast<uintptr_t>(byte) + 1, MIN_PAGE_SIZE))) {
+        char value = *byte;
+        if (write) {
+            *byte = value;
+        }
+    }
+}
+
+// Читаем вектор с позиции offset за один проход по кэшу, курсор не трогаем. Первый же промах
+// грузит разом все недостающие страницы вектора. Запрос больше всего кэша читаем мимо него
+// прямо с диска (сначала скинув грязные страницы файла), если O_DIRECT его примет
+ssize_t read_at(FileDescriptor &fileDesc, off_t offset, const struct iovec *iov, int iovcnt, bool readahead) {
+    size_t count = iov_bytes(iov, iovcnt);
+    if (count > cacheSize * pageSize && direct_io_aligned(offset, iov, iovcnt)) {
+        if (flush_file_pages(writeback_fd(fileDesc), fileDesc.file, false) == -1) {
+            return -1;
+        }
+        // Мимо кэша: для гистограмм это промах
+        threadMisses++;
+        int64_t start = monotonic_ns();
+        ssize_t bytes_from_file = preadv(fileDesc.fd, iov, iovcnt, offset);
+        record_latency(LAB2_LATENCY_DISK_IO, monotonic_ns() - start);
+        if (bytes_from_file > 0) {
+            count_stat(STAT_BYTES_READ, bytes_from_file);
+            count_stat(STAT_DISK_BYTES_READ, bytes_from_file);
+        }
+        return bytes_from_file;
+    }
+
+    size_t bytes_read_total = 0;
+    off_t position = offset;
+    bool noreuse = no_reuse(fileDesc);
+    for (int segment = 0; segment < iovcnt; segment++) {
+        char *segment_data = static_cast<char *>(iov[segment].iov_base);
+        size_t segment_read = 0;
+        while (segment_read < iov[segment].iov_len) {
+            off_t page_aligned_offset = position / pageSize * pageSize;
+            size_t page_offset = position % pageSize;
+            size_t wanted = std::min(pageSize - page_offset, iov[segment].iov_len - segment_read);
+            size_t bytes_to_read = wanted;
+            char *dst = segment_data + segment_read;
+            if (traceDir[0] != '\0') {
+                trace_page_read(fileDesc, page_aligned_offset);
+            }
+
+            // Попадание копируем сразу в буфер пользователя, сначала ищем в L1, потом в общем кэше.
+            // Промах грузим прямо во фрейм
+            PageKey key = {fileDesc.dev, fileDesc.inode, page_aligned_offset};
+            ssize_t bytes_from_cache = noreuse ? -1 : read_l1_page(key, page_offset, dst, bytes_to_read);
+            if (bytes_from_cache >= 0) {
+                count_stat(STAT_L1_HITS);
+            } else {
+                threadSharedReads++;
+                bytes_from_cache = read_cache_page_optimistic(key, page_offset, dst, bytes_to_read, noreuse);
+            }
+            if (bytes_from_cache >= 0) {
+                bytes_to_read = bytes_from_cache;
+                count_hit(key);
+            } else {
+                size_t request_pages = (page_offset + count - bytes_read_total + pageSize - 1) / pageSize;
+                touch_user_pages(dst, bytes_to_read, true);
+                int32_t frame = pin_page_for_read(fileDesc, position, bytes_to_read, request_pages, readahead);
+                if (frame < 0) {
+                    count_stat(STAT_BYTES_READ, bytes_read_total);
+                    return frame == NO_VICTIM && bytes_read_total == 0 ? -1 : static_cast<ssize_t>(bytes_read_total);
+                }
+                pthread_mutex_lock(&frame_lock(frame));
+                memcpy(dst, frame_data(frame) + page_offset, bytes_to_read);
+                pthread_mutex_unlock(&frame_lock(frame));
+                unpin_frame(cachePages[frame]);
+            }
+
+            bytes_read_total += bytes_to_read;
+            segment_read += bytes_to_read;
+            position += static_cast<off_t>(bytes_to_read);
+            if (noreuse && page_offset + bytes_to_read == pageSize) {
+                drop_behind(fileDesc, page_aligned_offset);
+            }
+            // Страница кончилась раньше, чем просили - дошли до конца файла
+            if (bytes_to_read < wanted) {
+                count_stat(STAT_BYTES_READ, bytes_read_total);
+                return bytes_read_total;
+            }
+        }
+    }
+    count_stat(STAT_BYTES_READ, bytes_read_total);
+    return bytes_read_total;
+}
+
+// Пишем вектор с позиции offset через кэш, курсор не трогаем
+ssize_t write_at(FileDescriptor &fileDesc, off_t offset, const struct iovec *iov, int iovcnt) {
+    size_t bytes_written = 0;
+    off_t position = offset;
+    for (int segment = 0; segment < iovcnt; segment++) {
+        const char *buffer = static_cast<const char *>(iov[segment].iov_base);
+        size_t segment_written = 0;
+        while (segment_written < iov[segment].iov_len) {
+            off_t page_aligned_offset = position / pageSize * pageSize;
+            size_t page_offset = position % pageSize;
+            size_t bytes_to_write = std::min(pageSize - page_offset, iov[segment].iov_len - segment_written);
+
+            // если страница нашлась, то пишем туды, если нет - подрубаем клок и вытесняем.
+            // Страницу целиком не читаем: дочитываем только блоки на краях записи, которые она
+            // задевает не полностью, остальное дочитает тот, кто будет страницу читать
+            size_t end_offset = page_offset + bytes_to_write;
+            touch_user_pages(buffer + segment_written, bytes_to_write, false);
+            PageKey key = {fileDesc.dev, fileDesc.inode, page_aligned_offset};
+            if (cacheIndex->find_unlocked(key, cacheSize) != NO_FRAME) {
+                count_hit(key);
+            } else {
+                count_miss(key);
+            }
+            int32_t frame = get_cache_page(fileDesc, page_aligned_offset, false);
+            if (frame == NO_VICTIM) {
+                count_stat(STAT_BYTES_WRITTEN, bytes_written);
+                return bytes_written > 0 ? static_cast<ssize_t>(bytes_written) : -1;
+            }
+            CachePage &page = cachePages[frame];
+            size_t unit_bytes = io_sectors(frame) * SECTOR_SIZE;
+
+            // и отмечаем ее как очень грязную
+            pthread_mutex_lock(&frame_lock(frame));
+            begin_frame_update(page);
+            if (page_offset % unit_bytes != 0) {
+                fill_sectors(fileDesc.readFd, frame, page_offset / SECTOR_SIZE, page_offset / SECTOR_SIZE + 1);
+            }
+            if (end_offset % unit_bytes != 0) {
+                fill_sectors(fileDesc.readFd, frame, (end_offset - 1) / SECTOR_SIZE,
+                             (end_offset - 1) / SECTOR_SIZE + 1);
+            }
+            grow_file_size(fileDesc.file, page_aligned_offset + static_cast<off_t>(end_offset));
+            memcpy(frame_data(frame) + page_offset, buffer + segment_written, bytes_to_write);
+            page.length = std::max<uint32_t>(page.length, end_offset);
+            size_t first_sector = page_offset / SECTOR_SIZE;
+            size_t last_sector = (end_offset + SECTOR_SIZE - 1) / SECTOR_SIZE;
+            set_sectors(validSectors, frame, first_sector, last_sector);
+            set_sectors(dirtySectors, frame, first_sector, last_sector);
+            mark_page_dirty(frame);
+            end_frame_update(page);
+            pthread_mutex_unlock(&frame_lock(frame));
+            unpin_frame(page);
+
+            position += static_cast<off_t>(bytes_to_write);
+            segment_written += bytes_to_write;
+            bytes_written += bytes_to_write;
+        }
+    }
+    count_stat(STAT_BYTES_WRITTEN, bytes_written);
+    return bytes_written;
+}
+
+// Проверяем аргументы позиционных вызовов так же, как их проверяет ядро
+bool valid_io_arguments(off_t offset, const struct iovec *iov, int iovcnt) {
+    if (offset < 0 || iovcnt < 0 || iovcnt > IOV_MAX || (iovcnt > 0 && iov == nullptr)) {
+        errno = EINVAL;
+        return false;
+    }
+    return true;
+}
+
+ssize_t lab2_read(int fd, void *buf, size_t count) {
+    LatencyTimer timer(LAB2_LATENCY_READ_HIT, LAB2_LATENCY_READ_MISS, LAB2_LATENCY_READ_L1);
+    DescriptorRef ref(fd);
+    if (!ref.desc) {
+        return -1;
+    }
+    FileDescriptor &fileDesc = *ref.desc;
+    lock_cursor(descriptorTable[fd].cursorLock);
+    update_readahead_window(fileDesc);
+    struct iovec iov = {buf, count};
+    ssize_t bytes_read = read_at(fileDesc, fileDesc.cursor, &iov, 1, true);
+    if (bytes_read > 0) {
+        fileDesc.cursor += bytes_read;
+    }
+    fileDesc.lastReadEnd = fileDesc.cursor;
+    pthread_mutex_unlock(&descriptorTable[fd].cursorLock);
+    return bytes_read;
+}
+
+ssize_t lab2_pread(int fd, void *buf, size_t count, off_t offset) {
+    struct iovec iov = {buf, count};
+    return lab2_preadv(fd, &iov, 1, offset);
+}
+
+ssize_t lab2_preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+    LatencyTimer timer(LAB2_LATENCY_READ_HIT, LAB2_LATENCY_READ_MISS, LAB2_LATENCY_READ_L1);
+    DescriptorRef ref(fd);
+    if (!ref.desc || !valid_io_arguments(offset, iov, iovcnt)) {
+        return -1;
+    }
+    return read_at(*ref.desc, offset, iov, iovcnt, false);
+}
+
+
+// Чтение без копирования: отдаем указатель прямо в закрепленную страницу кэша
+ssize_t lab2_read_view(int fd, size_t count, lab2_view *view) {
+    view->data = nullptr;
+    view->length = 0;
+    view->frame = NO_FRAME;
+    LatencyTimer timer(LAB2_LATENCY_READ_HIT, LAB2_LATENCY_READ_MISS);
+    DescriptorRef ref(fd);
+    if (!ref.desc) {
+        return -1;
+    }
+    FileDescriptor &fileDesc = *ref.desc;
+    lock_cursor(descriptorTable[fd].cursorLock);
+    update_readahead_window(fileDesc);
+    // Страница позади курсора дочитана; при NOREUSE выкидываем ее, если view на нее уже отпустили
+    if (no_reuse(fileDesc) && fileDesc.cursor >= static_cast<off_t>(pageSize) && fileDesc.cursor % pageSize == 0) {
+        drop_behind(fileDesc, fileDesc.cursor - static_cast<off_t>(pageSize));
+    }
+
+    size_t page_offset = fileDesc.cursor % pageSize;
+    size_t bytes_to_read = std::min(pageSize - page_offset, count);
+    if (traceDir[0] != '\0') {
+        trace_page_read(fileDesc, fileDesc.cursor - static_cast<off_t>(page_offset));
+    }
+    int32_t frame = pin_page_for_read(fileDesc, fileDesc.cursor, bytes_to_read, 1, true);
+    if (frame >= 0 && bytes_to_read == 0) {
+        unpin_frame(cachePages[frame]);
+        frame = NO_FRAME;
+    }
+    if (frame >= 0) {
+        view->data = frame_data(frame) + page_offset;
+        view->length = bytes_to_read;
+        view->frame = frame;
+        count_stat(STAT_BYTES_READ, bytes_to_read);
+        fileDesc.cursor += bytes_to_read;
+        fileDesc.lastReadEnd = fileDesc.cursor;
+    }
+    pthread_mutex_unlock(&descriptorTable[fd].cursorLock);
+    return frame == NO_VICTIM ? -1 : static_cast<ssize_t>(view->length);
+}
+
+void lab2_unpin_view(lab2_view *view) {
+    if (view->frame != NO_FRAME) {
+        unpin_frame(cachePages[view->frame]);
+    }
+    view->data = nullptr;
+    view->length = 0;
+    view->frame = NO_FRAME;
+}
+
+
+ssize_t lab2_write(int fd, const void *buf, size_t size) {
+    LatencyTimer timer(LAB2_LATENCY_WRITE_HIT, LAB2_LATENCY_WRITE_MISS);
+    DescriptorRef ref(fd);
+    if (!ref.desc) {
+        return -1;
+    }
+    FileDescriptor &fileDesc = *ref.desc;
+    lock_cursor(descriptorTable[fd].cursorLock);
+    struct iovec iov = {const_cast<void *>(buf), size};
+    ssize_t bytes_written = write_at(fileDesc, fileDesc.cursor, &iov, 1);
+    if (bytes_written > 0) {
+        fileDesc.cursor += bytes_written;
+    }
+    pthread_mutex_unlock(&descriptorTable[fd].cursorLock);
+    return bytes_written;
+}
+
+ssize_t lab2_pwrite(int fd, const void *buf, size_t count, off_t offset) {
+    struct iovec iov = {const_cast<void *>(buf), count};
+    return lab2_pwritev(fd, &iov, 1, offset);
+}
+
+ssize_t lab2_pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+    LatencyTimer timer(LAB2_LATENCY_WRITE_HIT, LAB2_LATENCY_WRITE_MISS);
+    DescriptorRef ref(fd);
+    if (!ref.desc || !valid_io_arguments(offset, iov, iovcnt)) {
+        return -1;
+    }
+    return write_at(*ref.desc, offset, iov, iovcnt);
+}
+
+
+// Грязная страница файла, закрепленная на время записи
+struct DirtyPage {
+    int32_t file;
+    off_t offset;
+    int32_t frame;
+};
+
+// Грязный кусок одной из страниц пачки
+struct DirtyRun {
+    size_t page;                // Index in the sorted dirty pages
+    SectorRun sectors;
+};
+
+// Сортируем собранные страницы по файлу и смещению и снимаем с них грязные куски. Куски, которые
+// идут в файле подряд (в том числе через границу страниц), пишем одним запросом pwritev прямо
+// из выровненных фреймов, все запросы - одной пачкой, потом открепляем. Неудачный кусок снова грязный,
+// а вызов вернет -1 с его ошибкой
+// fd = -1 - страницы разных файлов, дескриптор берем через get_writeback_fd
+int write_dirty_pages(std::vector<DirtyPage> &dirty_pages, int fd) {
+    std::sort(dirty_pages.begin(), dirty_pages.end(), [](const DirtyPage &a, const DirtyPage &b) {
+        return a.file != b.file ? a.file < b.file : a.offset < b.offset;
+    });
+    std::vector<DirtyRun> runs;
+    for (size_t i = 0; i < dirty_pages.size(); i++) {
+        for (const SectorRun &sectors: take_dirty_runs(dirty_pages[i].frame)) {
+            runs.push_back({i, sectors});
+        }
+    }
+    std::vector<struct iovec> iov(runs.size());
+    std::vector<IoRequest> requests;
+    std::vector<size_t> request_bytes;
+    for (size_t r = 0; r < runs.size(); r++) {
+        const DirtyPage &page = dirty_pages[runs[r].page];
+        size_t start = runs[r].sectors.first * SECTOR_SIZE;
+        size_t bytes = (runs[r].sectors.last - runs[r].sectors.first) * SECTOR_SIZE;
+        off_t offset = page.offset + static_cast<off_t>(start);
+        iov[r] = {frame_data(page.frame) + start, bytes};
+        IoRequest *last = requests.empty() ? nullptr : &requests.back();
+        if (last && dirty_pages[runs[r - 1].page].file == page.file && last->iovcnt < IOV_MAX &&
+            last->offset + static_cast<off_t>(request_bytes.back()) == offset) {
+            last->iovcnt++;
+            request_bytes.back() += bytes;
+            continue;
+        }
+        int run_fd = fd != -1 ? fd : get_writeback_fd(page.file);
+        // Файл не удалось переоткрыть (run_fd = -1) - запрос просто вернет EBADF
+        requests.push_back({run_fd, &iov[r], 1, offset, true, 0, 0});
+        request_bytes.push_back(bytes);
+    }
+
+    submit_io(requests.data(), requests.size());
+    int result = 0, error = 0;
+    size_t r = 0;
+    for (size_t q = 0; q < requests.size(); q++) {
+        const IoRequest &request = requests[q];
+        if (request.result != static_cast<ssize_t>(request_bytes[q])) {
+            // Короткая запись ошибки не дает, ее причину ядро вернуло бы на следующей
+            error = request.result < 0 ? request.error : EIO;
+            errno = error;
+            perror("Failed to write pages to disk");
+            for (int i = 0; i < request.iovcnt; i++, r++) {
+                restore_dirty_run(dirty_pages[runs[r].page].frame, runs[r].sectors);
+            }
+            result = -1;
+            continue;
+        }
+        const CachePage &first = cachePages[dirty_pages[runs[r].page].frame];
+        LAB2_PROBE4(writeback, first.dev, first.inode, request.offset, request.result);
+        count_stat(STAT_DISK_BYTES_WRITTEN, request.result);
+        trim_file_tail(request.fd, dirty_pages[runs[r].page].file, request.offset + request.result);
+        for (int i = 0; i < request.iovcnt; i++, r++) {
+            // Страница записана, когда записан ее первый кусок
+            if (r == 0 || runs[r - 1].page != runs[r].page) {
+                count_stat(STAT_WRITEBACK_PAGES);
+            }
+        }
+    }
+    for (const DirtyPage &dirty_page: dirty_pages) {
+        unpin_frame(cachePages[dirty_page.frame]);
+    }
+    errno = result == -1 ? error : errno;
+    return result;
+}
+
+// Скидываем грязные страницы файла со смещениями из [start, end), проходя только по его списку фреймов.
+// Фреймы, которые сейчас грузятся или вытесняются, дожидаемся. Пока ждали, фрейм мог
+// достаться другому файлу, поэтому после закрепления проверяем тег еще раз
+int flush_file_pages(int fd, int32_t file, bool mark_unused, off_t start, off_t end) {
+    std::vector<DirtyPage> dirty_pages;
+    for (int32_t i: get_file_pages(file)) {
+        CachePage &page = cachePages[i];
+        while (!try_pin_frame(page)) {
+            wait_frame(page, page.state.load(std::memory_order_acquire) | FRAME_EXCLUSIVE);
+        }
+        if (page.file == file && page.offset >= start && page.offset < end) {
+            if (mark_unused) {
+                usedBits->clear(i, std::memory_order_relaxed);
+            }
+            if (clean_page(i)) {
+                dirty_pages.push_back({page.file, page.offset, i});
+                continue;
+            }
+        }
+        unpin_frame(page);
+    }
+    return write_dirty_pages(dirty_pages, fd);
+}
+
+
+// Один проход фонового сброса. Если грязных больше верхней границы, сбрасываем до половины
+// границы; кроме того сбрасываем все, что грязное дольше dirtyExpireMs
+void background_writeback() {
+    size_t dirty = sharedMemory->dirtyCount.load(std::memory_order_relaxed);
+    size_t high_watermark = cacheSize * dirtyRatioPercent / 100;
+    size_t to_flush = dirty > high_watermark ? dirty - high_watermark / 2 : 0;
+    if (sharedMemory->flushRequested.exchange(false, std::memory_order_relaxed)) {
+        to_flush = std::max(to_flush, FLUSH_BATCH_PAGES);
+    }
+    int64_t expired = monotonic_ms() - dirtyExpireMs;
+
+    // Идем по битмапу грязных: чистые фреймы пропускаем по 64 за раз, не трогая их метаданные
+    std::vector<DirtyPage> dirty_pages;
+    for (size_t word = 0; word < dirtyBits->wordCount; word++) {
+        uint64_t dirty_word = dirtyBits->words()[word].load(std::memory_order_relaxed);
+        for (; dirty_word != 0; dirty_word &= dirty_word - 1) {
+            auto frame = static_cast<int32_t>(word * FrameBitmap::BITS + __builtin_ctzll(dirty_word));
+            CachePage &page = cachePages[frame];
+            if (dirty_pages.size() >= to_flush && page.dirtySince.load(std::memory_order_relaxed) > expired) {
+                continue;
+            }
+            if (!try_pin_frame(page)) {
+                continue;
+            }
+            if (page.file != -1 && clean_page(frame)) {
+                dirty_pages.push_back({page.file, page.offset, frame});
+            } else {
+                unpin_frame(page);
+            }
+        }
+    }
+    write_dirty_pages(dirty_pages, -1);
+}
+
+// Поток флашера. Проходы делает только один процесс за раз - тот, кто взял flusherLock
+void *flusher_main(void *) {
+    pthread_mutex_lock(&flusherMutex);
+    while (!flusherStop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += FLUSH_INTERVAL_MS * 1000000;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        pthread_cond_timedwait(&flusherCond, &flusherMutex, &deadline);
+        if (flusherStop) {
+            break;
+        }
+        pthread_mutex_unlock(&flusherMutex);
+
+        int locked = pthread_mutex_trylock(&sharedMemory->flusherLock);
+        if (locked == EOWNERDEAD) {
+            pthread_mutex_consistent(&sharedMemory->flusherLock);
+            locked = 0;
+        }
+        if (locked == 0) {
+            background_writeback();
+            pthread_mutex_unlock(&sharedMemory->flusherLock);
+        }
+        pthread_mutex_lock(&flusherMutex);
+    }
+    pthread_mutex_unlock(&flusherMutex);
+    return nullptr;
+}
+
+void start_flusher() {
+    if (!flusherEnabled || flusherStarted) {
+        return;
+    }
+    flusherStop = false;
+    if (pthread_create(&flusherThread, nullptr, flusher_main, nullptr) != 0) {
+        perror("Failed to start write-back flusher");
+        return;
+    }
+    flusherStarted = true;
+}
+
+void stop_flusher() {
+    if (!flusherStarted) {
+        return;
+    }
+    pthread_mutex_lock(&flusherMutex);
+    flusherStop = true;
+    pthread_cond_signal(&flusherCond);
+    pthread_mutex_unlock(&flusherMutex);
+    pthread_join(flusherThread, nullptr);
+    flusherStarted = false;
+}
+
+
+int lab2_close(int fd) {
+    LatencyTimer timer(LAB2_LATENCY_CLOSE);
+    if (fd < 0 || fd >= MAX_FILE_DESCRIPTORS) {
+        errno = EBADF;
+        return -1;
+    }
+    DescriptorSlot &slot = descriptorTable[fd];
+    uint32_t state = slot.state.load(std::memory_order_relaxed);
+    do {
+        if (!(state & DESCRIPTOR_OPEN)) {
+            errno = EBADF;
+            return -1;
+        }
+    } while (!slot.state.compare_exchange_weak(state, (state & ~DESCRIPTOR_OPEN) | DESCRIPTOR_CLOSING,
+                                               std::memory_order_acq_rel));
+    // Новые вызовы дескриптор уже не возьмут, дожидаемся тех, что успели
+    while (slot.state.load(std::memory_order_acquire) != DESCRIPTOR_CLOSING) {
+        sched_yield();
+    }
+    FileDescriptor &fileDesc = slot.desc;
+    // Не записалось - как close(2) после неудачной отложенной записи: дескриптор закрыт, но -1
+    int flush_result = flush_file_pages(writeback_fd(fileDesc), fileDesc.file, true);
+    int flush_errno = errno;
+    if (!fileDesc.trace.empty()) {
+        write_access_trace(fileDesc);
+    }
+    std::vector<uint8_t>().swap(fileDesc.trace);
+    std::vector<off_t>().swap(fileDesc.prewarm);
+    pthread_mutex_destroy(&fileDesc.traceLock);
+    if (fileDesc.readFd != fd && fileDesc.readFd != -1) {
+        close(fileDesc.readFd);
+    }
+    // Последний дескриптор файла закрыт, грязных страниц нет: для кэша в файле запоминаем, каким был файл
+    if (sharedMemory->files[fileDesc.file].openCount.fetch_sub(1) == 1 && cacheFileFd != -1) {
+        snapshot_shared_file(fileDesc.file);
+    }
+    pthread_mutex_destroy(&slot.cursorLock);
+    slot.state.fetch_and(~DESCRIPTOR_CLOSING, std::memory_order_release);
+    if (close(fd) == -1 || flush_result == -1) {
+        errno = flush_result == -1 ? flush_errno : errno;
+        return -1;
+    }
+    return 0;
+}
+
+
+off_t lab2_lseek(int fd, off_t offset, int whence) {
+    DescriptorRef ref(fd);
+    if (!ref.desc) {
+        return -1;
+    }
+    FileDescriptor &fileDesc = *ref.desc;
+    lock_cursor(descriptorTable[fd].cursorLock);
+    off_t new_offset;
+    switch (whence) {
+        case SEEK_SET:
+            new_offset = offset;
+            break;
+        case SEEK_CUR:
+            new_offset = fileDesc.cursor + offset;
+            break;
+        case SEEK_END:
+            new_offset = sharedMemory->files[fileDesc.file].size.load(std::memory_order_acquire) + offset;
+            break;
+        default:
+            new_offset = -1;
+            break;
+    }
+    if (new_offset >= 0) {
+        fileDesc.cursor = new_offset;
+    }
+    pthread_mutex_unlock(&descriptorTable[fd].cursorLock);
+
+    if (new_offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    return new_offset;
+}
+
+
+// Эпоха a не раньше эпохи b. Счетчики 32-битные под фьютекс, поэтому сравниваем через разность
+bool commit_reached(uint32_t a, uint32_t b) {
+    return static_cast<int32_t>(a - b) >= 0;
+}
+
+// Сбрасываем все грязные страницы файла, чьи бы они ни были, и делаем fsync
+int sync_file(const FileDescriptor &fileDesc) {
+    if (flush_file_pages(writeback_fd(fileDesc), fileDesc.file, false) == -1) {
+        return -1;
+    }
+    int64_t start = monotonic_ns();
+    int result = fsync(fileDesc.fd);
+    record_latency(LAB2_LATENCY_DISK_IO, monotonic_ns() - start);
+    count_stat(STAT_DEVICE_FLUSHES);
+    return result;
+}
+
+// Один групповой коммит. Эпоху берем до сброса, так что она покрывает все записи,
+// закончившиеся до того, как ее начали
+void run_group_commit(const FileDescriptor &fileDesc, SharedFile &file) {
+    uint32_t epoch = file.commitStarted.fetch_add(1) + 1;
+    if (sync_file(fileDesc) == -1) {
+        file.commitErrno = errno;
+        file.commitFailed = epoch;
+    }
+    file.commitDone.store(epoch, std::memory_order_release);
+    file.commitLeader.store(0, std::memory_order_release);
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&file.commitDone), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+// Групповой коммит: одновременные fsync файла из всех процессов ждут одну эпоху сброса и fsync.
+// Нам годится эпоха, начатая после нашего прихода: уже идущая могла собрать страницы до наших записей.
+// Никто не ведет - ведем сами, иначе спим на commitDone. Ведущий умер посреди эпохи - ее подхватывает
+// следующий, поэтому спим с таймаутом
+int lab2_fsync(int fd) {
+    LatencyTimer timer(LAB2_LATENCY_FSYNC);
+    DescriptorRef ref(fd);
+    if (!ref.desc) {
+        return -1;
+    }
+    // Записанное через lab2_mmap этого процесса сначала отдаем в кэш
+    if (sync_file_mappings(ref.desc->file) == -1) {
+        return -1;
+    }
+    if (!groupCommit) {
+        return sync_file(*ref.desc);
+    }
+    SharedFile &file = sharedMemory->files[ref.desc->file];
+    uint32_t target = file.commitStarted.load() + 1;
+    uint32_t done;
+    for (;;) {
+        done = file.commitDone.load(std::memory_order_acquire);
+        if (commit_reached(done, target)) {
+            break;
+        }
+        pid_t leader = file.commitLeader.load(std::memory_order_acquire);
+        if (leader == 0 || (kill(leader, 0) == -1 && errno == ESRCH)) {
+            if (file.commitLeader.compare_exchange_strong(leader, getpid())) {
+                run_group_commit(*ref.desc, file);
+            }
+            continue;
+        }
+        struct timespec timeout = {0, COMMIT_WAIT_NS};
+        int64_t start = monotonic_ns();
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&file.commitDone), FUTEX_WAIT, done, &timeout, nullptr, 0);
+        count_stat(STAT_LOCK_WAIT_NS, monotonic_ns() - start);
+    }
+    uint32_t failed = file.commitFailed;
+    if (commit_reached(failed, target) && commit_reached(done, failed)) {
+        errno = file.commitErrno;
+        return -1;
+    }
+    return 0;
+}
+
+
+// WILLNEED: грузим страницы [start, end) пачками, как промах с упреждающим чтением. Дальше конца
+// файла не идем, и больше половины кэша не берем, иначе начало диапазона вытеснил бы его же конец
+int prefetch_file_pages(const FileDescriptor &fileDesc, off_t start, off_t end) {
+    struct stat file_stat;
+    if (fstat(fileDesc.fd, &file_stat) == -1) {
+        return -1;
+    }
+    end = std::min<off_t>(end, file_stat.st_size);
+    off_t position = start / static_cast<off_t>(pageSize) * static_cast<off_t>(pageSize);
+    size_t budget = std::max<size_t>(cacheSize / 2, 1);
+    while (position < end && budget > 0) {
+        size_t pages = std::min({(static_cast<size_t>(end - position) + pageSize - 1) / pageSize,
+                                 readBatchPages, budget});
+        load_pages(fileDesc, position, pages);
+        position += static_cast<off_t>(pages * pageSize);
+        budget -= pages;
+    }
+    return 0;
+}
+
+// DONTNEED: выкидываем чистые страницы файла из [start, end), которых никто не держит, сразу
+// отдавая фреймы под новые страницы. Закрепленные и испачканные заново после сброса остаются
+void evict_file_pages(int32_t file, off_t start, off_t end) {
+    drop_cold_pages(sharedMemory->files[file].dev, sharedMemory->files[file].inode, start, end);
+    for (int32_t frame: get_file_pages(file)) {
+        CachePage &page = cachePages[frame];
+        uint32_t expected = 0;
+        if (!page.state.compare_exchange_strong(expected, FRAME_EXCLUSIVE, std::memory_order_acquire)) {
+            continue;
+        }
+        begin_frame_update(page);
+        if (page.file != file || page.offset < start || page.offset >= end || dirtyBits->test(frame)) {
+            release_exclusive_frame(page, 0);
+            continue;
+        }
+        drop_exclusive_frame(frame);
+    }
+}
+
+// Меняем флаги совета атомарно: на дескрипторе в это время могут читать другие потоки
+void update_advice(FileDescriptor &fileDesc, uint32_t clear, uint32_t set) {
+    uint32_t advice = fileDesc.advice.load(std::memory_order_relaxed);
+    while (!fileDesc.advice.compare_exchange_weak(advice, (advice & ~clear) | set, std::memory_order_relaxed)) {
+    }
+}
+
+// Советы про весь дескриптор (NORMAL, SEQUENTIAL, RANDOM, NOREUSE) сочетаются так же, как в ядре:
+// NORMAL снимает все, SEQUENTIAL и RANDOM сменяют друг друга, NOREUSE добавляется к ним.
+// WILLNEED и DONTNEED работают с диапазоном сразу. DONTNEED выкидывает только страницы,
+// целиком лежащие в диапазоне, сначала скинув грязные
+int lab2_fadvise(int fd, off_t offset, off_t len, int advice) {
+    DescriptorRef ref(fd);
+    if (!ref.desc) {
+        return -1;
+    }
+    if (offset < 0 || len < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    FileDescriptor &fileDesc = *ref.desc;
+    off_t end = len == 0 || len > LLONG_MAX - offset ? LLONG_MAX : offset + len;
+    auto page = static_cast<off_t>(pageSize);
+    switch (advice) {
+        case POSIX_FADV_NORMAL:
+            update_advice(fileDesc, ADVICE_SEQUENTIAL | ADVICE_RANDOM | ADVICE_NOREUSE, 0);
+            return 0;
+        case POSIX_FADV_SEQUENTIAL:
+            update_advice(fileDesc, ADVICE_RANDOM, ADVICE_SEQUENTIAL);
+            return 0;
+        case POSIX_FADV_RANDOM:
+            update_advice(fileDesc, ADVICE_SEQUENTIAL, ADVICE_RANDOM);
+            return 0;
+        case POSIX_FADV_NOREUSE:
+            update_advice(fileDesc, 0, ADVICE_NOREUSE);
+            return 0;
+        case POSIX_FADV_WILLNEED:
+            return prefetch_file_pages(fileDesc, offset, end);
+        case POSIX_FADV_DONTNEED: {
+            off_t first = (offset + page - 1) / page * page;
+            off_t last = end == LLONG_MAX ? end : end / page * page;
+            if (first >= last) {
+                return 0;
+            }
+            if (flush_file_pages(writeback_fd(fileDesc), fileDesc.file, false, first, last) == -1) {
+                return -1;
+            }
+            evict_file_pages(fileDesc.file, first, last);
+            return 0;
+        }
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+}
+
+
+// Страницы с той, на которую приходится меньший из старого и нового концов, уходят из кэша (грязные
+// сначала на диск): за новым концом их быть не должно, а последняя должна на нем кончаться
+int lab2_ftruncate(int fd, off_t length) {
+    DescriptorRef ref(fd);
+    if (!ref.desc) {
+        return -1;
+    }
+    FileDescriptor &fileDesc = *ref.desc;
+    if (length < 0 || !fileDesc.writable) {
+        errno = EINVAL;
+        return -1;
+    }
+    SharedFile &shared_file = sharedMemory->files[fileDesc.file];
+    auto page = static_cast<off_t>(pageSize);
+    off_t first = std::min(length, shared_file.size.load(std::memory_order_acquire)) / page * page;
+    if (flush_file_pages(fileDesc.fd, fileDesc.file, false, first, LLONG_MAX) == -1) {
+        return -1;
+    }
+    evict_file_pages(fileDesc.file, first, LLONG_MAX);
+    pthread_mutex_lock(&shared_file.sizeLock);
+    int result = ftruncate(fileDesc.fd, length);
+    if (result == 0) {
+        shared_file.size.store(length, std::memory_order_release);
+    }
+    pthread_mutex_unlock(&shared_file.sizeLock);
+    return result;
+}
+
+
+// Отображение, в которое попадает address. Зовут под mappingsLock
+Mapping *find_mapping(const char *address) {
+    for (Mapping &mapping: mappings) {
+        if (address >= mapping.address && address < mapping.address + mapping.length) {
+            return &mapping;
+        }
+    }
+    return nullptr;
+}
+
+// Кладем страницу в отображение. Уже положили - осталось разбудить тех, кто ее ждет
+void copy_mapped_page(const char *source, uint64_t address, bool protect) {
+    struct uffdio_copy copy = {};
+    copy.dst = address;
+    copy.src = reinterpret_cast<uint64_t>(source);
+    copy.len = pageSize;
+    copy.mode = protect ? UFFDIO_COPY_MODE_WP : 0;
+    if (ioctl(faultFd, UFFDIO_COPY, &copy) == -1 && errno == EEXIST) {
+        struct uffdio_range range = {address, pageSize};
+        ioctl(faultFd, UFFDIO_WAKE, &range);
+    }
+}
+
+// Первое обращение к странице отображения: закрепляем страницу кэша и копируем ее в память процесса
+// прямо из фрейма, через faultBuffer идет только неполная последняя страница файла. Первое чтение
+// оставляет страницу защищенной от записи, чтобы узнать о первой записи
+void fill_mapped_page(Mapping &mapping, size_t page, bool write) {
+    LatencyTimer timer(LAB2_LATENCY_READ_HIT, LAB2_LATENCY_READ_MISS);
+    auto offset = static_cast<off_t>(page * pageSize);
+    auto address = reinterpret_cast<uint64_t>(mapping.address + offset);
+    bool protect = mapping.writable && faultWriteProtect && !write;
+    DescriptorRef ref(mapping.fd);
+    size_t bytes = pageSize;
+    int32_t frame = NO_FRAME;
+    if (ref.desc) {
+        if (traceDir[0] != '\0') {
+            trace_page_read(*ref.desc, offset);
+        }
+        threadSharedReads++;
+        frame = pin_page_for_read(*ref.desc, offset, bytes, 1, false);
+    }
+    if (frame < 0) {
+        memset(faultBuffer, 0, pageSize);
+        copy_mapped_page(faultBuffer, address, protect);
+    } else {
+        pthread_mutex_lock(&frame_lock(frame));
+        bytes = std::min<size_t>(bytes, cachePages[frame].length);
+        if (bytes == pageSize) {
+            copy_mapped_page(frame_data(frame), address, protect);
+        } else {
+            memcpy(faultBuffer, frame_data(frame), bytes);
+            memset(faultBuffer + bytes, 0, pageSize - bytes);
+            copy_mapped_page(faultBuffer, address, protect);
+        }
+        pthread_mutex_unlock(&frame_lock(frame));
+        unpin_frame(cachePages[frame]);
+        count_stat(STAT_BYTES_READ, bytes);
+    }
+    if (mapping.writable && !protect) {
+        mapping.dirty[page] = true;
+    }
+}
+
+void handle_fault(const struct uffd_msg &message) {
+    pthread_mutex_lock(&mappingsLock);
+    Mapping *mapping = find_mapping(reinterpret_cast<char *>(message.arg.pagefault.address));
+    if (mapping) {
+        size_t page = (reinterpret_cast<char *>(message.arg.pagefault.address) - mapping->address) / pageSize;
+        if (message.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WP) {
+            mapping->dirty[page] = true;
+            struct uffdio_writeprotect unprotect = {};
+            unprotect.range = {reinterpret_cast<uint64_t>(mapping->address + page * pageSize), pageSize};
+            ioctl(faultFd, UFFDIO_WRITEPROTECT, &unprotect);
+        } else {
+            fill_mapped_page(*mapping, page, message.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WRITE);
+        }
+    }
+    pthread_mutex_unlock(&mappingsLock);
+}
+
+// Поток промахов отображений: один на процесс, живет до detach_shared_memory
+void *fault_thread_main(void *) {
+    struct pollfd fds[2] = {{faultFd, POLLIN, 0}, {faultStopFd, POLLIN, 0}};
+    for (;;) {
+        if (poll(fds, 2, -1) == -1 && errno != EINTR) {
+            perror("Failed to wait for page faults");
+            return nullptr;
+        }
+        if (fds[1].revents & POLLIN) {
+            return nullptr;
+        }
+        struct uffd_msg message;
+        while (read(faultFd, &message, sizeof(message)) == sizeof(message)) {
+            if (message.event == UFFD_EVENT_PAGEFAULT) {
+                handle_fault(message);
+            }
+        }
+    }
+}
+
+int open_userfaultfd(uint64_t features) {
+    int fd = static_cast<int>(syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK));
+    struct uffdio_api api = {UFFD_API, features, 0};
+    if (fd != -1 && ioctl(fd, UFFDIO_API, &api) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// userfaultfd и поток промахов заводим при первом lab2_mmap. Ядро без защиты от записи для
+// анонимной памяти - работаем и так, но тогда грязной считается каждая страница записываемого
+// отображения, к которой обращались. Зовут под mappingsLock
+bool start_fault_handler() {
+    if (faultFd != -1) {
+        return true;
+    }
+    faultWriteProtect = true;
+    int fd = open_userfaultfd(UFFD_FEATURE_PAGEFAULT_FLAG_WP);
+    if (fd == -1) {
+        faultWriteProtect = false;
+        fd = open_userfaultfd(0);
+    }
+    if (fd == -1) {
+        perror("Failed to create userfaultfd");
+        return false;
+    }
+    faultBuffer = static_cast<char *>(aligned_alloc(MIN_PAGE_SIZE, pageSize));
+    faultStopFd = eventfd(0, EFD_CLOEXEC);
+    faultFd = fd;
+    if (!faultBuffer || faultStopFd == -1 || pthread_create(&faultThread, nullptr, fault_thread_main, nullptr) != 0) {
+        perror("Failed to start page fault thread");
+        free(faultBuffer);
+        faultBuffer = nullptr;
+        if (faultStopFd != -1) {
+            close(faultStopFd);
+        }
+        close(fd);
+        faultStopFd = -1;
+        faultFd = -1;
+        return false;
+    }
+    return true;
+}
+
+// Записанные страницы отображения копируем в кэш. Защиту от записи ставим до копирования:
+// запись во время копирования снова сделает страницу грязной. Зовут под mappingsLock
+int copy_back_mapping(Mapping &mapping) {
+    int result = 0;
+    for (size_t page = 0; page < mapping.dirty.size(); page++) {
+        if (!mapping.dirty[page]) {
+            continue;
+        }
+        mapping.dirty[page] = false;
+        size_t offset = page * pageSize;
+        if (faultWriteProtect) {
+            struct uffdio_writeprotect protect = {};
+            protect.range = {reinterpret_cast<uint64_t>(mapping.address + offset), pageSize};
+            protect.mode = UFFDIO_WRITEPROTECT_MODE_WP;
+            ioctl(faultFd, UFFDIO_WRITEPROTECT, &protect);
+        }
+        auto bytes = static_cast<ssize_t>(std::min(pageSize, mapping.size - offset));
+        if (lab2_pwrite(mapping.fd, mapping.address + offset, bytes, static_cast<off_t>(offset)) != bytes) {
+            mapping.dirty[page] = true;
+            result = -1;
+        }
+    }
+    return result;
+}
+
+int sync_file_mappings(int32_t file) {
+    int result = 0;
+    pthread_mutex_lock(&mappingsLock);
+    for (Mapping &mapping: mappings) {
+        if (mapping.file == file && copy_back_mapping(mapping) == -1) {
+            result = -1;
+        }
+    }
+    pthread_mutex_unlock(&mappingsLock);
+    return result;
+}
+
+// Отображение файла на память: резервируем адреса и отдаем страницы из кэша по промахам
+void *lab2_mmap(int fd, size_t length, int prot) {
+    DescriptorRef ref(fd);
+    if (!ref.desc) {
+        return MAP_FAILED;
+    }
+    bool writable = prot & PROT_WRITE;
+    if (length == 0 || !(prot & PROT_READ) || (prot & ~(PROT_READ | PROT_WRITE))) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+    if (writable && !ref.desc->writable) {
+        errno = EACCES;
+        return MAP_FAILED;
+    }
+    // Свой дескриптор на тот же файл: отображение переживает lab2_close(fd), как у mmap
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    int mapping_fd = lab2_open(path, writable ? O_RDWR : O_RDONLY);
+    if (mapping_fd == -1) {
+        return MAP_FAILED;
+    }
+    size_t mapped = align_up(length, pageSize);
+    // В ребенке после fork userfaultfd родителя не работает, так что отображение ему не достается
+    void *address = mmap(nullptr, mapped, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (address == MAP_FAILED || madvise(address, mapped, MADV_DONTFORK) == -1) {
+        if (address != MAP_FAILED) {
+            munmap(address, mapped);
+        }
+        lab2_close(mapping_fd);
+        return MAP_FAILED;
+    }
+    pthread_mutex_lock(&mappingsLock);
+    bool registered = start_fault_handler();
+    if (registered) {
+        struct uffdio_register range = {};
+        range.range = {reinterpret_cast<uint64_t>(address), mapped};
+        range.mode = UFFDIO_REGISTER_MODE_MISSING | (writable && faultWriteProtect ? UFFDIO_REGISTER_MODE_WP : 0);
+        registered = ioctl(faultFd, UFFDIO_REGISTER, &range) == 0;
+    }
+    if (registered) {
+        mappings.push_back({static_cast<char *>(address), mapped, length, mapping_fd, ref.desc->file, writable,
+                            std::vector<bool>(mapped / pageSize)});
+    }
+    pthread_mutex_unlock(&mappingsLock);
+    if (!registered) {
+        int saved_errno = errno;
+        munmap(address, mapped);
+        lab2_close(mapping_fd);
+        errno = saved_errno;
+        return MAP_FAILED;
+    }
+    return address;
+}
+
+// Записанное отдаем в кэш, а lab2_close отображения - на диск. Снимать можно только отображение целиком
+int lab2_munmap(void *address, size_t length) {
+    pthread_mutex_lock(&mappingsLock);
+    auto mapping = std::find_if(mappings.begin(), mappings.end(), [&](const Mapping &candidate) {
+        return candidate.address == address && candidate.length == align_up(length, pageSize);
+    });
+    if (mapping == mappings.end()) {
+        pthread_mutex_unlock(&mappingsLock);
+        errno = EINVAL;
+        return -1;
+    }
+    int result = copy_back_mapping(*mapping);
+    struct uffdio_range range = {reinterpret_cast<uint64_t>(mapping->address), mapping->length};
+    ioctl(faultFd, UFFDIO_UNREGISTER, &range);
+    munmap(mapping->address, mapping->length);
+    int fd = mapping->fd;
+    mappings.erase(mapping);
+    pthread_mutex_unlock(&mappingsLock);
+    if (lab2_close(fd) == -1) {
+        result = -1;
+    }
+    return result;
+}
+
+// Выход процесса: отображения снимаем с записью, как ядро пишет в файл страницы MAP_SHARED
+void unmap_all_mappings() {
+    pthread_mutex_lock(&mappingsLock);
+    while (!mappings.empty()) {
+        void *address = mappings.back().address;
+        size_t size = mappings.back().size;
+        pthread_mutex_unlock(&mappingsLock);
+        lab2_munmap(address, size);
+        pthread_mutex_lock(&mappingsLock);
+    }
+    pthread_mutex_unlock(&mappingsLock);
+    if (faultFd != -1) {
+        uint64_t stop = 1;
+        if (write(faultStopFd, &stop, sizeof(stop)) == sizeof(stop)) {
+            pthread_join(faultThread, nullptr);
+        }
+        close(faultStopFd);
+        close(faultFd);
+        free(faultBuffer);
+        faultStopFd = -1;
+        faultFd = -1;
+        faultBuffer = nullptr;
+    }
+}
+
+// Ребенок после fork: отображений у него нет (MADV_DONTFORK), потока промахов тоже
+void forget_mappings() {
+    pthread_mutex_init(&mappingsLock, nullptr);
+    mappings.clear();
+    if (faultFd != -1) {
+        close(faultFd);
+        close(faultStopFd);
+        faultFd = -1;
+        faultStopFd = -1;
+    }
+}
+
+
+// Счетчики идут в начале lab2_stats в том же порядке, что и StatCounter
+static_assert(offsetof(lab2_stats, cachePages) == STAT_COUNTERS * sizeof(uint64_t));
+
+void add_process_stats(const ProcessStats &process, uint64_t *values) {
+    for (const StatShard &shard: process.shards) {
+        for (size_t i = 0; i < STAT_COUNTERS; i++) {
+            values[i] += shard.values[i].load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Слоты, по которым считать pid: все для pid 0, иначе слот процесса. 0 и errno, если таких нет
+size_t select_process_stats(pid_t pid, const ProcessStats **slots) {
+    if (!sharedMemory) {
+        errno = ENOENT;
+        return 0;
+    }
+    size_t count = 0;
+    for (const ProcessStats &process: sharedMemory->stats) {
+        if (pid == 0 || (&process != &sharedMemory->stats[0] && process.pid.load(std::memory_order_relaxed) == pid)) {
+            slots[count++] = &process;
+        }
+    }
+    if (count == 0) {
+        errno = ESRCH;
+    }
+    return count;
+}
+
+int lab2_get_stats(pid_t pid, lab2_stats *stats) {
+    const ProcessStats *slots[STAT_PROCESS_SLOTS];
+    size_t slot_count = select_process_stats(pid, slots);
+    if (slot_count == 0) {
+        return -1;
+    }
+    uint64_t values[STAT_COUNTERS] = {};
+    for (size_t i = 0; i < slot_count; i++) {
+        add_process_stats(*slots[i], values);
+    }
+    memcpy(stats, values, sizeof(values));
+    stats->cachePages = cacheSize;
+    stats->pageSize = pageSize;
+    stats->residentPages = cacheIndex->count.load(std::memory_order_relaxed);
+    stats->dirtyPages = sharedMemory->dirtyCount.load(std::memory_order_relaxed);
+    stats->coldPages = coldIndex->count.load(std::memory_order_relaxed);
+    return 0;
+}
+
+int lab2_get_latency(pid_t pid, lab2_latency *latency) {
+    const ProcessStats *slots[STAT_PROCESS_SLOTS];
+    size_t slot_count = select_process_stats(pid, slots);
+    if (slot_count == 0) {
+        return -1;
+    }
+    memset(latency, 0, sizeof(*latency));
+    for (size_t i = 0; i < slot_count; i++) {
+        for (const StatShard &shard: slots[i]->shards) {
+            for (size_t kind = 0; kind < LAB2_LATENCY_KINDS; kind++) {
+                for (size_t bucket = 0; bucket < LAB2_LATENCY_BUCKETS; bucket++) {
+                    latency->buckets[kind][bucket] += shard.latency[kind][bucket].load(std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+size_t lab2_stat_processes(pid_t *pids, size_t max) {
+    size_t count = 0;
+    for (size_t i = 1; sharedMemory && i < STAT_PROCESS_SLOTS; i++) {
+        pid_t pid = sharedMemory->stats[i].pid.load(std::memory_order_relaxed);
+        if (pid != 0) {
+            if (count < max) {
+                pids[count] = pid;
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+// Монитору писать в кэш нечего: отображаем готовый сегмент только на чтение и в refCount не входим
+int lab2_attach_stats() {
+    if (sharedMemory) {
+        return 0;
+    }
+    HugePages huge_pages = HugePages::OFF;
+    const char *cache_file = getenv("LAB2_CACHE_FILE");
+    int shm_fd = cache_file ? open(cache_file, O_RDONLY | O_CLOEXEC) : shm_open(SHARED_MEMORY_NAME, O_RDONLY, 0);
+    if (shm_fd == -1 && !cache_file) {
+        huge_pages = HugePages::HUGETLB;
+        shm_fd = open(HUGETLB_SHARED_MEMORY_PATH, O_RDONLY);
+    }
+    if (shm_fd == -1) {
+        return -1;
+    }
+    int map_flags = MAP_SHARED | (huge_pages == HugePages::HUGETLB ? MAP_HUGETLB : 0);
+    size_t header_size = huge_pages == HugePages::HUGETLB ? HUGE_PAGE_SIZE : sizeof(SharedMemory);
+    struct stat shm_stat;
+    void *header = MAP_FAILED;
+    if (fstat(shm_fd, &shm_stat) == 0 && static_cast<size_t>(shm_stat.st_size) >= header_size) {
+        header = mmap(nullptr, header_size, PROT_READ, map_flags, shm_fd, 0);
+    }
+    if (header == MAP_FAILED) {
+        close(shm_fd);
+        return -1;
+    }
+    auto *shared = static_cast<SharedMemory *>(header);
+    if (!shared->ready.load(std::memory_order_acquire) || shared->magic != SHARED_MEMORY_MAGIC) {
+        fprintf(stderr, "Shared memory %s is not ready or has an unknown layout\n", SHARED_MEMORY_NAME);
+        munmap(header, header_size);
+        close(shm_fd);
+        return -1;
+    }
+    size_t mapped_size = shared->geometry.mappedSize;
+    munmap(header, header_size);
+    void *memory = mmap(nullptr, mapped_size, PROT_READ, map_flags, shm_fd, 0);
+    close(shm_fd);
+    if (memory == MAP_FAILED) {
+        return -1;
+    }
+    sharedMemory = static_cast<SharedMemory *>(memory);
+    map_shared_arrays();
+    return 0;
 }
 
 }
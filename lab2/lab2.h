@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+extern "C" {
+
+// Read-only window into a pinned cache page, see lab2_read_view
+struct lab2_view {
+    const char *data;           // Points into the shared cache, valid until lab2_unpin_view
+    size_t length;              // Count of bytes available at data
+    int32_t frame;              // Pinned frame, -1 if nothing is pinned
+};
+
+// Cache counters, see lab2_get_stats. Counters only grow; the last five fields are current values
+struct lab2_stats {
+    uint64_t hits;              // Page accesses that found the page in the cache
+    uint64_t misses;            // Page accesses that had to load or install the page
+    uint64_t readaheadPages;    // Pages loaded in a batch ahead of the page that missed
+    uint64_t evictions;         // Pages evicted to free a frame
+    uint64_t dirtyEvictions;    // Evicted pages that had to be written back first
+    uint64_t writebackPages;    // Dirty pages written to disk by fsync, close, the flusher or eviction
+    uint64_t bytesRead;         // Bytes returned by lab2 reads
+    uint64_t bytesWritten;      // Bytes taken by lab2 writes
+    uint64_t diskBytesRead;     // Bytes read from disk
+    uint64_t diskBytesWritten;  // Bytes written to disk
+    uint64_t lockWaitNs;        // Time spent waiting for frames pinned by others and for cursor locks
+    uint64_t l1Hits;            // Hits served from the process-local L1 copy of the page, counted in hits too
+    uint64_t deviceFlushes;     // fsync(2) calls of lab2_fsync, one serves every lab2_fsync that joined its group commit
+    uint64_t coldHits;          // Pages loaded by decompressing them from the compressed tier (LAB2_COLD_SIZE)
+    uint64_t coldMisses;        // Pages loaded from disk while the compressed tier was on
+    uint64_t coldStores;        // Evicted pages kept in the compressed tier
+    uint64_t coldPageBytes;     // Bytes of those pages before compression
+    uint64_t coldCompressedBytes; // and after, coldPageBytes / coldCompressedBytes is the compression ratio
+    uint64_t cachePages;        // Frames in the cache
+    uint64_t pageSize;          // Size of a cache page
+    uint64_t residentPages;     // Frames holding a page
+    uint64_t dirtyPages;        // Frames that differ from the file
+    uint64_t coldPages;         // Pages held in the compressed tier
+};
+
+// Latency histograms of lab2 calls and of what they wait for, see lab2_get_latency
+enum lab2_latency_kind {
+    LAB2_LATENCY_OPEN,
+    LAB2_LATENCY_READ_HIT,      // lab2_read, lab2_pread(v) and lab2_read_view that loaded no page
+    LAB2_LATENCY_READ_MISS,     // Reads that had to load at least one page
+    LAB2_LATENCY_READ_L1,       // lab2_read and lab2_pread(v) served entirely from the process-local L1
+    LAB2_LATENCY_WRITE_HIT,     // lab2_write and lab2_pwrite(v) that found all their pages cached
+    LAB2_LATENCY_WRITE_MISS,    // Writes that had to install at least one page
+    LAB2_LATENCY_FSYNC,
+    LAB2_LATENCY_CLOSE,
+    LAB2_LATENCY_LOCK_WAIT,     // Each wait for a frame pinned by others or for a cursor lock
+    LAB2_LATENCY_DISK_IO,       // Each disk read, write, fsync or batch of io_uring requests
+    LAB2_LATENCY_KINDS,
+};
+
+// Log-bucketed: bucket 0 counts 0 ns, bucket b counts [2^(b-1), 2^b) ns, the last one everything longer
+constexpr size_t LAB2_LATENCY_BUCKETS = 32;
+
+struct lab2_latency {
+    uint64_t buckets[LAB2_LATENCY_KINDS][LAB2_LATENCY_BUCKETS];
+};
+
+void initialize_library();
+int lab2_open(const char *path, int flags);
+int lab2_close(int fd);
+ssize_t lab2_read(int fd, void *buf, size_t count);
+ssize_t lab2_write(int fd, const void *buf, size_t count);
+off_t lab2_lseek(int fd, off_t offset, int whence);
+int lab2_fsync(int fd);
+
+// Sets the size of the file like ftruncate(2); cached pages past the new end are written back and
+// dropped. lab2 tracks the size of every file itself: writes past the end grow it, lab2_lseek(SEEK_END)
+// uses it, and write-back in whole O_DIRECT blocks trims the file back to it
+int lab2_ftruncate(int fd, off_t length);
+
+// Positional and scatter/gather I/O through the cache. They neither use nor move the cursor,
+// so threads may call them on the same descriptor at once. A vector is served in one pass:
+// the first miss loads every missing page it covers in one batch
+ssize_t lab2_pread(int fd, void *buf, size_t count, off_t offset);
+ssize_t lab2_pwrite(int fd, const void *buf, size_t count, off_t offset);
+ssize_t lab2_preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+ssize_t lab2_pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+
+// Access hint for [offset, offset + len) of the file, len 0 means up to the end; advice is one of
+// POSIX_FADV_*. SEQUENTIAL widens readahead, RANDOM turns it off, NOREUSE puts pages in cold so a
+// one-pass scan does not push hot pages out, NORMAL undoes all three. These apply to the whole
+// descriptor. WILLNEED loads the range now, DONTNEED writes it back and drops it from the cache
+int lab2_fadvise(int fd, off_t offset, off_t len, int advice);
+
+// With LAB2_TRACE_DIR set, lab2_close saves the order in which the descriptor read pages of the file
+// to a trace in that directory (format in access-trace.h, policy-sim reads it too). lab2_open of the
+// file then loads the pages of its last trace in that order, in batches, ahead of the reader
+// (LAB2_PREWARM=0 turns this off). lab2_prewarm loads them all now, up to half of the cache.
+// -1 with ENOENT if there is no trace for path
+int lab2_prewarm(const char *path);
+
+// Pins the page under the cursor and returns up to count bytes of it without copying.
+// The page cannot be evicted until lab2_unpin_view, but writes to it stay visible.
+ssize_t lab2_read_view(int fd, size_t count, lab2_view *view);
+void lab2_unpin_view(lab2_view *view);
+
+// Maps the first length bytes of the file. A page is copied in from the cache on its first access
+// (userfaultfd), so reads see the page as it was then. Writes reach the cache on lab2_fsync of any
+// descriptor of the file in this process and on lab2_munmap or exit; past length they are dropped.
+// prot is PROT_READ or PROT_READ | PROT_WRITE; the mapping keeps the file open until lab2_munmap.
+void *lab2_mmap(int fd, size_t length, int prot);
+int lab2_munmap(void *address, size_t length);
+
+// Counters of process pid, or the sum over all processes (exited ones included) for pid 0.
+// -1 with ESRCH if pid has no counters of its own
+int lab2_get_stats(pid_t pid, lab2_stats *stats);
+// Fills up to max processes that have counters of their own and returns how many there are
+size_t lab2_stat_processes(pid_t *pids, size_t max);
+// Latency histograms of process pid, or of all processes for pid 0, same rules as lab2_get_stats
+int lab2_get_latency(pid_t pid, lab2_latency *latency);
+// For monitors: maps the existing cache read-only without joining it, so lab2_get_stats works
+// without initialize_library. -1 if there is no cache
+int lab2_attach_stats();
+}
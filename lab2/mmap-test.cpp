@@ -0,0 +1,160 @@
+#include <iostream>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "lab2.h"
+#include "test-util.h"
+
+constexpr size_t PAGE_SIZE = 4096;
+constexpr size_t PAGES = 16;
+constexpr size_t TAIL = 100;                    // The file ends inside its last page
+constexpr size_t FILE_SIZE = PAGES * PAGE_SIZE + TAIL;
+const char *FILE_NAME = "mmap-test.dat";
+constexpr size_t COPY_PAGES = 256;              // As many as there are frame lock stripes
+constexpr size_t COPY_SIZE = COPY_PAGES * PAGE_SIZE;
+constexpr unsigned COPY_TIMEOUT_S = 20;
+const char *SOURCE_NAME = "mmap-test-source.dat";
+const char *TARGET_NAME = "mmap-test-target.dat";
+
+// Byte i of the file is i % 251 as created
+char initial_byte(size_t i) {
+    return static_cast<char>(i % 251);
+}
+
+// What is on disk, read past the cache
+bool disk_page_is(size_t page, char value) {
+    int fd = open(FILE_NAME, O_RDONLY);
+    std::vector<char> buffer(PAGE_SIZE);
+    bool ok = fd != -1 && pread(fd, buffer.data(), PAGE_SIZE, static_cast<off_t>(page * PAGE_SIZE)) == PAGE_SIZE &&
+              buffer.front() == value && buffer.back() == value;
+    if (fd != -1) {
+        close(fd);
+    }
+    return ok;
+}
+
+// A file of COPY_PAGES pages, page p holds p + version in every byte
+bool create_copy_file(const char *name, char version) {
+    int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    std::vector<char> page(PAGE_SIZE);
+    bool ok = fd != -1;
+    for (size_t p = 0; p < COPY_PAGES && ok; p++) {
+        std::fill(page.begin(), page.end(), static_cast<char>(p + version));
+        ok = write(fd, page.data(), PAGE_SIZE) == PAGE_SIZE;
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    return ok;
+}
+
+bool holds_copy_pages(const char *data, char version) {
+    for (size_t p = 0; p < COPY_PAGES; p++) {
+        if (data[p * PAGE_SIZE] != static_cast<char>(p + version) ||
+            data[p * PAGE_SIZE + PAGE_SIZE - 1] != static_cast<char>(p + version)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A mapping as the buffer of lab2_pwrite and lab2_pread of another cached file: its faults are served
+// through the cache while the call copies, so the call must not hold frame locks over the user's memory.
+// Every page of the other file is cached first, so its frames cover all the lock stripes
+bool copy_through_mapping() {
+    bool ok = check(create_copy_file(SOURCE_NAME, 1) && create_copy_file(TARGET_NAME, 2), "Failed to create files.");
+    int source_fd = lab2_open(SOURCE_NAME, O_RDWR);
+    int target_fd = lab2_open(TARGET_NAME, O_RDWR);
+    std::vector<char> target(COPY_SIZE);
+    ok = ok && check(source_fd != -1 && target_fd != -1, "Failed to open files.") &&
+         check(lab2_pread(target_fd, target.data(), COPY_SIZE, 0) == COPY_SIZE, "Failed to cache the target.");
+    // A hang is a failure: SIGALRM ends the test
+    alarm(COPY_TIMEOUT_S);
+    auto *map = ok ? static_cast<char *>(lab2_mmap(source_fd, COPY_SIZE, PROT_READ | PROT_WRITE)) : nullptr;
+    ok = ok && check(map != MAP_FAILED && map != nullptr, "lab2_mmap of the source failed.") &&
+         check(lab2_pwrite(target_fd, map, COPY_SIZE, 0) == COPY_SIZE, "lab2_pwrite from a mapping failed.") &&
+         check(lab2_pread(target_fd, target.data(), COPY_SIZE, 0) == COPY_SIZE && holds_copy_pages(target.data(), 1),
+               "lab2_pwrite from a mapping wrote wrong data.") &&
+         check(lab2_munmap(map, COPY_SIZE) == 0, "lab2_munmap of the source failed.");
+
+    // Into a fresh mapping, reading pages that are not cached
+    ok = ok && check(lab2_fadvise(target_fd, 0, 0, POSIX_FADV_DONTNEED) == 0 && create_copy_file(TARGET_NAME, 3),
+                     "Failed to rewrite the target.");
+    map = ok ? static_cast<char *>(lab2_mmap(source_fd, COPY_SIZE, PROT_READ | PROT_WRITE)) : nullptr;
+    ok = ok && check(map != MAP_FAILED && map != nullptr, "lab2_mmap of the source failed.") &&
+         check(lab2_pread(target_fd, map, COPY_SIZE, 0) == COPY_SIZE && holds_copy_pages(map, 3),
+               "lab2_pread into a mapping failed.") &&
+         check(lab2_munmap(map, COPY_SIZE) == 0, "lab2_munmap of the source failed.");
+    alarm(0);
+    lab2_close(source_fd);
+    lab2_close(target_fd);
+    unlink(SOURCE_NAME);
+    unlink(TARGET_NAME);
+    return ok;
+}
+
+int main() {
+    int create_fd = open(FILE_NAME, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    std::vector<char> contents(FILE_SIZE);
+    for (size_t i = 0; i < FILE_SIZE; i++) {
+        contents[i] = initial_byte(i);
+    }
+    if (create_fd < 0 || write(create_fd, contents.data(), FILE_SIZE) != FILE_SIZE) {
+        std::cerr << "Failed to create file.\n";
+        return 1;
+    }
+    close(create_fd);
+    initialize_library();
+    // On a fresh cache: the frames of the two files then pair up on the same lock stripes
+    bool ok = copy_through_mapping();
+    int fd = lab2_open(FILE_NAME, O_RDWR);
+    int read_only_fd = lab2_open(FILE_NAME, O_RDONLY);
+
+    // A page written through the cache and not flushed yet is what the mapping sees
+    std::vector<char> page(PAGE_SIZE, 'c');
+    ok = ok && check(fd != -1 && read_only_fd != -1, "Failed to open file.") &&
+                     check(lab2_pwrite(fd, page.data(), PAGE_SIZE, 3 * PAGE_SIZE) == PAGE_SIZE, "Write failed.");
+    memcpy(contents.data() + 3 * PAGE_SIZE, page.data(), PAGE_SIZE);
+    auto *map = ok ? static_cast<char *>(lab2_mmap(fd, FILE_SIZE, PROT_READ | PROT_WRITE)) : nullptr;
+    ok = ok && check(map != MAP_FAILED && map != nullptr, "lab2_mmap failed.") &&
+         check(memcmp(map, contents.data(), FILE_SIZE) == 0, "The mapping differs from the file.") &&
+         check(map[FILE_SIZE] == 0 && map[PAGES * PAGE_SIZE + PAGE_SIZE - 1] == 0, "Past the end is not zero.");
+    ok = ok && check(lab2_mmap(read_only_fd, FILE_SIZE, PROT_READ | PROT_WRITE) == MAP_FAILED && errno == EACCES,
+                     "A read-only descriptor gave a writable mapping.");
+
+    // Stores reach the cache on lab2_fsync, and from there the disk and other processes
+    if (ok) {
+        memset(map + 5 * PAGE_SIZE, 'w', PAGE_SIZE);
+    }
+    ok = ok && check(lab2_fsync(fd) == 0 && disk_page_is(5, 'w'), "lab2_fsync did not write the mapped page.");
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        std::vector<char> buffer(PAGE_SIZE);
+        // _exit: the thread serving the faults of the parent is not in the child, LeakSanitizer would count its memory
+        _exit(lab2_pread(read_only_fd, buffer.data(), PAGE_SIZE, 5 * PAGE_SIZE) == PAGE_SIZE && buffer[0] == 'w' ? 0 : 1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    ok = ok && check(WIFEXITED(status) && WEXITSTATUS(status) == 0, "Another process did not see the mapped write.");
+
+    // A read-only mapping outlives its descriptor and sees what the first mapping synced
+    auto *view = ok ? static_cast<char *>(lab2_mmap(read_only_fd, FILE_SIZE, PROT_READ)) : nullptr;
+    ok = ok && check(view != MAP_FAILED && view != nullptr && lab2_close(read_only_fd) == 0, "Read-only map failed.") &&
+         check(view[5 * PAGE_SIZE] == 'w' && view[9 * PAGE_SIZE + 7] == initial_byte(9 * PAGE_SIZE + 7),
+               "The read-only mapping has wrong data.");
+
+    // lab2_munmap writes the rest back
+    if (ok) {
+        memset(map + 7 * PAGE_SIZE, 'u', PAGE_SIZE);
+    }
+    ok = ok && check(lab2_munmap(map, FILE_SIZE) == 0 && disk_page_is(7, 'u'), "lab2_munmap lost the write.") &&
+         check(lab2_munmap(view, FILE_SIZE) == 0, "lab2_munmap of the read-only mapping failed.") &&
+         check(lab2_lseek(fd, 0, SEEK_END) == FILE_SIZE, "The mapping changed the file size.");
+    lab2_close(fd);
+    unlink(FILE_NAME);
+    return ok ? 0 : 1;
+}
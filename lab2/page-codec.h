@@ -0,0 +1,185 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <sys/types.h>
+
+// Сжатие страниц холодного яруса в формате блока LZ4: последовательности из литералов и ссылки
+// назад (смещение до 64 KB, длина от 4). Жадный поиск по хэшу 4 байт, без внешних библиотек.
+// Текст и логи сжимаются в 3-5 раз, а разжатие страницы - это несколько memcpy
+constexpr size_t LZ_MIN_MATCH = 4;          // Shortest back reference
+constexpr size_t LZ_LAST_LITERALS = 5;      // The block always ends with this many literals
+constexpr size_t LZ_MATCH_LIMIT = 12;       // A match starts at least this far from the end of the block
+constexpr size_t LZ_MAX_OFFSET = 65535;
+constexpr size_t LZ_HASH_BITS = 12;
+
+inline uint32_t lz_read32(const char *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint64_t lz_read64(const char *p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline size_t lz_hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Сколько байт подряд a совпадает с b, не дальше limit байт. Идем по 8 байт: первый отличный
+// байт - младший ненулевой байт xor
+inline size_t lz_match_length(const char *a, const char *b, size_t limit) {
+    size_t length = 0;
+    for (; length + sizeof(uint64_t) <= limit; length += sizeof(uint64_t)) {
+        uint64_t difference = lz_read64(a + length) ^ lz_read64(b + length);
+        if (difference != 0) {
+            return length + __builtin_ctzll(difference) / 8;
+        }
+    }
+    while (length < limit && a[length] == b[length]) {
+        length++;
+    }
+    return length;
+}
+
+// Длина 15 и больше продолжается байтами после токена: 255 - читать дальше
+inline char *lz_put_length(char *out, size_t length) {
+    for (; length >= 255; length -= 255) {
+        *out++ = static_cast<char>(255);
+    }
+    *out++ = static_cast<char>(length);
+    return out;
+}
+
+// Последовательность: литералы и ссылка на offset байт назад длиной match (без ссылки у последней).
+// nullptr, если она не влезает в [out, out_end)
+inline char *lz_put_sequence(char *out, const char *out_end, const char *literals, size_t literal_count,
+                             size_t offset, size_t match, bool last) {
+    size_t worst = 1 + literal_count + literal_count / 255 + 1 + (last ? 0 : 2 + match / 255 + 1);
+    if (worst > static_cast<size_t>(out_end - out)) {
+        return nullptr;
+    }
+    char *token = out++;
+    *token = static_cast<char>(std::min<size_t>(literal_count, 15) << 4);
+    if (literal_count >= 15) {
+        out = lz_put_length(out, literal_count - 15);
+    }
+    memcpy(out, literals, literal_count);
+    out += literal_count;
+    if (last) {
+        return out;
+    }
+    *out++ = static_cast<char>(offset & 0xFF);
+    *out++ = static_cast<char>(offset >> 8);
+    match -= LZ_MIN_MATCH;
+    *token = static_cast<char>(*token | std::min<size_t>(match, 15));
+    if (match >= 15) {
+        out = lz_put_length(out, match - 15);
+    }
+    return out;
+}
+
+// Сжимаем size байт из src в dst. 0, если сжатое не влезает в capacity: такую страницу хранить незачем
+inline size_t lz_compress(const char *src, size_t size, char *dst, size_t capacity) {
+    uint32_t table[1 << LZ_HASH_BITS] = {};
+    const char *in = src, *anchor = src, *end = src + size;
+    const char *match_limit = size > LZ_MATCH_LIMIT ? end - LZ_MATCH_LIMIT : src;
+    char *out = dst, *out_end = dst + capacity;
+    while (in < match_limit) {
+        uint32_t sequence = lz_read32(in);
+        size_t hash = lz_hash(sequence);
+        const char *candidate = src + table[hash];
+        table[hash] = static_cast<uint32_t>(in - src);
+        if (candidate >= in || static_cast<size_t>(in - candidate) > LZ_MAX_OFFSET || lz_read32(candidate) != sequence) {
+            // Чем дольше нет совпадений, тем крупнее шаг: несжимаемая страница не стоит полного прохода
+            in += 1 + ((in - anchor) >> 6);
+            continue;
+        }
+        while (in > anchor && candidate > src && in[-1] == candidate[-1]) {
+            in--;
+            candidate--;
+        }
+        const char *match_end = in + LZ_MIN_MATCH;
+        match_end += lz_match_length(match_end, candidate + LZ_MIN_MATCH, end - LZ_LAST_LITERALS - match_end);
+        out = lz_put_sequence(out, out_end, anchor, in - anchor, in - candidate, match_end - in, false);
+        if (!out) {
+            return 0;
+        }
+        in = anchor = match_end;
+    }
+    out = lz_put_sequence(out, out_end, anchor, end - anchor, 0, 0, true);
+    return out ? out - dst : 0;
+}
+
+inline bool lz_get_length(const char *&in, const char *in_end, size_t &length) {
+    unsigned char byte;
+    do {
+        if (in >= in_end) {
+            return false;
+        }
+        byte = static_cast<unsigned char>(*in++);
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// Разжимаем size байт из src в dst, не больше capacity байт. -1, если блок испорчен
+inline ssize_t lz_decompress(const char *src, size_t size, char *dst, size_t capacity) {
+    const char *in = src, *in_end = src + size;
+    char *out = dst, *out_end = dst + capacity;
+    while (in < in_end) {
+        auto token = static_cast<unsigned char>(*in++);
+        size_t literals = token >> 4;
+        if (literals == 15 && !lz_get_length(in, in_end, literals)) {
+            return -1;
+        }
+        if (literals > static_cast<size_t>(in_end - in) || literals > static_cast<size_t>(out_end - out)) {
+            return -1;
+        }
+        // Короткие литералы копируем 16 байтами разом, если хватает места с обеих сторон
+        if (literals <= 16 && in_end - in >= 16 && out_end - out >= 16) {
+            memcpy(out, in, 16);
+        } else {
+            memcpy(out, in, literals);
+        }
+        in += literals;
+        out += literals;
+        if (in == in_end) {
+            break;
+        }
+        if (in_end - in < 2) {
+            return -1;
+        }
+        size_t offset = static_cast<unsigned char>(in[0]) | static_cast<size_t>(static_cast<unsigned char>(in[1])) << 8;
+        in += 2;
+        size_t match = token & 15;
+        if (match == 15 && !lz_get_length(in, in_end, match)) {
+            return -1;
+        }
+        match += LZ_MIN_MATCH;
+        if (offset == 0 || offset > static_cast<size_t>(out - dst) || match > static_cast<size_t>(out_end - out)) {
+            return -1;
+        }
+        // Ссылка дальше 8 байт: копируем по 8 с перехлестом за конец, если за ним есть место.
+        // Ближе она перекрывает сама себя - копируем периодами, каждый раз вдвое длиннее
+        const char *reference = out - offset;
+        if (offset >= sizeof(uint64_t) && static_cast<size_t>(out_end - out) >= match + sizeof(uint64_t)) {
+            for (size_t copied = 0; copied < match; copied += sizeof(uint64_t)) {
+                memcpy(out + copied, reference + copied, sizeof(uint64_t));
+            }
+        } else {
+            for (size_t copied = 0; copied < match;) {
+                size_t chunk = std::min(match - copied, copied + offset);
+                memcpy(out + copied, reference, chunk);
+                copied += chunk;
+            }
+        }
+        out += match;
+    }
+    return out - dst;
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+// Ключ страницы в кэше: устройство + инод однозначно задают файл, offset - страницу в нем
+struct PageKey {
+    dev_t dev;
+    ino_t inode;
+    off_t offset;
+
+    bool operator==(const PageKey &other) const {
+        return dev == other.dev && inode == other.inode && offset == other.offset;
+    }
+};
+
+constexpr int32_t NO_FRAME = -1;
+
+// Перемешиваем ключ, чтобы соседние страницы одного файла разбегались по разным корзинам
+inline uint64_t hash_page_key(const PageKey &key) {
+    uint64_t h = static_cast<uint64_t>(key.dev) * 0x9E3779B97F4A7C15ULL;
+    h ^= static_cast<uint64_t>(key.inode) + 0xBF58476D1CE4E5B9ULL + (h << 6) + (h >> 2);
+    h ^= static_cast<uint64_t>(key.offset) + 0x94D049BB133111EBULL + (h << 6) + (h >> 2);
+    h ^= h >> 31;
+    h *= 0xD6E8FEB86659FD93ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+// Хэш-индекс страниц с цепочками корзин. Живет целиком в общей памяти, поэтому никаких
+// указателей - только номера фреймов. Узел i соответствует фрейму кэша i, так что
+// поиск, вставка и удаление при вытеснении работают за O(1) без сдвигов массива.
+// Сам индекс не блокируется: цепочка корзины трогает только узлы этой корзины,
+// поэтому вызывающему достаточно держать блокировку корзины (см. bucket_of).
+// Головы и ссылки next атомарные, чтобы find_unlocked мог пройти цепочку вообще без блокировки.
+// Размеры задаются при init, корзины и узлы лежат сразу за заголовком: под индекс надо
+// выделить bytes_for(frames, buckets) байт
+struct PageIndex {
+    struct Node {
+        PageKey key;
+        std::atomic<int32_t> next; // Следующий фрейм в цепочке корзины
+        int32_t prev;           // Предыдущий фрейм (NO_FRAME - голова цепочки)
+        bool linked;            // Фрейм сейчас лежит в индексе
+    };
+
+    size_t frameCount;          // Число узлов
+    size_t bucketCount;         // Число корзин, степень двойки
+    std::atomic<size_t> count;  // Число фреймов в индексе
+
+    static size_t bytes_for(size_t frames, size_t buckets) {
+        return sizeof(PageIndex) + buckets * sizeof(std::atomic<int32_t>) + frames * sizeof(Node);
+    }
+
+    // Голова цепочки для каждой корзины
+    std::atomic<int32_t> *buckets() {
+        return reinterpret_cast<std::atomic<int32_t> *>(this + 1);
+    }
+
+    const std::atomic<int32_t> *buckets() const {
+        return reinterpret_cast<const std::atomic<int32_t> *>(this + 1);
+    }
+
+    // Узлы цепочек, по одному на фрейм
+    Node *nodes() {
+        return reinterpret_cast<Node *>(buckets() + bucketCount);
+    }
+
+    const Node *nodes() const {
+        return reinterpret_cast<const Node *>(buckets() + bucketCount);
+    }
+
+    // buckets - степень двойки не меньше 2, чтобы узлы за корзинами остались выровненными
+    void init(size_t frames, size_t buckets_count) {
+        frameCount = frames;
+        bucketCount = buckets_count;
+        for (size_t i = 0; i < bucketCount; i++) {
+            buckets()[i].store(NO_FRAME, std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < frameCount; i++) {
+            Node &node = nodes()[i];
+            node.next.store(NO_FRAME, std::memory_order_relaxed);
+            node.prev = NO_FRAME;
+            node.linked = false;
+        }
+        count.store(0, std::memory_order_relaxed);
+    }
+
+    size_t bucket_of(const PageKey &key) const {
+        return hash_page_key(key) & (bucketCount - 1);
+    }
+
+    int32_t find(const PageKey &key) const {
+        for (int32_t frame = buckets()[bucket_of(key)].load(std::memory_order_relaxed); frame != NO_FRAME;
+             frame = nodes()[frame].next.load(std::memory_order_relaxed)) {
+            if (nodes()[frame].key == key) {
+                return frame;
+            }
+        }
+        return NO_FRAME;
+    }
+
+    // Поиск без блокировки корзины. Цепочку могут менять прямо во время обхода, поэтому
+    // результат - только подсказка: и промах, и найденный фрейм вызывающий обязан перепроверить.
+    // Шагов не больше max_steps, чтобы не зациклиться, перескочив в чужую цепочку
+    int32_t find_unlocked(const PageKey &key, size_t max_steps) const {
+        int32_t frame = buckets()[bucket_of(key)].load(std::memory_order_acquire);
+        for (size_t step = 0; frame != NO_FRAME && step < max_steps; step++) {
+            if (nodes()[frame].key == key) {
+                return frame;
+            }
+            frame = nodes()[frame].next.load(std::memory_order_acquire);
+        }
+        return NO_FRAME;
+    }
+
+    // Вставляем фрейм в голову цепочки. Фрейм не должен уже лежать в индексе
+    void insert(int32_t frame, const PageKey &key) {
+        Node &node = nodes()[frame];
+        std::atomic<int32_t> &head = buckets()[bucket_of(key)];
+        int32_t old_head = head.load(std::memory_order_relaxed);
+        node.key = key;
+        node.prev = NO_FRAME;
+        node.next.store(old_head, std::memory_order_relaxed);
+        if (old_head != NO_FRAME) {
+            nodes()[old_head].prev = frame;
+        }
+        head.store(frame, std::memory_order_release);
+        node.linked = true;
+        count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void remove(int32_t frame) {
+        Node &node = nodes()[frame];
+        if (!node.linked) {
+            return;
+        }
+        int32_t next = node.next.load(std::memory_order_relaxed);
+        if (node.prev != NO_FRAME) {
+            nodes()[node.prev].next.store(next, std::memory_order_release);
+        } else {
+            buckets()[bucket_of(node.key)].store(next, std::memory_order_release);
+        }
+        if (next != NO_FRAME) {
+            nodes()[next].prev = node.prev;
+        }
+        // next не трогаем: обходящий без блокировки читатель должен суметь уйти с удаленного узла дальше
+        node.prev = NO_FRAME;
+        node.linked = false;
+        count.fetch_sub(1, std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,239 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <memory>
+#include <iomanip>
+#include <algorithm>
+#include "page-index.h"
+#include "frame-bitmap.h"
+#include "replacement-policy.h"
+#include "access-trace.h"
+
+// Same geometry as the shared cache in lab2.cpp
+constexpr size_t CACHE_PAGES = 12800;
+constexpr size_t INDEX_BUCKETS = 16384;
+constexpr size_t PAGE_SIZE = 4096;
+const ReplacementPolicy POLICIES[] = {ReplacementPolicy::CLOCK, ReplacementPolicy::TWO_Q,
+                                      ReplacementPolicy::CLOCK_PRO};
+
+struct Workload {
+    std::string name;
+    std::vector<PageKey> accesses;
+};
+
+// Single-process model of the shared cache: frames, the hash index and the policy from lab2
+struct SimulatedCache {
+    bool resident[CACHE_PAGES];
+    std::unique_ptr<char[]> indexMemory;
+    std::unique_ptr<char[]> ghostsMemory;
+    std::unique_ptr<char[]> usedMemory;
+    std::unique_ptr<char[]> hotMemory;
+    PageIndex &index;
+    PageIndex &ghosts;
+    FrameBitmap &used;
+    FrameBitmap &hot;
+    ReplacementState replacement;
+    size_t sweepWord = 0;
+    uint64_t sweepCandidates = 0;
+
+    explicit SimulatedCache(ReplacementPolicy policy)
+            : indexMemory(new char[PageIndex::bytes_for(CACHE_PAGES, INDEX_BUCKETS)]),
+              ghostsMemory(new char[PageIndex::bytes_for(CACHE_PAGES, INDEX_BUCKETS)]),
+              usedMemory(new char[FrameBitmap::bytes_for(CACHE_PAGES)]),
+              hotMemory(new char[FrameBitmap::bytes_for(CACHE_PAGES)]),
+              index(*reinterpret_cast<PageIndex *>(indexMemory.get())),
+              ghosts(*reinterpret_cast<PageIndex *>(ghostsMemory.get())),
+              used(*reinterpret_cast<FrameBitmap *>(usedMemory.get())),
+              hot(*reinterpret_cast<FrameBitmap *>(hotMemory.get())) {
+        std::fill(std::begin(resident), std::end(resident), false);
+        index.init(CACHE_PAGES, INDEX_BUCKETS);
+        ghosts.init(CACHE_PAGES, INDEX_BUCKETS);
+        used.init(CACHE_PAGES);
+        hot.init(CACHE_PAGES);
+        replacement.init(policy, CACHE_PAGES);
+    }
+
+    // Mirrors get_cache_page_to_replace without pins and dirty pages
+    int32_t victim() {
+        while (true) {
+            if (sweepCandidates == 0) {
+                sweepWord = replacement.next_word();
+                sweepCandidates = replacement.sweep_word(sweepWord, used, hot, index.count);
+                continue;
+            }
+            auto frame = static_cast<int32_t>(sweepWord * FrameBitmap::BITS + __builtin_ctzll(sweepCandidates));
+            sweepCandidates &= sweepCandidates - 1;
+            if (resident[frame] && !replacement.still_evictable(frame, used, hot)) {
+                continue;
+            }
+            if (replacement.evicted(frame, hot) && resident[frame]) {
+                replacement.remember_evicted(ghosts, index.nodes()[frame].key);
+            }
+            if (resident[frame]) {
+                index.remove(frame);
+                resident[frame] = false;
+            }
+            return frame;
+        }
+    }
+
+    bool access(const PageKey &key) {
+        int32_t frame = index.find(key);
+        if (frame != NO_FRAME) {
+            used.mark(frame);
+            return true;
+        }
+        frame = victim();
+        index.insert(frame, key);
+        resident[frame] = true;
+        replacement.loaded(frame, used, hot, replacement.uses_ghosts() && replacement.take_ghost(ghosts, key));
+        return false;
+    }
+};
+
+double hit_ratio(ReplacementPolicy policy, const Workload &workload) {
+    auto cache = std::make_unique<SimulatedCache>(policy);
+    size_t hits = 0;
+    for (const PageKey &key: workload.accesses) {
+        hits += cache->access(key);
+    }
+    return workload.accesses.empty() ? 0 : static_cast<double>(hits) / workload.accesses.size();
+}
+
+PageKey page_key(ino_t inode, size_t page) {
+    return {0, inode, static_cast<off_t>(page * PAGE_SIZE)};
+}
+
+// ema-search-str with repetitions on a file 1.5 times bigger than the cache
+Workload loop_workload() {
+    Workload workload = {"loop 1.5x cache, 4 passes", {}};
+    for (int pass = 0; pass < 4; pass++) {
+        for (size_t page = 0; page < CACHE_PAGES * 3 / 2; page++) {
+            workload.accesses.push_back(page_key(1, page));
+        }
+    }
+    return workload;
+}
+
+// Random reads of a working set half the size of the cache, interrupted by one large scan
+Workload hot_scan_workload() {
+    Workload workload = {"hot set + one-time scan", {}};
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<size_t> hot_page(0, CACHE_PAGES / 2 - 1);
+    for (int phase = 0; phase < 3; phase++) {
+        for (size_t i = 0; i < CACHE_PAGES * 4; i++) {
+            workload.accesses.push_back(page_key(1, hot_page(gen)));
+        }
+        if (phase == 1) {
+            for (size_t page = 0; page < CACHE_PAGES * 4; page++) {
+                workload.accesses.push_back(page_key(2, page));
+            }
+        }
+    }
+    return workload;
+}
+
+// Skewed random reads over a file four times bigger than the cache
+Workload skewed_workload() {
+    Workload workload = {"skewed random, 4x cache", {}};
+    std::mt19937 gen(7);
+    std::geometric_distribution<size_t> distance(2.0 / CACHE_PAGES);
+    for (size_t i = 0; i < CACHE_PAGES * 16; i++) {
+        workload.accesses.push_back(page_key(1, std::min(distance(gen), CACHE_PAGES * 4 - 1)));
+    }
+    return workload;
+}
+
+// Trace lab2 recorded with LAB2_TRACE_DIR: the page numbers of one file, see access-trace.h
+bool load_lab2_trace(FILE *trace, Workload &workload) {
+    AccessTraceInfo info;
+    std::vector<uint64_t> pages;
+    if (!read_trace_pages(trace, info, pages)) {
+        return false;
+    }
+    for (uint64_t page: pages) {
+        auto offset = static_cast<off_t>(page * info.pageSize / PAGE_SIZE * PAGE_SIZE);
+        workload.accesses.push_back({0, static_cast<ino_t>(info.inode), offset});
+    }
+    return true;
+}
+
+// Recorded trace: a trace lab2 wrote, or one access per line, "<inode> <offset>", where lines
+// starting with # are skipped
+bool load_trace(const char *path, Workload &workload) {
+    workload.name = path;
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    char first[ACCESS_TRACE_LINE_MAX];
+    bool lab2_trace = fgets(first, sizeof(first), file) &&
+                      strncmp(first, ACCESS_TRACE_HEADER, strlen(ACCESS_TRACE_HEADER)) == 0;
+    bool loaded = lab2_trace && load_lab2_trace(file, workload);
+    fclose(file);
+    if (lab2_trace) {
+        return loaded;
+    }
+    std::ifstream trace(path);
+    if (!trace) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(trace, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        unsigned long long inode, offset;
+        if (fields >> inode >> offset) {
+            workload.accesses.push_back({0, static_cast<ino_t>(inode),
+                                         static_cast<off_t>(offset / PAGE_SIZE * PAGE_SIZE)});
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<Workload> workloads;
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            Workload workload;
+            if (!load_trace(argv[i], workload)) {
+                std::cerr << "Failed to read trace " << argv[i] << ".\n";
+                return 1;
+            }
+            workloads.push_back(std::move(workload));
+        }
+    } else {
+        workloads = {loop_workload(), hot_scan_workload(), skewed_workload()};
+    }
+
+    std::cout << "workload (" << CACHE_PAGES << " pages of cache)";
+    for (ReplacementPolicy policy: POLICIES) {
+        std::cout << " | " << replacement_policy_name(policy);
+    }
+    std::cout << "\n" << std::fixed << std::setprecision(3);
+    bool scan_resistant = true;
+    for (const Workload &workload: workloads) {
+        std::cout << workload.name << " (" << workload.accesses.size() << " accesses)";
+        double ratios[std::size(POLICIES)];
+        for (size_t i = 0; i < std::size(POLICIES); i++) {
+            ratios[i] = hit_ratio(POLICIES[i], workload);
+            std::cout << " | " << ratios[i];
+        }
+        std::cout << "\n";
+        // On the built-in scans CLOCK-Pro has to keep something, while plain CLOCK keeps nothing useful
+        if (argc == 1 && workload.name != "skewed random, 4x cache" && ratios[2] <= ratios[0]) {
+            scan_resistant = false;
+        }
+    }
+    if (!scan_resistant) {
+        std::cerr << "CLOCK-Pro did not beat CLOCK on a scan.\n";
+        return 1;
+    }
+    return 0;
+}
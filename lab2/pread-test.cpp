@@ -0,0 +1,158 @@
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <random>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "lab2.h"
+
+constexpr size_t PAGE_SIZE = 4096;
+constexpr size_t FILE_BYTES = 4 * 1024 * 1024;
+constexpr int THREADS = 4;
+const char *FILE_NAME = "pread-test.dat";
+
+char expected_byte(size_t offset) {
+    return static_cast<char>('a' + (offset / 7 + offset) % 26);
+}
+
+bool create_file() {
+    int fd = open(FILE_NAME, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        return false;
+    }
+    std::vector<char> data(FILE_BYTES);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = expected_byte(i);
+    }
+    bool ok = write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+    close(fd);
+    return ok;
+}
+
+bool matches(const char *data, size_t length, off_t offset) {
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] != expected_byte(offset + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Threads share one descriptor and read random unaligned ranges with lab2_pread
+bool concurrent_preads(int fd) {
+    bool ok[THREADS];
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([fd, t, &ok] {
+            std::mt19937_64 gen(t);
+            std::uniform_int_distribution<size_t> offset(0, FILE_BYTES - 1);
+            std::uniform_int_distribution<size_t> length(1, 5 * PAGE_SIZE);
+            std::vector<char> buffer(5 * PAGE_SIZE);
+            ok[t] = true;
+            for (int i = 0; i < 2000 && ok[t]; i++) {
+                off_t start = static_cast<off_t>(offset(gen));
+                size_t bytes = std::min(length(gen), FILE_BYTES - start);
+                ok[t] = lab2_pread(fd, buffer.data(), bytes, start) == static_cast<ssize_t>(bytes) &&
+                        matches(buffer.data(), bytes, start);
+            }
+        });
+    }
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+    return std::all_of(std::begin(ok), std::end(ok), [](bool thread_ok) { return thread_ok; });
+}
+
+// One vector of odd-sized segments crossing page boundaries, read past the end of the file
+bool vectored_read(int fd) {
+    char first[100], second[3 * PAGE_SIZE], third[PAGE_SIZE];
+    struct iovec iov[] = {{first, sizeof(first)}, {second, sizeof(second)}, {third, sizeof(third)}};
+    off_t offset = FILE_BYTES - sizeof(first) - sizeof(second) - 10;
+    ssize_t bytes = lab2_preadv(fd, iov, 3, offset);
+    return bytes == static_cast<ssize_t>(sizeof(first) + sizeof(second) + 10) &&
+           matches(first, sizeof(first), offset) && matches(second, sizeof(second), offset + sizeof(first)) &&
+           matches(third, 10, offset + sizeof(first) + sizeof(second));
+}
+
+// lab2_pwritev lands at its offset, does not move the cursor, and reaches the disk on fsync
+bool vectored_write(int fd) {
+    char head[10], tail[PAGE_SIZE + 20];
+    memset(head, 'X', sizeof(head));
+    memset(tail, 'Y', sizeof(tail));
+    struct iovec iov[] = {{head, sizeof(head)}, {tail, sizeof(tail)}};
+    off_t offset = 3 * PAGE_SIZE - 5;
+    off_t cursor = lab2_lseek(fd, 0, SEEK_CUR);
+    if (lab2_pwritev(fd, iov, 2, offset) != static_cast<ssize_t>(sizeof(head) + sizeof(tail)) ||
+        lab2_lseek(fd, 0, SEEK_CUR) != cursor || lab2_fsync(fd) != 0) {
+        return false;
+    }
+    int plain_fd = open(FILE_NAME, O_RDONLY);
+    char check[sizeof(head) + sizeof(tail) + 2];
+    bool ok = plain_fd >= 0 && pread(plain_fd, check, sizeof(check), offset - 1) == sizeof(check) &&
+              check[0] == expected_byte(offset - 1) && check[1] == 'X' && check[sizeof(head)] == 'X' &&
+              check[sizeof(head) + 1] == 'Y' && check[sizeof(check) - 2] == 'Y' &&
+              check[sizeof(check) - 1] == expected_byte(offset + sizeof(head) + sizeof(tail));
+    close(plain_fd);
+    // Put the original bytes back for the next checks
+    std::vector<char> original(sizeof(head) + sizeof(tail));
+    for (size_t i = 0; i < original.size(); i++) {
+        original[i] = expected_byte(offset + i);
+    }
+    return ok && lab2_pwrite(fd, original.data(), original.size(), offset) == static_cast<ssize_t>(original.size());
+}
+
+// Requests bigger than the whole cache: aligned ones go straight to the disk, but must still
+// see a page that is only dirty in the cache; unaligned ones go through the cache
+bool large_reads(int fd) {
+    size_t bytes = 2 * 1024 * 1024;
+    off_t offset = 1024 * 1024;
+    char dirty = 'Z';
+    if (lab2_pwrite(fd, &dirty, 1, offset + 12345) != 1) {
+        return false;
+    }
+    auto *buffer = static_cast<char *>(aligned_alloc(PAGE_SIZE, bytes + PAGE_SIZE));
+    bool ok = lab2_pread(fd, buffer, bytes, offset) == static_cast<ssize_t>(bytes) &&
+              buffer[12345] == dirty && matches(buffer, 12345, offset) &&
+              matches(buffer + 12346, bytes - 12346, offset + 12346);
+    ok = ok && lab2_pread(fd, buffer + 1, bytes, offset + 1) == static_cast<ssize_t>(bytes) &&
+         buffer[12345] == dirty && matches(buffer + 1, 12344, offset + 1);
+    free(buffer);
+    char original = expected_byte(offset + 12345);
+    return ok && lab2_pwrite(fd, &original, 1, offset + 12345) == 1;
+}
+
+int main() {
+    // Smaller than the file, so the large reads do not fit into the cache
+    setenv("LAB2_CACHE_SIZE", "1M", 1);
+    if (!create_file()) {
+        std::cerr << "Failed to create file.\n";
+        return 1;
+    }
+    initialize_library();
+    int fd = lab2_open(FILE_NAME, O_RDWR);
+    if (fd < 0) {
+        std::cerr << "Failed to open file.\n";
+        unlink(FILE_NAME);
+        return 1;
+    }
+
+    int status = 0;
+    const std::pair<const char *, bool (*)(int)> checks[] = {
+            {"concurrent lab2_pread", concurrent_preads},
+            {"lab2_preadv", vectored_read},
+            {"lab2_pwritev", vectored_write},
+            {"large lab2_pread", large_reads},
+    };
+    for (const auto &[name, check]: checks) {
+        bool ok = check(fd);
+        std::cout << name << ": " << (ok ? "ok" : "FAILED") << "\n";
+        status |= !ok;
+    }
+    lab2_close(fd);
+    unlink(FILE_NAME);
+    return status;
+}
@@ -0,0 +1,179 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "lab2.h"
+#include "test-util.h"
+
+// Plain libc calls only: run with LD_PRELOAD=liblab2-preload.so LAB2_PRELOAD_PATHS=preload-cached.dat
+constexpr size_t PAGE_SIZE = 4096;
+constexpr size_t PAGES = 64;
+const char *CACHED_FILE = "preload-cached.dat";
+const char *PLAIN_FILE = "preload-plain.dat";
+const char *SHARED_MEMORY_PATH = "/dev/shm/globalCache_shm";
+
+using get_stats_call = int (*)(pid_t, lab2_stats *);
+
+// Page p holds p + version in every word
+bool write_pages(int fd, uint64_t version) {
+    std::vector<uint64_t> page(PAGE_SIZE / sizeof(uint64_t));
+    for (size_t p = 0; p < PAGES; p++) {
+        std::fill(page.begin(), page.end(), p + version);
+        if (write(fd, page.data(), PAGE_SIZE) != PAGE_SIZE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool read_pages(int fd, uint64_t version) {
+    std::vector<uint64_t> page(PAGE_SIZE / sizeof(uint64_t));
+    for (size_t p = 0; p < PAGES; p++) {
+        if (read(fd, page.data(), PAGE_SIZE) != PAGE_SIZE || page[0] != p + version || page.back() != p + version) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// What is on disk, past any cache: O_DIRECT opens are not intercepted
+bool disk_holds(const char *name, uint64_t version) {
+    int fd = open(name, O_RDONLY | O_DIRECT);
+    auto *page = static_cast<uint64_t *>(aligned_alloc(PAGE_SIZE, PAGE_SIZE));
+    bool ok = fd != -1 && page;
+    for (size_t p = 0; p < PAGES && ok; p++) {
+        ok = pread(fd, page, PAGE_SIZE, static_cast<off_t>(p * PAGE_SIZE)) == PAGE_SIZE && page[0] == p + version;
+    }
+    free(page);
+    if (fd != -1) {
+        close(fd);
+    }
+    return ok;
+}
+
+// The file on disk is exactly size bytes and they are data
+bool disk_file_is(const char *name, const char *data, size_t size) {
+    struct stat file_stat;
+    int fd = open(name, O_RDONLY | O_DIRECT);
+    auto *page = static_cast<char *>(aligned_alloc(PAGE_SIZE, PAGE_SIZE));
+    bool ok = fd != -1 && page && fstat(fd, &file_stat) == 0 && file_stat.st_size == static_cast<off_t>(size) &&
+              pread(fd, page, PAGE_SIZE, 0) == static_cast<ssize_t>(size) && memcmp(page, data, size) == 0;
+    free(page);
+    if (fd != -1) {
+        close(fd);
+    }
+    return ok;
+}
+
+// A process attaches, forks and exits first: the child keeps working on the cache and, as the last
+// user, removes it. Result: '1' written to result_fd once the child has read back its pages
+void outlive_parent(int result_fd) {
+    int fd = open(CACHED_FILE, O_RDWR | O_CREAT | O_TRUNC, 0640);
+    bool ok = fd != -1 && write_pages(fd, 11);
+    std::cout.flush();
+    pid_t parent = getpid();
+    if (ok && fork() == 0) {
+        while (getppid() == parent) {
+            usleep(1000);
+        }
+        ok = lseek(fd, 0, SEEK_SET) == 0 && read_pages(fd, 11) && lseek(fd, 0, SEEK_SET) == 0 &&
+             write_pages(fd, 12) && fsync(fd) == 0 && close(fd) == 0 && access(SHARED_MEMORY_PATH, F_OK) == 0;
+        if (ok && write(result_fd, "1", 1) != 1) {
+            ok = false;
+        }
+        exit(ok ? 0 : 1);
+    }
+    exit(ok ? 0 : 1);
+}
+
+int main() {
+    auto get_stats = reinterpret_cast<get_stats_call>(dlsym(RTLD_DEFAULT, "lab2_get_stats"));
+    if (!check(get_stats != nullptr, "liblab2-preload.so is not loaded.")) {
+        return 1;
+    }
+    umask(022);
+
+    // Nothing is cached yet, so this process is not a user of the cache: the two below are all of them
+    int result[2];
+    if (!check(pipe(result) == 0, "Failed to create pipe.")) {
+        return 1;
+    }
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(result[0]);
+        outlive_parent(result[1]);
+    }
+    close(result[1]);
+    int status;
+    waitpid(pid, &status, 0);
+    char outlived = 0;
+    // EOF once the child is gone, after its exit handlers
+    bool child_reported = read(result[0], &outlived, 1) == 1 && read(result[0], &outlived, 1) == 0;
+    close(result[0]);
+    bool ok = check(WIFEXITED(status) && WEXITSTATUS(status) == 0 && child_reported,
+                    "The child lost the cache when its parent exited.") &&
+              check(disk_holds(CACHED_FILE, 12), "The child's fsync did not reach the disk.") &&
+              check(access(SHARED_MEMORY_PATH, F_OK) != 0, "The last child did not remove the cache.");
+
+    // Created, written, reread and synced through the cache
+    int fd = open(CACHED_FILE, O_RDWR | O_CREAT | O_TRUNC, 0640);
+    lab2_stats before = {}, after = {};
+    struct stat file_stat = {};
+    ok = ok && check(fd != -1 && get_stats(getpid(), &before) == 0, "The cached file did not open through lab2.") &&
+                     check(fstat(fd, &file_stat) == 0 && (file_stat.st_mode & 0777) == 0640,
+                           "The file got a wrong mode.") &&
+                     check(write_pages(fd, 0) && lseek(fd, 0, SEEK_SET) == 0 && read_pages(fd, 0), "Read back failed.");
+    uint64_t record[8] = {1, 2, 3, 4, 5, 6, 7, 8}, reread[8] = {};
+    ok = ok && check(pwrite(fd, record, sizeof(record), 100) == sizeof(record) &&
+                     pread(fd, reread, sizeof(reread), 100) == sizeof(reread) &&
+                     memcmp(record, reread, sizeof(record)) == 0, "Positional read or write failed.");
+    ok = ok && check(get_stats(getpid(), &after) == 0 && after.bytesWritten - before.bytesWritten >= PAGES * PAGE_SIZE &&
+                     after.hits > before.hits, "Calls on the cached file did not go through the cache.");
+
+    // A child that inherited the cached descriptor reads through it and leaves the cache to the parent
+    std::cout.flush();
+    pid = fork();
+    if (pid == 0) {
+        lseek(fd, 0, SEEK_SET);
+        exit(pwrite(fd, record, sizeof(record), 100) == sizeof(record) && read_pages(fd, 0) ? 0 : 1);
+    }
+    waitpid(pid, &status, 0);
+    ok = ok && check(WIFEXITED(status) && WEXITSTATUS(status) == 0, "The forked child read the wrong data.") &&
+         check(access(SHARED_MEMORY_PATH, F_OK) == 0, "The forked child took the cache away from the parent.");
+    ok = ok && check(lseek(fd, 0, SEEK_SET) == 0 && write_pages(fd, 0) &&
+                     fsync(fd) == 0 && close(fd) == 0 && disk_holds(CACHED_FILE, 0), "fsync did not reach the disk.");
+
+    // O_TRUNC drops the old pages of the file from the cache
+    fd = open(CACHED_FILE, O_RDWR | O_TRUNC);
+    char byte;
+    ok = ok && check(fd != -1 && read(fd, &byte, 1) == 0, "The truncated file still had cached data.") &&
+         check(write_pages(fd, 7) && close(fd) == 0 && disk_holds(CACHED_FILE, 7), "Rewrite after O_TRUNC failed.");
+
+    // A short file keeps its size: write-back goes in whole O_DIRECT blocks, the file must not grow with them
+    const char line[] = "short line\n";
+    fd = open(CACHED_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0640);
+    ok = ok && check(fd != -1 && write(fd, line, sizeof(line) - 1) == sizeof(line) - 1 &&
+                     lseek(fd, 0, SEEK_END) == sizeof(line) - 1 && close(fd) == 0 &&
+                     disk_file_is(CACHED_FILE, line, sizeof(line) - 1), "The short file got a wrong size or data.");
+    fd = open(CACHED_FILE, O_RDWR);
+    ok = ok && check(fd != -1 && ftruncate(fd, 5) == 0 && lseek(fd, 0, SEEK_END) == 5 && close(fd) == 0 &&
+                     disk_file_is(CACHED_FILE, line, 5), "ftruncate did not go through the cache.");
+
+    // Paths outside LAB2_PRELOAD_PATHS go to the kernel as they are
+    get_stats(getpid(), &before);
+    fd = open(PLAIN_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ok = ok && check(fd != -1 && write_pages(fd, 3) && lseek(fd, 0, SEEK_SET) == 0 && read_pages(fd, 3) &&
+                     close(fd) == 0, "The plain file failed.");
+    get_stats(getpid(), &after);
+    ok = ok && check(after.bytesRead == before.bytesRead && after.bytesWritten == before.bytesWritten,
+                     "The plain file went through the cache.");
+    unlink(CACHED_FILE);
+    unlink(PLAIN_FILE);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "lab2.h"
+#include "access-trace.h"
+#include "test-util.h"
+
+constexpr size_t PAGE_SIZE = 4096;
+const char *FILE_NAME = "prewarm-bench.dat";
+const char *TRACE_DIR = "prewarm-bench-traces";
+
+// What one run of the job cost, filled in by the child process
+struct Result {
+    double jobMs;               // Prewarm included when the run calls lab2_prewarm
+    uint64_t misses;
+    uint64_t diskPagesRead;
+    bool ok;
+};
+
+enum class Mode {
+    UNTRACED,                   // No LAB2_TRACE_DIR
+    RECORD,                     // First traced run, there is no trace yet
+    PREWARM_ON_OPEN,
+    EXPLICIT_PREWARM,           // LAB2_PREWARM=0 and lab2_prewarm before the job
+};
+
+// The job of a recurring batch run: the same scattered pages of the file in the same order.
+// Page p holds p in every word
+bool run_job(const std::vector<size_t> &order, Mode mode) {
+    if (mode == Mode::EXPLICIT_PREWARM && lab2_prewarm(FILE_NAME) != 0) {
+        return false;
+    }
+    int fd = lab2_open(FILE_NAME, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    std::vector<uint64_t> page(PAGE_SIZE / sizeof(uint64_t));
+    bool ok = true;
+    for (size_t i = 0; i < order.size() && ok; i++) {
+        ok = lab2_pread(fd, page.data(), PAGE_SIZE, static_cast<off_t>(order[i] * PAGE_SIZE)) == PAGE_SIZE &&
+             page[0] == order[i] && page.back() == order[i];
+    }
+    lab2_close(fd);
+    return ok;
+}
+
+bool run(const std::vector<size_t> &order, size_t file_pages, Mode mode, Result &result) {
+    bool exited = run_in_child(result, [&](Result &shared) {
+        // A fresh cache that holds the whole file: every miss is a cold one
+        setenv("LAB2_CACHE_SIZE", std::to_string(2 * file_pages * PAGE_SIZE).c_str(), 1);
+        if (mode != Mode::UNTRACED) {
+            setenv("LAB2_TRACE_DIR", TRACE_DIR, 1);
+        }
+        if (mode == Mode::EXPLICIT_PREWARM) {
+            setenv("LAB2_PREWARM", "0", 1);
+        }
+        initialize_library();
+        lab2_stats before, after;
+        lab2_get_stats(getpid(), &before);
+        auto start = std::chrono::steady_clock::now();
+        shared.ok = run_job(order, mode);
+        auto end = std::chrono::steady_clock::now();
+        lab2_get_stats(getpid(), &after);
+        shared.jobMs = std::chrono::duration<double, std::milli>(end - start).count();
+        shared.misses = after.misses - before.misses;
+        shared.diskPagesRead = (after.diskBytesRead - before.diskBytesRead) / PAGE_SIZE;
+        return true;
+    });
+    return exited && result.ok;
+}
+
+// The trace of the recording run: the file's inode, then every page read, in order
+bool trace_matches(const std::vector<size_t> &order) {
+    std::vector<std::string> traces;
+    std::string command = std::string("ls ") + TRACE_DIR;
+    FILE *list = popen(command.c_str(), "r");
+    char name[256];
+    while (list && fgets(name, sizeof(name), list)) {
+        traces.emplace_back(std::string(TRACE_DIR) + "/" + strtok(name, "\n"));
+    }
+    if (list) {
+        pclose(list);
+    }
+    FILE *trace = traces.size() == 1 ? fopen(traces[0].c_str(), "r") : nullptr;
+    if (!trace) {
+        return false;
+    }
+    struct stat file_stat;
+    stat(FILE_NAME, &file_stat);
+    char line[ACCESS_TRACE_LINE_MAX];
+    AccessTraceInfo info;
+    std::vector<uint64_t> pages;
+    bool ok = fgets(line, sizeof(line), trace) &&
+              strncmp(line, ACCESS_TRACE_HEADER, strlen(ACCESS_TRACE_HEADER)) == 0 &&
+              read_trace_pages(trace, info, pages) && info.inode == file_stat.st_ino && info.pageSize == PAGE_SIZE;
+    fclose(trace);
+    return ok && std::equal(pages.begin(), pages.end(), order.begin(), order.end());
+}
+
+void remove_traces() {
+    std::string command = std::string("rm -rf ") + TRACE_DIR;
+    if (system(command.c_str()) != 0) {
+        std::cerr << "Failed to remove " << TRACE_DIR << ".\n";
+    }
+}
+
+int main(int argc, char *argv[]) {
+    size_t file_mb = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 64;
+    size_t reads = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 8192;
+    size_t file_pages = file_mb * 1024 * 1024 / PAGE_SIZE;
+    if (file_pages == 0 || reads == 0 || reads > file_pages) {
+        std::cerr << "Usage: prewarm-bench [file_mb] [page reads, at most the pages of the file]\n";
+        return 1;
+    }
+    bool ok = create_numbered_file(FILE_NAME, file_pages, PAGE_SIZE);
+    // Distinct pages in a shuffled order: no readahead can guess it
+    std::vector<size_t> order(file_pages);
+    for (size_t p = 0; p < file_pages; p++) {
+        order[p] = p;
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937_64(7));
+    order.resize(reads);
+
+    remove_traces();
+    const std::pair<const char *, Mode> runs[] = {
+            {"no trace dir", Mode::UNTRACED},
+            {"first run, records", Mode::RECORD},
+            {"prewarm on open", Mode::PREWARM_ON_OPEN},
+            {"lab2_prewarm first", Mode::EXPLICIT_PREWARM},
+    };
+    // A discarded run first: the first pass over a freshly written file is slower below the cache
+    Result results[4] = {};
+    ok = ok && run(order, file_pages, Mode::UNTRACED, results[0]);
+    for (size_t i = 0; i < 4 && ok; i++) {
+        ok = run(order, file_pages, runs[i].second, results[i]);
+        if (ok && runs[i].second == Mode::RECORD && !trace_matches(order)) {
+            std::cerr << "The recorded trace does not list the pages in the order they were read.\n";
+            ok = false;
+        }
+    }
+    remove_traces();
+    unlink(FILE_NAME);
+    if (!ok) {
+        std::cerr << "Run failed or a page read back wrong.\n";
+        return 1;
+    }
+
+    std::cout << file_mb << " MB file, " << reads << " scattered page reads in the same order every run\n";
+    std::cout << "run | job, ms | misses | pages read from disk\n";
+    for (size_t i = 0; i < 4; i++) {
+        std::cout << runs[i].first << " | " << results[i].jobMs << " | " << results[i].misses << " | "
+                  << results[i].diskPagesRead << "\n";
+    }
+    const Result &recorded = results[1], &on_open = results[2], &explicit_prewarm = results[3];
+    if (on_open.misses * 4 > recorded.misses || explicit_prewarm.misses * 4 > recorded.misses) {
+        std::cerr << "Prewarming from the trace did not remove most cold misses.\n";
+        return 1;
+    }
+    return 0;
+}
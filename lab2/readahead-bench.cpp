@@ -0,0 +1,98 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lab2.h"
+#include "test-util.h"
+
+#define BUFFER_SIZE 32768 // 32 KiB, the chunk size ema-search-str reads with
+
+struct ScanResult {
+    unsigned long long syscalls;
+    unsigned long long bytes;
+    unsigned long long checksum;
+    double seconds;
+};
+
+// Read syscalls of this process so far (preadv counts as one)
+unsigned long long read_syscalls() {
+    std::ifstream io("/proc/self/io");
+    std::string name;
+    unsigned long long value;
+    while (io >> name >> value) {
+        if (name == "syscr:") {
+            return value;
+        }
+    }
+    return 0;
+}
+
+// Cold scan of the file through a fresh shared cache, in the child process
+ScanResult scan(const char *filename) {
+    ScanResult result = {0, 0, 0, 0};
+    initialize_library();
+    char buffer[BUFFER_SIZE];
+    unsigned long long syscalls_before = read_syscalls();
+    auto start = std::chrono::steady_clock::now();
+
+    int fd = lab2_open(filename, O_RDONLY);
+    if (fd == -1) {
+        std::cerr << "Error opening file" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    ssize_t bytes_read;
+    while ((bytes_read = lab2_read(fd, buffer, BUFFER_SIZE)) > 0) {
+        for (ssize_t i = 0; i < bytes_read; i++) {
+            result.checksum = result.checksum * 31 + static_cast<unsigned char>(buffer[i]);
+        }
+        result.bytes += bytes_read;
+    }
+    lab2_close(fd);
+
+    auto end = std::chrono::steady_clock::now();
+    result.seconds = std::chrono::duration<double>(end - start).count();
+    result.syscalls = read_syscalls() - syscalls_before;
+    return result;
+}
+
+bool run(const char *filename, const char *readahead, ScanResult &result) {
+    return run_in_child(result, [&](ScanResult &shared) {
+        setenv("LAB2_READAHEAD_MAX", readahead, 1);
+        // Reads through io_uring do not show up in syscr, so count plain preadv
+        setenv("LAB2_IO_URING", "0", 1);
+        shared = scan(filename);
+        return true;
+    });
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <filename>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    ScanResult without_readahead, with_readahead;
+    if (!run(argv[1], "0", without_readahead) || !run(argv[1], "64", with_readahead)) {
+        std::cerr << "Scan failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    for (auto &[name, result]: {std::pair{"no readahead", without_readahead},
+                                std::pair{"readahead", with_readahead}}) {
+        std::cout << name << ": " << result.syscalls << " read syscalls, "
+                  << static_cast<double>(result.bytes) / result.seconds / (1024 * 1024) << " MB/s" << std::endl;
+    }
+
+    if (with_readahead.checksum != without_readahead.checksum || with_readahead.bytes != without_readahead.bytes) {
+        std::cerr << "Readahead returned different data" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (with_readahead.syscalls >= without_readahead.syscalls) {
+        std::cerr << "Readahead did not reduce read syscalls" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
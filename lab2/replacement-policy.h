@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "page-index.h"
+#include "frame-bitmap.h"
+
+// Политика вытеснения общего кэша. Выбирается один раз, когда первый процесс размечает память
+enum class ReplacementPolicy : uint32_t {
+    CLOCK,      // Обычный клок по биту used
+    TWO_Q,      // 2Q: новые страницы идут в A1in (FIFO), в Am попадают только вернувшиеся из A1out
+    CLOCK_PRO,  // Клок с горячими и холодными страницами и адаптивной долей горячих
+};
+
+inline const char *replacement_policy_name(ReplacementPolicy policy) {
+    switch (policy) {
+        case ReplacementPolicy::TWO_Q:
+            return "2q";
+        case ReplacementPolicy::CLOCK_PRO:
+            return "clock-pro";
+        default:
+            return "clock";
+    }
+}
+
+inline bool parse_replacement_policy(const char *name, ReplacementPolicy &policy) {
+    for (ReplacementPolicy candidate: {ReplacementPolicy::CLOCK, ReplacementPolicy::TWO_Q,
+                                       ReplacementPolicy::CLOCK_PRO}) {
+        if (strcmp(name, replacement_policy_name(candidate)) == 0) {
+            policy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Состояние политики вытеснения. Живет в общей памяти, поэтому без указателей и виртуальных
+// функций - политика хранится номером. Все три политики сделаны клоком по фреймам: стрелка
+// идет по кругу словами битмапов, по 64 фрейма за шаг, а политика решает, кого из них можно
+// вытеснять. Так попадание остается установкой бита used и не требует блокировок.
+// Флаги фреймов - битмапы used и hot. hot - страница в Am у 2Q или горячая у CLOCK-Pro;
+// холодные страницы - это A1in у 2Q и холодные у CLOCK-Pro.
+// Призраки - ключи недавно вытесненных холодных страниц: если страница возвращается, пока
+// ее призрак жив, она считается повторно используемой и становится горячей (у CLOCK-Pro - если
+// горячих меньше hotTarget). Вернувшийся призрак растит hotTarget, истекший без возврата - уменьшает.
+// Призраки лежат в отдельном PageIndex на frames слотов (слот кольца -> ключ вытесненной страницы).
+// Трогают его только remember_evicted/take_ghost, их вызывающий сериализует сам
+struct ReplacementState {
+    ReplacementPolicy policy;
+    size_t frames;                  // Число фреймов кэша
+    std::atomic<size_t> hand;       // Стрелка клока
+    std::atomic<size_t> hotCount;   // Число горячих фреймов
+    std::atomic<size_t> hotTarget;  // CLOCK-Pro: сколько горячих держать, подстраивается под нагрузку
+    size_t twoQColdPages;           // Kin: размер A1in у 2Q
+    size_t minHotPages;             // CLOCK-Pro: скан не выдавит горячих ниже этого
+    size_t maxHotPages;             // CLOCK-Pro: холодным всегда оставляем место
+    size_t ghostLimit;              // Сколько призраков помним (Kout у 2Q)
+    size_t ghostHand;               // Следующий слот кольца призраков
+
+    void init(ReplacementPolicy replacement_policy, size_t frame_count) {
+        policy = replacement_policy;
+        frames = frame_count;
+        hand.store(0, std::memory_order_relaxed);
+        hotCount.store(0, std::memory_order_relaxed);
+        hotTarget.store(frames / 2, std::memory_order_relaxed);
+        twoQColdPages = frames / 4;
+        minHotPages = frames / 4;
+        maxHotPages = frames - frames / 100 - 1;
+        ghostLimit = policy == ReplacementPolicy::TWO_Q ? std::max<size_t>(frames / 2, 1) : frames;
+        ghostHand = 0;
+    }
+
+    bool uses_ghosts() const {
+        return policy != ReplacementPolicy::CLOCK;
+    }
+
+    // Следующее слово битмапов под стрелкой
+    size_t next_word() {
+        return hand.fetch_add(1, std::memory_order_relaxed) % FrameBitmap::words_for(frames);
+    }
+
+    // Стрелка проходит 64 фрейма слова word: политика снимает и ставит биты и возвращает маску
+    // фреймов, которые можно вытеснять. resident - сколько фреймов сейчас занято страницами.
+    // Закреплен ли фрейм и есть ли в нем страница, смотрит вызывающий
+    uint64_t sweep_word(size_t word, FrameBitmap &used, FrameBitmap &hot, size_t resident) {
+        uint64_t valid = used.valid_mask(word);
+        std::atomic<uint64_t> &used_word = used.words()[word];
+        std::atomic<uint64_t> &hot_word = hot.words()[word];
+        switch (policy) {
+            case ReplacementPolicy::TWO_Q: {
+                // Клок идет только по Am. A1in - очередь: обращения к странице в ней не спасают,
+                // пока очередь длиннее Kin (или в кэше есть пустые фреймы)
+                uint64_t hot_bits = hot_word.load(std::memory_order_relaxed);
+                uint64_t referenced = used_word.fetch_and(~hot_bits, std::memory_order_relaxed);
+                uint64_t evictable = hot_bits & ~referenced;
+                size_t cold = resident - std::min(resident, hotCount.load(std::memory_order_relaxed));
+                if (cold > twoQColdPages || resident < frames) {
+                    evictable |= ~hot_bits;
+                }
+                return evictable & valid;
+            }
+            case ReplacementPolicy::CLOCK_PRO: {
+                uint64_t hot_bits = hot_word.load(std::memory_order_relaxed);
+                uint64_t referenced = used_word.exchange(0, std::memory_order_relaxed);
+                // Холодную страницу трогали с момента загрузки - значит, ее используют повторно
+                uint64_t promote = ~hot_bits & referenced & valid;
+                if (promote) {
+                    uint64_t before = hot_word.fetch_or(promote, std::memory_order_relaxed);
+                    hotCount.fetch_add(__builtin_popcountll(promote & ~before), std::memory_order_relaxed);
+                }
+                // Горячие без обращений остывают, пока горячих больше цели
+                uint64_t idle_hot = hot_bits & ~referenced;
+                while (idle_hot && hotCount.load(std::memory_order_relaxed) > hotTarget.load(std::memory_order_relaxed)) {
+                    uint64_t bit = idle_hot & -idle_hot;
+                    idle_hot &= idle_hot - 1;
+                    if (hot_word.fetch_and(~bit, std::memory_order_relaxed) & bit) {
+                        hotCount.fetch_sub(1, std::memory_order_relaxed);
+                    }
+                }
+                return ~hot_bits & ~referenced & valid;
+            }
+            default:
+                return ~used_word.exchange(0, std::memory_order_relaxed) & valid;
+        }
+    }
+
+    // Кандидат из маски sweep_word все еще годится: его не трогали с тех пор, как прошла стрелка
+    bool still_evictable(size_t frame, const FrameBitmap &used, const FrameBitmap &hot) const {
+        if (policy == ReplacementPolicy::TWO_Q && !hot.test(frame, std::memory_order_relaxed)) {
+            return true;
+        }
+        return !used.test(frame, std::memory_order_relaxed);
+    }
+
+    // Фрейм захвачен для вытеснения. true - страница была холодной и ее стоит запомнить призраком
+    bool evicted(size_t frame, FrameBitmap &hot) {
+        if (hot.clear(frame, std::memory_order_relaxed)) {
+            hotCount.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+        }
+        return uses_ghosts();
+    }
+
+    // Запоминаем вытесненную холодную страницу, затирая самого старого призрака.
+    // Если старый призрак так и не вернулся, CLOCK-Pro держит чуть меньше горячих, но не меньше четверти кэша
+    void remember_evicted(PageIndex &ghosts, const PageKey &key) {
+        auto slot = static_cast<int32_t>(ghostHand);
+        ghostHand = (ghostHand + 1) % ghostLimit;
+        if (ghosts.nodes()[slot].linked) {
+            ghosts.remove(slot);
+            size_t target = hotTarget.load(std::memory_order_relaxed);
+            if (policy == ReplacementPolicy::CLOCK_PRO && target > minHotPages) {
+                hotTarget.store(target - 1, std::memory_order_relaxed);
+            }
+        }
+        ghosts.insert(slot, key);
+    }
+
+    // Страница снова грузится. true - ее призрак был жив
+    bool take_ghost(PageIndex &ghosts, const PageKey &key) {
+        int32_t slot = ghosts.find(key);
+        if (slot == NO_FRAME) {
+            return false;
+        }
+        ghosts.remove(slot);
+        size_t target = hotTarget.load(std::memory_order_relaxed);
+        if (policy == ReplacementPolicy::CLOCK_PRO && target < maxHotPages) {
+            hotTarget.store(target + 1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    // Страница только что загружена во фрейм. Загрузка сама по себе обращением не считается
+    // (кроме обычного клока), иначе один проход по большому файлу сделал бы горячим все подряд
+    void loaded(size_t frame, FrameBitmap &used, FrameBitmap &hot, bool ghost_hit) {
+        bool make_hot = ghost_hit && (policy == ReplacementPolicy::TWO_Q || hotCount.load(std::memory_order_relaxed) <
+                                                                          hotTarget.load(std::memory_order_relaxed));
+        if (policy == ReplacementPolicy::CLOCK || make_hot) {
+            used.set(frame, std::memory_order_relaxed);
+        } else {
+            used.clear(frame, std::memory_order_relaxed);
+        }
+        if (make_hot && !hot.set(frame, std::memory_order_relaxed)) {
+            hotCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+};
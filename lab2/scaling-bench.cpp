@@ -0,0 +1,79 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "lab2.h"
+#include "test-util.h"
+
+
+constexpr size_t PAGE_SIZE = 4096;
+constexpr size_t FILE_PAGES = 2048; // 8 MiB, fits into the cache
+const char *FILE_NAME = "scaling-bench.dat";
+
+// One worker: random page-sized reads through the shared cache
+int worker(size_t operations, unsigned seed) {
+    initialize_library();
+    int fd = lab2_open(FILE_NAME, O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open file.\n";
+        return 1;
+    }
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<size_t> dis(0, FILE_PAGES - 1);
+    std::vector<uint64_t> buffer(PAGE_SIZE / sizeof(uint64_t));
+    for (size_t op = 0; op < operations; op++) {
+        size_t page = dis(gen);
+        lab2_lseek(fd, static_cast<off_t>(page * PAGE_SIZE), SEEK_SET);
+        if (lab2_read(fd, buffer.data(), PAGE_SIZE) != PAGE_SIZE ||
+            buffer[0] != page * PAGE_SIZE || buffer.back() != page * PAGE_SIZE + PAGE_SIZE - sizeof(uint64_t)) {
+            std::cerr << "Wrong data for page " << page << ".\n";
+            lab2_close(fd);
+            return 1;
+        }
+    }
+    lab2_close(fd);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int max_processes = argc > 1 ? std::atoi(argv[1]) : 12;
+    size_t operations = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100000;
+
+    if (!create_offset_file(FILE_NAME, FILE_PAGES, PAGE_SIZE)) {
+        std::cerr << "Failed to create " << FILE_NAME << ".\n";
+        return 1;
+    }
+
+    int status_total = 0;
+    for (int processes = 1; processes <= max_processes; processes++) {
+        std::cout.flush();
+        auto start = std::chrono::steady_clock::now();
+        std::vector<pid_t> children;
+        for (int p = 0; p < processes; p++) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                exit(worker(operations, 1000 + p));
+            }
+            children.push_back(pid);
+        }
+        for (pid_t pid: children) {
+            int status;
+            waitpid(pid, &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                status_total = 1;
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        std::cout << processes << " processes: "
+                  << static_cast<double>(operations * processes) / seconds << " ops/s\n";
+    }
+
+    unlink(FILE_NAME);
+    return status_total;
+}
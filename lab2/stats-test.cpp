@@ -0,0 +1,119 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "lab2.h"
+#include "test-util.h"
+
+constexpr size_t PAGE_SIZE = 4096;
+constexpr size_t PAGES = 32;
+const char *FILE_NAME = "stats-test.dat";
+
+bool read_whole_file(int fd) {
+    std::vector<char> buffer(PAGE_SIZE);
+    lab2_lseek(fd, 0, SEEK_SET);
+    for (size_t p = 0; p < PAGES; p++) {
+        if (lab2_read(fd, buffer.data(), PAGE_SIZE) != PAGE_SIZE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Runs lab2-stat once in JSON mode and returns what it printed
+std::string run_stat_cli(const char *path) {
+    int pipe_fd[2];
+    if (pipe(pipe_fd) == -1) {
+        return "";
+    }
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(pipe_fd[1], STDOUT_FILENO);
+        close(pipe_fd[0]);
+        close(pipe_fd[1]);
+        execl(path, path, "--json", "--processes", "--latency", "0", nullptr);
+        _exit(127);
+    }
+    close(pipe_fd[1]);
+    std::string output;
+    char chunk[4096];
+    ssize_t bytes;
+    while ((bytes = read(pipe_fd[0], chunk, sizeof(chunk))) > 0) {
+        output.append(chunk, bytes);
+    }
+    close(pipe_fd[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? output : "";
+}
+
+uint64_t calls(const lab2_latency &latency, lab2_latency_kind kind) {
+    uint64_t count = 0;
+    for (uint64_t bucket: latency.buckets[kind]) {
+        count += bucket;
+    }
+    return count;
+}
+
+int main(int argc, char *argv[]) {
+    int create_fd = open(FILE_NAME, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (create_fd < 0 || ftruncate(create_fd, PAGES * PAGE_SIZE) != 0) {
+        std::cerr << "Failed to create file.\n";
+        return 1;
+    }
+    close(create_fd);
+    initialize_library();
+    int fd = lab2_open(FILE_NAME, O_RDWR);
+    if (fd < 0) {
+        std::cerr << "Failed to open file.\n";
+        return 1;
+    }
+
+    lab2_stats before, cold, warm, global;
+    bool ok = lab2_get_stats(getpid(), &before) == 0 && read_whole_file(fd) &&
+              lab2_get_stats(getpid(), &cold) == 0 && read_whole_file(fd) &&
+              lab2_get_stats(getpid(), &warm) == 0;
+    ok = check(ok, "Reading the file or the counters failed.") &&
+         check(cold.misses > before.misses && cold.diskBytesRead - before.diskBytesRead == PAGES * PAGE_SIZE,
+               "The cold pass did not count misses and disk reads.") &&
+         check(warm.hits - cold.hits == PAGES && warm.misses == cold.misses,
+               "The warm pass did not count only hits.") &&
+         check(warm.l1Hits > cold.l1Hits && warm.l1Hits <= warm.hits, "The warm pass found nothing in the L1.") &&
+         check(warm.bytesRead - before.bytesRead == 2 * PAGES * PAGE_SIZE, "Wrong count of bytes read.");
+
+    std::vector<char> page(PAGE_SIZE, 'x');
+    ok = ok && check(lab2_write(fd, page.data(), PAGE_SIZE) == PAGE_SIZE && lab2_fsync(fd) == 0, "Write failed.");
+    ok = ok && lab2_get_stats(getpid(), &warm) == 0 && lab2_get_stats(0, &global) == 0 &&
+         check(warm.bytesWritten == PAGE_SIZE && warm.writebackPages >= 1, "Write-back was not counted.") &&
+         check(global.hits >= warm.hits && global.cachePages > 0 && global.residentPages >= PAGES,
+               "Global counters are behind this process.");
+
+    // Every call lands in exactly one histogram: the cold pass had misses, the warm one only hits
+    lab2_latency latency;
+    ok = ok && check(lab2_get_latency(getpid(), &latency) == 0, "No latency histograms.") &&
+         check(calls(latency, LAB2_LATENCY_OPEN) == 1 && calls(latency, LAB2_LATENCY_FSYNC) == 1 &&
+               calls(latency, LAB2_LATENCY_WRITE_HIT) + calls(latency, LAB2_LATENCY_WRITE_MISS) == 1,
+               "Open, fsync or write were not timed once.") &&
+         check(calls(latency, LAB2_LATENCY_READ_MISS) > 0 &&
+               calls(latency, LAB2_LATENCY_READ_HIT) + calls(latency, LAB2_LATENCY_READ_L1) >= PAGES &&
+               calls(latency, LAB2_LATENCY_READ_HIT) + calls(latency, LAB2_LATENCY_READ_MISS) +
+               calls(latency, LAB2_LATENCY_READ_L1) == 2 * PAGES,
+               "Reads were not split into hits and misses.") &&
+         check(calls(latency, LAB2_LATENCY_READ_L1) == warm.l1Hits, "L1 hits and L1 reads disagree.") &&
+         check(calls(latency, LAB2_LATENCY_DISK_IO) > 0, "Disk I/O was not timed.");
+
+    if (ok && argc > 1) {
+        std::string output = run_stat_cli(argv[1]);
+        std::cout << output;
+        ok = check(output.find("\"pid\":" + std::to_string(getpid())) != std::string::npos &&
+                   output.find("\"hits\":") != std::string::npos && output.find("\"read_miss\":") != std::string::npos,
+                   "lab2-stat did not report this process.");
+    }
+    lab2_close(fd);
+    unlink(FILE_NAME);
+    return ok ? 0 : 1;
+}
@@ -5,18 +5,9 @@
 #include <random>
 #include <cstring>
 #include <cstdlib>
+#include "lab2.h"
 
 
-extern "C" {
-int lab2_open(const char *path, int flags);
-int lab2_close(int fd);
-ssize_t lab2_read(int fd, void *buf, size_t count);
-ssize_t lab2_write(int fd, const void *buf, size_t count);
-off_t lab2_lseek(int fd, off_t offset, int whence);
-int lab2_fsync(int fd);
-void initialize_library();
-}
-
 constexpr size_t PAGE_SIZE = 4096;
 
 int main() {
@@ -103,6 +94,8 @@ int main() {
     }
     std::cout << "Allocated new_control_buffer at address: " << static_cast<void *>(new_control_buffer) << "\n";
 
+    // The whole file is read again and again
+    lab2_fadvise(fd, 0, buf_size, POSIX_FADV_WILLNEED);
     for (int i = 0; i < 10; i++) {
         lab2_lseek(fd, 0, SEEK_SET);
 
@@ -153,6 +146,50 @@ int main() {
         std::cout << "Iteration " << i << " completed successfully.\n";
     }
 
+    // Read the file once more through pinned page views and compare with the control copy
+    lab2_lseek(fd, 0, SEEK_SET);
+    size_t viewed = 0;
+    lab2_view view;
+    ssize_t view_bytes;
+    while (viewed < buf_size && (view_bytes = lab2_read_view(fd, buf_size - viewed, &view)) > 0) {
+        bool equal = memcmp(view.data, new_control_buffer + viewed, view_bytes) == 0;
+        lab2_unpin_view(&view);
+        if (!equal) {
+            std::cerr << "Page view differs from control file at offset " << viewed << ".\n";
+            break;
+        }
+        viewed += view_bytes;
+    }
+    if (viewed != buf_size) {
+        std::cerr << "Error reading file through views. Bytes viewed: " << viewed << " Expected: " << buf_size
+                  << "\n";
+        free(new_buffer);
+        free(new_control_buffer);
+        free(buffer);
+        lab2_close(fd);
+        close(control_fd);
+        return 1;
+    }
+
+    // Drop the file from the cache: the dirty pages must reach the disk first, and the next read
+    // has to load them again
+    int plain_fd = open("testfile.txt", O_RDONLY);
+    bool dropped = lab2_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0 && plain_fd >= 0 &&
+                   pread(plain_fd, new_buffer, buf_size, 0) == static_cast<ssize_t>(buf_size) &&
+                   memcmp(new_buffer, new_control_buffer, buf_size) == 0 &&
+                   lab2_pread(fd, new_buffer, buf_size, 0) == static_cast<ssize_t>(buf_size) &&
+                   memcmp(new_buffer, new_control_buffer, buf_size) == 0;
+    close(plain_fd);
+    if (!dropped) {
+        std::cerr << "File differs from control file after lab2_fadvise DONTNEED.\n";
+        free(new_buffer);
+        free(new_control_buffer);
+        free(buffer);
+        lab2_close(fd);
+        close(control_fd);
+        return 1;
+    }
+
     std::cout << "Freeing buffers...\n";
     free(new_buffer);
     free(new_control_buffer);
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+// Helpers shared by the tests and benchmarks of lab2
+
+// Prints message when the condition fails, so checks chain with &&
+inline bool check(bool condition, const char *message) {
+    if (!condition) {
+        std::cerr << message << "\n";
+    }
+    return condition;
+}
+
+// Creates name from pages blocks of block_size bytes, past the cache. fill(p, block) fills block p
+template <typename Word = char, typename Fill>
+bool create_file(const char *name, size_t pages, size_t block_size, Fill fill) {
+    int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        return false;
+    }
+    std::vector<Word> block(block_size / sizeof(Word));
+    bool ok = true;
+    for (size_t p = 0; p < pages && ok; p++) {
+        fill(p, block);
+        ok = write(fd, block.data(), block_size) == static_cast<ssize_t>(block_size);
+    }
+    close(fd);
+    return ok;
+}
+
+// Every 8-byte word of page p holds p, so a reader can tell which page it got
+inline bool create_numbered_file(const char *name, size_t pages, size_t page_size) {
+    return create_file<uint64_t>(name, pages, page_size, [](size_t p, std::vector<uint64_t> &page) {
+        std::fill(page.begin(), page.end(), p);
+    });
+}
+
+// Every 8-byte word of the file holds its own offset, so readers can verify what they got
+inline bool create_offset_file(const char *name, size_t pages, size_t page_size) {
+    return create_file<uint64_t>(name, pages, page_size, [page_size](size_t p, std::vector<uint64_t> &page) {
+        for (size_t i = 0; i < page.size(); i++) {
+            page[i] = p * page_size + i * sizeof(uint64_t);
+        }
+    });
+}
+
+// A file of size bytes that are all holes, past the cache
+inline bool create_sparse_file(const char *name, off_t size) {
+    int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ftruncate(fd, size) == 0;
+    close(fd);
+    return ok;
+}
+
+// Runs child(result) in a forked process, a fresh user of the cache: what it sets in the environment
+// applies to its own initialize_library. result lives in shared memory, so a child that ends with
+// _exit still reports. false if the child returned false or did not exit cleanly
+template <typename Result, typename Child>
+bool run_in_child(Result &result, Child child) {
+    auto *shared = static_cast<Result *>(mmap(nullptr, sizeof(Result), PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (shared == MAP_FAILED) {
+        return false;
+    }
+    *shared = {};
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        exit(child(*shared) ? 0 : 1);
+    }
+    int status = 0;
+    bool exited = pid != -1 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    result = *shared;
+    munmap(shared, sizeof(Result));
+    return exited;
+}
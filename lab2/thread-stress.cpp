@@ -0,0 +1,167 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lab2.h"
+#include "test-util.h"
+
+constexpr size_t PAGE_SIZE = 4096;
+constexpr size_t SHARED_PAGES = 64;         // Read-only part of every file, checked by all threads
+constexpr size_t THREAD_PAGES = 16;         // Part of every file that only one thread writes
+constexpr int FILES = 8;
+constexpr int OPENS_PER_FILE = 4;           // Descriptors per file shared by all threads
+
+std::string file_name(int file) {
+    return "thread-stress-" + std::to_string(file) + ".dat";
+}
+
+// Every 8-byte word of the shared part holds its own offset, the thread parts are holes
+bool create_files(int threads) {
+    auto size = static_cast<off_t>((SHARED_PAGES + threads * THREAD_PAGES) * PAGE_SIZE);
+    for (int file = 0; file < FILES; file++) {
+        std::string name = file_name(file);
+        if (!create_offset_file(name.c_str(), SHARED_PAGES, PAGE_SIZE) || truncate(name.c_str(), size) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct Worker {
+    const std::vector<int> *fds = nullptr;
+    int plainFd = -1;           // Open in the kernel, but not through lab2_open
+    int thread = 0;
+    size_t operations = 0;
+    size_t done = 0;
+    std::string error;
+
+    bool fail(const std::string &message) {
+        error = "thread " + std::to_string(thread) + ": " + message;
+        return false;
+    }
+
+    // Mix of positional reads and writes on shared descriptors, cursor reads on a private one,
+    // open/close churn and calls on a descriptor lab2 does not know
+    bool run() {
+        std::mt19937_64 gen(thread);
+        std::uniform_int_distribution<size_t> pick_fd(0, fds->size() - 1);
+        std::uniform_int_distribution<size_t> shared_page(0, SHARED_PAGES - 1);
+        std::uniform_int_distribution<size_t> own_page(0, THREAD_PAGES - 1);
+        std::vector<uint64_t> buffer(PAGE_SIZE / sizeof(uint64_t));
+        uint64_t version = 0;
+        for (; done < operations; done++) {
+            size_t fd_index = pick_fd(gen);
+            int fd = (*fds)[fd_index];
+            size_t kind = done % 8;
+            if (kind < 4) {
+                size_t page = shared_page(gen);
+                if (lab2_pread(fd, buffer.data(), PAGE_SIZE, static_cast<off_t>(page * PAGE_SIZE)) != PAGE_SIZE ||
+                    buffer[1] != page * PAGE_SIZE + sizeof(uint64_t)) {
+                    return fail("wrong shared page " + std::to_string(page));
+                }
+            } else if (kind < 7) {
+                // Pages of this thread: write a new version and read it back, maybe through another
+                // descriptor of the same file
+                off_t offset = static_cast<off_t>((SHARED_PAGES + thread * THREAD_PAGES + own_page(gen)) * PAGE_SIZE);
+                std::fill(buffer.begin(), buffer.end(), ++version);
+                if (lab2_pwrite(fd, buffer.data(), PAGE_SIZE, offset) != PAGE_SIZE) {
+                    return fail("pwrite failed");
+                }
+                int other_fd = (*fds)[fd_index / OPENS_PER_FILE * OPENS_PER_FILE + gen() % OPENS_PER_FILE];
+                if (lab2_pread(other_fd, buffer.data(), PAGE_SIZE, offset) != PAGE_SIZE ||
+                    buffer[0] != version || buffer.back() != version) {
+                    return fail("lost own write");
+                }
+            } else {
+                int own_fd = lab2_open(file_name(thread % FILES).c_str(), O_RDONLY);
+                if (own_fd < 0) {
+                    return fail("open failed");
+                }
+                size_t page = shared_page(gen);
+                if (lab2_lseek(own_fd, static_cast<off_t>(page * PAGE_SIZE), SEEK_SET) < 0 ||
+                    lab2_read(own_fd, buffer.data(), PAGE_SIZE) != PAGE_SIZE ||
+                    buffer[0] != page * PAGE_SIZE || lab2_close(own_fd) != 0) {
+                    return fail("cursor read on a private descriptor failed");
+                }
+                errno = 0;
+                if (lab2_read(plainFd, buffer.data(), PAGE_SIZE) != -1 || errno != EBADF) {
+                    return fail("read on a foreign descriptor did not fail with EBADF");
+                }
+            }
+        }
+        return true;
+    }
+};
+
+int main(int argc, char *argv[]) {
+    int threads = argc > 1 ? std::atoi(argv[1]) : 16;
+    size_t operations = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 20000;
+
+    if (!create_files(threads)) {
+        std::cerr << "Failed to create files.\n";
+        return 1;
+    }
+    initialize_library();
+    std::vector<int> fds;
+    for (int file = 0; file < FILES; file++) {
+        for (int i = 0; i < OPENS_PER_FILE; i++) {
+            int fd = lab2_open(file_name(file).c_str(), O_RDWR);
+            if (fd < 0) {
+                std::cerr << "Failed to open " << file_name(file) << ".\n";
+                return 1;
+            }
+            fds.push_back(fd);
+        }
+    }
+
+    int plain_fd = open(file_name(0).c_str(), O_RDONLY);
+    std::vector<Worker> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.push_back({&fds, plain_fd, t, operations, 0, {}});
+    }
+    std::atomic<bool> ok = true;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> running;
+    for (Worker &worker: workers) {
+        running.emplace_back([&worker, &ok] {
+            if (!worker.run()) {
+                ok = false;
+            }
+        });
+    }
+    for (std::thread &thread: running) {
+        thread.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    size_t done = 0;
+    for (const Worker &worker: workers) {
+        done += worker.done;
+        if (!worker.error.empty()) {
+            std::cerr << worker.error << "\n";
+        }
+    }
+    std::cout << threads << " threads x " << fds.size() << " descriptors: "
+              << static_cast<double>(done) / std::chrono::duration<double>(end - start).count() << " ops/s\n";
+
+    for (int fd: fds) {
+        lab2_close(fd);
+    }
+    char byte;
+    if (lab2_pread(-1, &byte, 1, 0) != -1 || errno != EBADF || lab2_close(fds[0]) != -1 || errno != EBADF) {
+        std::cerr << "Bad descriptors are not rejected with EBADF.\n";
+        ok = false;
+    }
+    close(plain_fd);
+    for (int file = 0; file < FILES; file++) {
+        unlink(file_name(file).c_str());
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "lab2.h"
+#include "test-util.h"
+
+constexpr size_t READ_SIZE = 4096;
+const char *FILE_NAME = "tlb-bench.dat";
+
+struct Config {
+    const char *name;
+    const char *pageSize;
+    const char *hugePages;
+};
+
+struct Result {
+    double opsPerSecond;
+    long long tlbMisses;        // -1 if the counter is not available
+};
+
+// Counts data TLB read misses of this process in user space
+int open_dtlb_counter() {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+bool create_file(size_t bytes) {
+    return create_file(FILE_NAME, bytes / (1024 * 1024), 1024 * 1024, [](size_t, std::vector<char> &chunk) {
+        for (size_t i = 0; i < chunk.size(); i++) {
+            chunk[i] = static_cast<char>('a' + i % 26);
+        }
+    });
+}
+
+// Child: warms the whole file into a fresh cache, then does random 4 KB hits across it
+bool measure(size_t file_bytes, size_t operations, Result &result) {
+    initialize_library();
+    int fd = lab2_open(FILE_NAME, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    std::vector<char> buffer(READ_SIZE);
+    while (lab2_read(fd, buffer.data(), buffer.size()) > 0) {
+    }
+
+    std::mt19937_64 gen(42);
+    std::uniform_int_distribution<size_t> dis(0, file_bytes / READ_SIZE - 1);
+    int counter = open_dtlb_counter();
+    if (counter != -1) {
+        ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (size_t op = 0; op < operations; op++) {
+        lab2_lseek(fd, static_cast<off_t>(dis(gen) * READ_SIZE), SEEK_SET);
+        if (lab2_read(fd, buffer.data(), READ_SIZE) != READ_SIZE) {
+            return false;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    result = {static_cast<double>(operations) / std::chrono::duration<double>(end - start).count(), -1};
+    if (counter != -1) {
+        ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counter, &result.tlbMisses, sizeof(result.tlbMisses)) != sizeof(result.tlbMisses)) {
+            result.tlbMisses = -1;
+        }
+        close(counter);
+    }
+    lab2_close(fd);
+    return true;
+}
+
+bool run(const Config &config, size_t file_bytes, size_t operations, Result &result) {
+    return run_in_child(result, [&](Result &shared) {
+        // Room for the whole file plus a spare page, so the random phase only hits
+        std::string cache_size = std::to_string(file_bytes + 2 * 1024 * 1024);
+        setenv("LAB2_CACHE_SIZE", cache_size.c_str(), 1);
+        setenv("LAB2_PAGE_SIZE", config.pageSize, 1);
+        setenv("LAB2_HUGE_PAGES", config.hugePages, 1);
+        return measure(file_bytes, operations, shared);
+    });
+}
+
+int main(int argc, char *argv[]) {
+    size_t file_mb = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 256;
+    size_t operations = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000000;
+    size_t file_bytes = file_mb * 1024 * 1024;
+
+    if (!create_file(file_bytes)) {
+        std::cerr << "Failed to create " << FILE_NAME << ".\n";
+        return 1;
+    }
+
+    const Config configs[] = {
+            {"4 KB pages", "4K", "off"},
+            {"64 KB pages", "64K", "off"},
+            {"2 MB pages", "2M", "off"},
+            {"2 MB pages, THP", "2M", "thp"},
+            {"2 MB pages, hugetlbfs", "2M", "hugetlb"},
+    };
+    std::cout << "config | random 4 KB hits/s | dTLB read misses per hit\n";
+    int status = 0;
+    for (const Config &config: configs) {
+        Result result;
+        if (!run(config, file_bytes, operations, result)) {
+            std::cerr << config.name << ": run failed.\n";
+            status = 1;
+            continue;
+        }
+        std::cout << config.name << " | " << result.opsPerSecond << " | ";
+        if (result.tlbMisses < 0) {
+            std::cout << "n/a\n";
+        } else {
+            std::cout << static_cast<double>(result.tlbMisses) / operations << "\n";
+        }
+    }
+    unlink(FILE_NAME);
+    return status;
+}
@@ -0,0 +1,100 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lab2.h"
+#include "test-util.h"
+
+constexpr size_t CHUNK_SIZE = 256 * 1024;
+const char *FILE_NAME = "uring-bench.dat";
+
+struct Result {
+    double readMbPerSecond;     // Cold random chunk reads
+    double fsyncMs;             // Write-back of the whole file
+    unsigned long long checksum;
+};
+
+bool create_file(size_t bytes) {
+    return create_file(FILE_NAME, bytes / CHUNK_SIZE, CHUNK_SIZE, [](size_t c, std::vector<char> &chunk) {
+        for (size_t i = 0; i < chunk.size(); i++) {
+            chunk[i] = static_cast<char>('a' + (c + i) % 26);
+        }
+    });
+}
+
+// Child: random chunk reads into a fresh cache, then dirties every page and times one fsync
+bool measure(size_t file_bytes, size_t reads, Result &result) {
+    initialize_library();
+    int fd = lab2_open(FILE_NAME, O_RDWR);
+    if (fd < 0) {
+        return false;
+    }
+    std::vector<char> buffer(CHUNK_SIZE);
+    std::mt19937_64 gen(42);
+    std::uniform_int_distribution<size_t> dis(0, file_bytes / CHUNK_SIZE - 1);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reads; i++) {
+        lab2_lseek(fd, static_cast<off_t>(dis(gen) * CHUNK_SIZE), SEEK_SET);
+        if (lab2_read(fd, buffer.data(), CHUNK_SIZE) != CHUNK_SIZE) {
+            return false;
+        }
+        for (char c: buffer) {
+            result.checksum = result.checksum * 31 + static_cast<unsigned char>(c);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    result.readMbPerSecond = static_cast<double>(reads * CHUNK_SIZE) / (1024 * 1024) /
+                             std::chrono::duration<double>(end - start).count();
+
+    lab2_lseek(fd, 0, SEEK_SET);
+    for (size_t written = 0; written < file_bytes; written += CHUNK_SIZE) {
+        if (lab2_write(fd, buffer.data(), CHUNK_SIZE) != CHUNK_SIZE) {
+            return false;
+        }
+    }
+    start = std::chrono::steady_clock::now();
+    if (lab2_fsync(fd) != 0) {
+        return false;
+    }
+    end = std::chrono::steady_clock::now();
+    result.fsyncMs = std::chrono::duration<double, std::milli>(end - start).count();
+    lab2_close(fd);
+    return true;
+}
+
+// Each backend gets the same fresh file: the previous run has overwritten it
+bool run(const char *io_uring, size_t file_bytes, size_t reads, Result &result) {
+    return create_file(file_bytes) && run_in_child(result, [&](Result &shared) {
+        setenv("LAB2_IO_URING", io_uring, 1);
+        setenv("LAB2_READAHEAD_MAX", "0", 1);
+        return measure(file_bytes, reads, shared);
+    });
+}
+
+int main(int argc, char *argv[]) {
+    size_t file_mb = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 64;
+    size_t reads = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 200;
+    size_t file_bytes = std::max<size_t>(file_mb, 1) * 1024 * 1024;
+
+    Result sync_result, uring_result;
+    if (!run("0", file_bytes, reads, sync_result) || !run("1", file_bytes, reads, uring_result)) {
+        std::cerr << "Run failed.\n";
+        unlink(FILE_NAME);
+        return 1;
+    }
+    unlink(FILE_NAME);
+
+    std::cout << "backend | random 256 KB cold reads, MB/s | fsync of " << file_mb << " MB, ms\n";
+    for (auto &[name, result]: {std::pair{"preadv/pwritev", sync_result}, std::pair{"io_uring", uring_result}}) {
+        std::cout << name << " | " << result.readMbPerSecond << " | " << result.fsyncMs << "\n";
+    }
+    if (sync_result.checksum != uring_result.checksum) {
+        std::cerr << "io_uring returned different data.\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+// Статические точки трассировки USDT с провайдером lab2: в коде это один nop, а адрес и аргументы
+// лежат в заметке .note.stapsdt, по которой bpftrace ставит пробу (usdt:liblab2.so:lab2:cache_miss).
+// Есть sys/sdt.h из systemtap - берем его. Нет - на x86-64 пишем такую же заметку сами,
+// на остальных архитектурах точки пустые. Все аргументы - 64-битные беззнаковые
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define LAB2_PROBE3(name, a, b, c) DTRACE_PROBE3(lab2, name, a, b, c)
+#define LAB2_PROBE4(name, a, b, c, d) DTRACE_PROBE4(lab2, name, a, b, c, d)
+#elif defined(__x86_64__)
+// Формат заметки тот же, что у sys/sdt.h: адрес nop, база для пересчета адреса после prelink,
+// семафор (у нас нет), провайдер, имя и аргументы вида "8@%rax"
+#define LAB2_PROBE_NOTE(name, args) \
+    "990: nop\n" \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+    ".balign 4\n" \
+    ".4byte 992f-991f, 994f-993f, 3\n" \
+    "991: .asciz \"stapsdt\"\n" \
+    "992: .balign 4\n" \
+    "993: .8byte 990b\n" \
+    ".8byte _.stapsdt.base\n" \
+    ".8byte 0\n" \
+    ".asciz \"lab2\"\n" \
+    ".asciz \"" #name "\"\n" \
+    ".asciz \"" args "\"\n" \
+    "994: .balign 4\n" \
+    ".popsection\n" \
+    ".ifndef _.stapsdt.base\n" \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n" \
+    ".hidden _.stapsdt.base\n" \
+    "_.stapsdt.base: .space 1\n" \
+    ".size _.stapsdt.base, 1\n" \
+    ".popsection\n" \
+    ".endif\n"
+#define LAB2_PROBE3(name, a, b, c) \
+    __asm__ __volatile__(LAB2_PROBE_NOTE(name, "8@%0 8@%1 8@%2") \
+                         :: "nor"(static_cast<uint64_t>(a)), "nor"(static_cast<uint64_t>(b)), \
+                            "nor"(static_cast<uint64_t>(c)))
+#define LAB2_PROBE4(name, a, b, c, d) \
+    __asm__ __volatile__(LAB2_PROBE_NOTE(name, "8@%0 8@%1 8@%2 8@%3") \
+                         :: "nor"(static_cast<uint64_t>(a)), "nor"(static_cast<uint64_t>(b)), \
+                            "nor"(static_cast<uint64_t>(c)), "nor"(static_cast<uint64_t>(d)))
+#else
+#define LAB2_PROBE3(name, a, b, c) do {} while (0)
+#define LAB2_PROBE4(name, a, b, c, d) do {} while (0)
+#endif
@@ -0,0 +1,120 @@
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lab2.h"
+#include "test-util.h"
+
+constexpr size_t PAGE_SIZE = 4096;
+constexpr size_t CHUNK = 64 * PAGE_SIZE;
+const char *DATA_FILE = "warm-restart-bench.dat";
+const char *CACHE_FILE = "warm-restart-bench.cache";
+
+// What one start of the reader saw, filled in by the child process
+struct Start {
+    double warmMs;              // Time to attach and read the whole file once, the working set is cached after that
+    uint64_t diskBytesRead;
+    bool ok;
+};
+
+// Page p of version v holds p + v in every word, so stale pages are easy to spot
+bool write_data_file(size_t pages, uint64_t version) {
+    return create_file<uint64_t>(DATA_FILE, pages, PAGE_SIZE, [&](size_t p, std::vector<uint64_t> &page) {
+        std::fill(page.begin(), page.end(), p + version);
+    });
+}
+
+// Reads the file front to back and checks every page. With crash set the process dies without
+// detaching from the cache, like a killed process would
+void reader(size_t pages, uint64_t version, bool crash, Start &start) {
+    // Attaching is part of the time: that is where a warm start checks and rebuilds the cache
+    auto begin = std::chrono::steady_clock::now();
+    initialize_library();
+    int fd = lab2_open(DATA_FILE, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    std::vector<uint64_t> buffer(CHUNK / sizeof(uint64_t));
+    size_t page = 0;
+    ssize_t bytes;
+    bool ok = true;
+    while ((bytes = lab2_read(fd, buffer.data(), CHUNK)) > 0) {
+        for (ssize_t offset = 0; offset < bytes; offset += PAGE_SIZE, page++) {
+            ok = ok && buffer[offset / sizeof(uint64_t)] == page + version;
+        }
+    }
+    lab2_close(fd);
+    start.warmMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    lab2_stats stats;
+    lab2_get_stats(getpid(), &stats);
+    start.diskBytesRead = stats.diskBytesRead;
+    start.ok = ok && bytes == 0 && page == pages;
+    if (crash) {
+        _exit(0);
+    }
+}
+
+bool run_start(size_t pages, uint64_t version, bool crash, Start &result) {
+    bool exited = run_in_child(result, [&](Start &start) {
+        reader(pages, version, crash, start);
+        return true;
+    });
+    return exited && result.ok;
+}
+
+void print_start(const char *cache, const char *start, const Start &result) {
+    std::cout << cache << " | " << start << " | " << result.warmMs << " | "
+              << static_cast<double>(result.diskBytesRead) / (1024 * 1024) << "\n";
+}
+
+int main(int argc, char *argv[]) {
+    size_t megabytes = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 64;
+    size_t pages = megabytes * 1024 * 1024 / PAGE_SIZE;
+    // The whole file fits, so a warm start should not touch the disk at all
+    setenv("LAB2_CACHE_SIZE", (std::to_string(2 * megabytes) + "M").c_str(), 1);
+    if (pages == 0 || !write_data_file(pages, 0)) {
+        std::cerr << "Failed to create the data file.\n";
+        return 1;
+    }
+    unlink(CACHE_FILE);
+
+    // Shared memory goes away with the last process: every start is cold
+    Start shm_first = {}, shm_restart = {};
+    bool ok = run_start(pages, 0, false, shm_first) && run_start(pages, 0, false, shm_restart);
+
+    // Cache file: the restart finds the pages, also after a crash, but not after the file changed
+    setenv("LAB2_CACHE_FILE", CACHE_FILE, 1);
+    Start file_first = {}, file_restart = {}, file_crashed = {}, file_after_crash = {}, file_changed = {};
+    ok = ok && run_start(pages, 0, false, file_first) && run_start(pages, 0, false, file_restart) &&
+         run_start(pages, 0, true, file_crashed) && run_start(pages, 0, false, file_after_crash) &&
+         write_data_file(pages, 1) && run_start(pages, 1, false, file_changed);
+    unsetenv("LAB2_CACHE_FILE");
+    unlink(CACHE_FILE);
+    unlink(DATA_FILE);
+    if (!ok) {
+        std::cerr << "A start failed or read wrong data.\n";
+        return 1;
+    }
+
+    std::cout << "cache | start | time to read the file once, ms | disk MB read\n";
+    print_start("shared memory", "first", shm_first);
+    print_start("shared memory", "restart", shm_restart);
+    print_start("cache file", "first", file_first);
+    print_start("cache file", "restart", file_restart);
+    print_start("cache file", "restart after a crash", file_after_crash);
+    print_start("cache file", "restart after the file changed", file_changed);
+    std::cout << "warm restart speedup: " << shm_restart.warmMs / file_restart.warmMs << "x\n";
+
+    if (file_restart.diskBytesRead != 0 || file_after_crash.diskBytesRead != 0) {
+        std::cerr << "A warm restart read from the disk.\n";
+        return 1;
+    }
+    if (file_changed.diskBytesRead < pages * PAGE_SIZE) {
+        std::cerr << "Pages of the changed file were taken from the cache file.\n";
+        return 1;
+    }
+    return 0;
+}
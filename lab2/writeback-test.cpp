@@ -0,0 +1,224 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "lab2.h"
+
+constexpr size_t PAGE_SIZE = 4096;
+constexpr size_t PAGES = 64;
+constexpr size_t CACHE_PAGES = 2048;            // LAB2_CACHE_SIZE of the segment this test creates
+constexpr size_t MANY_FILES = 1100;             // More than the shared file table holds, fewer than the cache pages
+const char *FILE_NAME = "writeback-test.dat";
+const char *UNLINKED_NAME = "writeback-test-unlinked.dat";
+const char *TOO_BIG_NAME = "writeback-test-too-big.dat";
+const char *WRITE_ONLY_NAME = "writeback-test-write-only.dat";
+
+// Writer process: dirties the file through the cache and exits without fsync or close,
+// with its own flusher turned off. Only the other process can write its pages back.
+int writer(int start_fd) {
+    char go;
+    if (read(start_fd, &go, 1) != 1) {
+        return 1;
+    }
+    setenv("LAB2_FLUSHER", "0", 1);
+    initialize_library();
+    int fd = lab2_open(FILE_NAME, O_RDWR);
+    if (fd < 0) {
+        std::cerr << "Failed to open file.\n";
+        return 1;
+    }
+    char page[PAGE_SIZE];
+    for (size_t p = 0; p < PAGES; p++) {
+        memset(page, static_cast<int>('A' + p % 26), PAGE_SIZE);
+        if (lab2_write(fd, page, PAGE_SIZE) != PAGE_SIZE) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Reads the file past any cache and checks that every page holds the writer's data
+bool file_written() {
+    int fd = open(FILE_NAME, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    char page[PAGE_SIZE];
+    bool written = true;
+    for (size_t p = 0; p < PAGES && written; p++) {
+        written = pread(fd, page, PAGE_SIZE, static_cast<off_t>(p * PAGE_SIZE)) == PAGE_SIZE &&
+                  page[0] == static_cast<char>('A' + p % 26) && page[PAGE_SIZE - 1] == page[0];
+    }
+    close(fd);
+    return written;
+}
+
+// A file removed while open has no path to reopen it by: eviction writes its dirty pages back
+// through the descriptor. Writes twice the cache, then reads every page back
+bool unlinked_file_written_back() {
+    int create_fd = open(UNLINKED_NAME, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (create_fd < 0) {
+        return false;
+    }
+    close(create_fd);
+    int fd = lab2_open(UNLINKED_NAME, O_RDWR);
+    unlink(UNLINKED_NAME);
+    if (fd < 0) {
+        return false;
+    }
+    char page[PAGE_SIZE];
+    bool written = true;
+    for (size_t p = 0; p < 2 * CACHE_PAGES && written; p++) {
+        memset(page, static_cast<int>('a' + p % 26), PAGE_SIZE);
+        written = lab2_write(fd, page, PAGE_SIZE) == PAGE_SIZE;
+    }
+    written = written && lab2_lseek(fd, 0, SEEK_SET) == 0;
+    for (size_t p = 0; p < 2 * CACHE_PAGES && written; p++) {
+        written = lab2_read(fd, page, PAGE_SIZE) == PAGE_SIZE &&
+                  page[0] == static_cast<char>('a' + p % 26) && page[PAGE_SIZE - 1] == page[0];
+    }
+    lab2_close(fd);
+    return written;
+}
+
+// Closed files keep their pages in the cache and their slots in the shared file table.
+// Opening more distinct files than the table holds frees the slots of closed ones
+bool many_files_opened() {
+    char page[PAGE_SIZE] = {'m'};
+    bool opened = true;
+    size_t created = 0;
+    for (; created < MANY_FILES && opened; created++) {
+        std::string name = "writeback-test-many-" + std::to_string(created) + ".dat";
+        int create_fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (create_fd >= 0) {
+            close(create_fd);
+        }
+        int fd = lab2_open(name.c_str(), O_RDWR);
+        opened = fd >= 0 && lab2_write(fd, page, PAGE_SIZE) == PAGE_SIZE && lab2_close(fd) == 0;
+    }
+    for (size_t i = 0; i < created; i++) {
+        unlink(("writeback-test-many-" + std::to_string(i) + ".dat").c_str());
+    }
+    return opened;
+}
+
+// lab2_close reports a write-back that failed, like close(2) after a failed delayed write: the file size
+// limit lets the cached write past it through and stops its write-back. The pages stay dirty and reach the file
+// once the limit is lifted
+bool close_reports_failed_flush() {
+    char page[PAGE_SIZE];
+    memset(page, 'b', PAGE_SIZE);
+    int create_fd = open(TOO_BIG_NAME, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (create_fd < 0) {
+        return false;
+    }
+    close(create_fd);
+    struct rlimit limit;
+    getrlimit(RLIMIT_FSIZE, &limit);
+    struct rlimit small = {PAGE_SIZE, limit.rlim_max};
+    signal(SIGXFSZ, SIG_IGN);
+    int fd = lab2_open(TOO_BIG_NAME, O_RDWR);
+    bool reported = fd >= 0 && setrlimit(RLIMIT_FSIZE, &small) == 0 &&
+                    lab2_lseek(fd, PAGE_SIZE, SEEK_SET) == PAGE_SIZE &&
+                    lab2_write(fd, page, PAGE_SIZE) == PAGE_SIZE && lab2_close(fd) == -1 && errno == EFBIG;
+    setrlimit(RLIMIT_FSIZE, &limit);
+    signal(SIGXFSZ, SIG_DFL);
+    fd = lab2_open(TOO_BIG_NAME, O_RDWR);
+    struct stat file_stat;
+    reported = reported && fd >= 0 && lab2_fsync(fd) == 0 && lab2_close(fd) == 0 &&
+               stat(TOO_BIG_NAME, &file_stat) == 0 && file_stat.st_size == 2 * PAGE_SIZE;
+    unlink(TOO_BIG_NAME);
+    return reported;
+}
+
+// A write into the middle of a block of an O_WRONLY file keeps the bytes around it:
+// the rest of the block is read from disk even though the descriptor cannot read
+bool write_only_keeps_edges() {
+    char page[PAGE_SIZE];
+    memset(page, 'w', PAGE_SIZE);
+    int create_fd = open(WRITE_ONLY_NAME, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    bool kept = create_fd >= 0 && write(create_fd, page, PAGE_SIZE) == PAGE_SIZE;
+    if (create_fd >= 0) {
+        close(create_fd);
+    }
+    int fd = kept ? lab2_open(WRITE_ONLY_NAME, O_WRONLY) : -1;
+    kept = fd >= 0 && lab2_pwrite(fd, "X", 1, 1) == 1 && lab2_close(fd) == 0;
+    int check_fd = open(WRITE_ONLY_NAME, O_RDONLY);
+    kept = kept && check_fd >= 0 && pread(check_fd, page, PAGE_SIZE, 0) == PAGE_SIZE && page[0] == 'w' &&
+           page[1] == 'X' && page[2] == 'w' && page[PAGE_SIZE - 1] == 'w';
+    if (check_fd >= 0) {
+        close(check_fd);
+    }
+    unlink(WRITE_ONLY_NAME);
+    return kept;
+}
+
+int main() {
+    int create_fd = open(FILE_NAME, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (create_fd < 0 || ftruncate(create_fd, PAGES * PAGE_SIZE) != 0) {
+        std::cerr << "Failed to create file.\n";
+        return 1;
+    }
+    close(create_fd);
+
+    int start_pipe[2];
+    if (pipe(start_pipe) != 0) {
+        return 1;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(start_pipe[1]);
+        exit(writer(start_pipe[0]));
+    }
+    close(start_pipe[0]);
+
+    // Attach first so the segment outlives the writer, with a short dirty age
+    setenv("LAB2_DIRTY_EXPIRE_MS", "100", 1);
+    setenv("LAB2_CACHE_SIZE", std::to_string(CACHE_PAGES * PAGE_SIZE).c_str(), 1);
+    initialize_library();
+    write(start_pipe[1], "g", 1);
+    close(start_pipe[1]);
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::cerr << "Writer failed.\n";
+        unlink(FILE_NAME);
+        return 1;
+    }
+
+    bool written = false;
+    for (int attempt = 0; attempt < 50 && !written; attempt++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        written = file_written();
+    }
+    unlink(FILE_NAME);
+    if (!written) {
+        std::cerr << "Background flusher did not write the pages back.\n";
+        return 1;
+    }
+    std::cout << "Dirty pages of an exited process were written back in the background.\n";
+    if (!unlinked_file_written_back()) {
+        std::cerr << "Dirty pages of a removed file were not written back.\n";
+        return 1;
+    }
+    if (!many_files_opened()) {
+        std::cerr << "Opening more files than the shared file table holds failed.\n";
+        return 1;
+    }
+    if (!close_reports_failed_flush()) {
+        std::cerr << "lab2_close did not report a failed write-back.\n";
+        return 1;
+    }
+    if (!write_only_keeps_edges()) {
+        std::cerr << "A partial write through an O_WRONLY descriptor lost the bytes around it.\n";
+        return 1;
+    }
+    return 0;
+}